@@ -17,6 +17,11 @@ TIMESTAMP_INFO_FIELD = "timestamp"
 
 CONSOLE_HISTORY_SIZE = 4000
 
+TOF_STATES = ["Off", "Resetting", "Booting", "Configuring", "On", "Failed"]
+TIMESTAMPED_SENSORS = ["AVG", "AVD", "FARG", "FARD", "ARG", "ARD", "ACT_AVG", "ACT_AVD"]
+SCAN_RESOLUTION = 101
+SCAN_MAX_CANDIDATES = 4
+
 
 class Command:
     def __init__(self, ID, name, commandType, inputFormat, outputFormat, outputInfoFrame=False):
@@ -97,7 +102,8 @@ Command(0x00, "Odometry and Sensors", CommandType.SUBSCRIPTION_SCATTER_DATA, [Fi
          Field("ToF ARG", int, description="mm"),
          Field("ToF ARD", int, description="mm"),
          Field("ToF ACT_AVG", int, description="mm"),
-         Field("ToF ACT_AVD", int, description="mm")]),
+         Field("ToF ACT_AVD", int, description="mm"),
+         Field("Predicted arrival", int, description="ms (robot clock), 0 if unknown")]),
 
 Command(0x01, "Info", CommandType.SUBSCRIPTION_TEXT, [Field("Subscribe", Enum, ["No", "Yes"])], [InfoField("Info")], outputInfoFrame=True),
 Command(0x02, "Error", CommandType.SUBSCRIPTION_TEXT, [Field("Subscribe", Enum, ["No", "Yes"])], [InfoField("Error")], outputInfoFrame=True),
@@ -136,16 +142,69 @@ Command(0x0B, "Stopping mgr", CommandType.SUBSCRIPTION_CURVE_DATA, [Field("Subsc
         [InfoField(TIMESTAMP_INFO_FIELD),
          InfoField("Current speed", QColor(0, 255, 0), description="mm/s"),
          InfoField("Robot stopped", QColor(255, 0, 0), description="boolean")], outputInfoFrame=True),
+Command(0x0C, "Sensors timestamped", CommandType.SUBSCRIPTION_SCATTER_DATA, [Field("Subscribe", Enum, ["No", "Yes"])],
+        [Field("Time", int, description="ms (robot clock)")] +
+        [f for name in TIMESTAMPED_SENSORS for f in (
+            Field(name + " value", int, description="mm, or 0: dead, 1: not updated, 2: too close, 3: no obstacle"),
+            Field(name + " age", int, description="us since the measure, -1 (UINT32_MAX): no measure yet"),
+            Field(name + " robot x", int, description="mm, robot position at the time of the measure"),
+            Field(name + " robot y", int, description="mm"),
+            Field(name + " robot angle", float, description="radians"))]),
+Command(0x0D, "Scan profile", CommandType.SUBSCRIPTION_SCATTER_DATA, [Field("Subscribe", Enum, ["No", "Yes"])],
+        [Field("y min", float, description="mm, fork position of the first bin"),
+         Field("y max", float, description="mm, fork position of the last bin")] +
+        [Field("Bin %d" % i, Enum, ["%d" % d for d in range(255)] + ["Empty"], description="mm")
+         for i in range(SCAN_RESOLUTION)]),
+Command(0x0E, "Puck tracking", CommandType.SUBSCRIPTION_SCATTER_DATA, [Field("Subscribe", Enum, ["No", "Yes"])],
+        [Field("Valid", bool),
+         Field("x", int, description="mm"),
+         Field("y", int, description="mm"),
+         Field("Fork y", float, description="mm"),
+         Field("Nb points", int),
+         Field("RMS", float, description="mm")]),
+Command(0x0F, "Trajectory request", CommandType.SUBSCRIPTION_SCATTER_DATA, [Field("Subscribe", Enum, ["No", "Yes"])],
+        [Field("Next index", int),
+         Field("Free room", int, description="points")]),
+Command(0x10, "Command credits", CommandType.SUBSCRIPTION_SCATTER_DATA, [Field("Subscribe", Enum, ["No", "Yes"])],
+        [Field("Free slots", Enum, ["%d" % i for i in range(256)]),
+         Field("Buffer size", Enum, ["%d" % i for i in range(256)]),
+         Field("Received frames", int, description="from this client since its connection")]),
+Command(0x11, "Sensors health", CommandType.SUBSCRIPTION_SCATTER_DATA, [Field("Subscribe", Enum, ["No", "Yes"])],
+        [Field("AVG state", Enum, TOF_STATES),
+         Field("AVG restarts", int),
+         Field("AVG age", int, description="ms since the last measure"),
+         Field("AVD state", Enum, TOF_STATES),
+         Field("AVD restarts", int),
+         Field("AVD age", int, description="ms since the last measure"),
+         Field("FARG state", Enum, TOF_STATES),
+         Field("FARG restarts", int),
+         Field("FARG age", int, description="ms since the last measure"),
+         Field("FARD state", Enum, TOF_STATES),
+         Field("FARD restarts", int),
+         Field("FARD age", int, description="ms since the last measure"),
+         Field("ARG state", Enum, TOF_STATES),
+         Field("ARG restarts", int),
+         Field("ARG age", int, description="ms since the last measure"),
+         Field("ARD state", Enum, TOF_STATES),
+         Field("ARD restarts", int),
+         Field("ARD age", int, description="ms since the last measure")]),
 
 
 # Long orders
-Command(0x20, "Follow trajectory",  CommandType.LONG_ORDER, [], [Field("Move state", int)]),
+Command(0x20, "Follow trajectory",  CommandType.LONG_ORDER, [Field("Streaming", Enum, ["No", "Yes"])], [Field("Move state", int)]),
 Command(0x21, "Stop",               CommandType.LONG_ORDER, [], []),
 Command(0x22, "Wait for jumper",    CommandType.LONG_ORDER, [], []),
 Command(0x23, "Start match chrono", CommandType.LONG_ORDER, [], []),
 Command(0x24, "Actuator Go Home",   CommandType.LONG_ORDER, [], [Field("Return code", int)]),
 Command(0x25, "Actuator Go To",     CommandType.LONG_ORDER, [Field("y", float), Field("z", float), Field("theta", float)], [Field("Return code", int)]),
-Command(0x26, "Actuator Find Puck", CommandType.LONG_ORDER, [Field("Goldenium", bool)], [Field("y", float), Field("d", int), Field("Return code", int)]),
+Command(0x26, "Actuator Find Puck", CommandType.LONG_ORDER, [Field("Goldenium", bool)],
+        [Field("y", float), Field("d", int), Field("Return code", int),
+         Field("Nb candidates", Enum, ["%d" % i for i in range(SCAN_MAX_CANDIDATES + 1)])] +
+        [f for i in range(SCAN_MAX_CANDIDATES) for f in (
+            Field("Candidate %d y" % i, float, description="mm"),
+            Field("Candidate %d d" % i, int, description="mm"),
+            Field("Candidate %d width" % i, float, description="mm"),
+            Field("Candidate %d confidence" % i, float, description="0 after the last candidate"))]),
 Command(0x27, "Act Go To at Speed", CommandType.LONG_ORDER,
         [Field("y", float),
          Field("z", float),
@@ -154,6 +213,21 @@ Command(0x27, "Act Go To at Speed", CommandType.LONG_ORDER,
          Field("z-speed", int),
          Field("theta-speed", int)],
         [Field("Return code", int)]),
+Command(0x28, "Act Go To Waypoints", CommandType.LONG_ORDER,
+        [Field("Mode", Enum, ["Append", "Preempt"]),
+         Field("y", float),
+         Field("z", float),
+         Field("theta", float),
+         Field("y-speed", int),
+         Field("z-speed", int),
+         Field("theta-speed", int, description="Further waypoints may follow (same layout)")],
+        [Field("Return code", int)]),
+Command(0x29, "Run sequence",       CommandType.LONG_ORDER,
+        [Field("Program", Enum, ["0x%02X" % i for i in range(256)], repeatable=True,
+               description="Bytecode: CALL 01 id timeout(2) len args | JUMP_IF 02 cond offset mask(4) value(4) target | JUMP 03 target | END 04 code")],
+        [Field("End code", Enum, ["%d" % i for i in range(252)] + ["Refused", "Invalid program", "Runtime error", "Cancelled"]),
+         Field("Calls", int),
+         Field("Last instruction", int)]),
 
 
 # Short orders
@@ -222,5 +296,104 @@ Command(0xA1, "Get sensors last update",CommandType.SHORT_ORDER, [],
          Field("FARD", int, description="ms"),
          Field("ARG", int, description="ms"),
          Field("ARD", int, description="ms")]),
+Command(0xA2, "Get boot timeline",      CommandType.SHORT_ORDER, [],
+        [Field("Dashboard", Enum, ["Pending", "Running", "OK", "Failed"]),
+         Field("Dashboard start", int, description="us"),
+         Field("Dashboard end", int, description="us"),
+         Field("Ethernet", Enum, ["Pending", "Running", "OK", "Failed"]),
+         Field("Ethernet start", int, description="us"),
+         Field("Ethernet end", int, description="us"),
+         Field("AX12 bus", Enum, ["Pending", "Running", "OK", "Failed"]),
+         Field("AX12 bus start", int, description="us"),
+         Field("AX12 bus end", int, description="us"),
+         Field("Direction", Enum, ["Pending", "Running", "OK", "Failed"]),
+         Field("Direction start", int, description="us"),
+         Field("Direction end", int, description="us"),
+         Field("Actuators", Enum, ["Pending", "Running", "OK", "Failed"]),
+         Field("Actuators start", int, description="us"),
+         Field("Actuators end", int, description="us"),
+         Field("ToF sensors", Enum, ["Pending", "Running", "OK", "Failed"]),
+         Field("ToF sensors start", int, description="us"),
+         Field("ToF sensors end", int, description="us"),
+         Field("Control", Enum, ["Pending", "Running", "OK", "Failed"]),
+         Field("Control start", int, description="us"),
+         Field("Control end", int, description="us"),
+         Field("Trajectory library", Enum, ["Pending", "Running", "OK", "Failed"]),
+         Field("Trajectory library start", int, description="us"),
+         Field("Trajectory library end", int, description="us")]),
+Command(0xA3, "Actuator track puck",    CommandType.SHORT_ORDER, [Field("Enable", bool)],
+        [Field("Ret code", Enum, ["Success", "Failure"]),
+         Field("Valid", bool),
+         Field("x", int, description="mm"),
+         Field("y", int, description="mm"),
+         Field("Fork y", float, description="mm")]),
+Command(0xA4, "Cancel long order",      CommandType.SHORT_ORDER,
+        [Field("Order ID", int, description="orders called by a sequence are not cancelled, cancel the sequence")],
+        [Field("Cancelled", int)]),
+Command(0xA5, "Add trajectory action",  CommandType.SHORT_ORDER,
+        [Field("Trigger", Enum, ["Index", "Distance to end"]),
+         Field("Value", int, description="Trajectory index, or distance to the end (mm)"),
+         Field("Action", Enum, ["Actuator"]),
+         Field("Mode", Enum, ["Append", "Preempt"]),
+         Field("y", float),
+         Field("z", float),
+         Field("theta", float),
+         Field("y-speed", int),
+         Field("z-speed", int),
+         Field("theta-speed", int)],
+        [Field("Return code", Enum, ["OK", "Invalid", "Full"])]),
+Command(0xA6, "Clear trajectory actions", CommandType.SHORT_ORDER, [], []),
+Command(0xA7, "Append timed traj pt", CommandType.SHORT_ORDER,
+        [Field("x", int, repeatable=True),
+         Field("y", int, repeatable=True),
+         Field("angle", float, repeatable=True),
+         Field("curvature", float, repeatable=True),
+         Field("speed", float, repeatable=True),
+         Field("stop point", bool, repeatable=True),
+         Field("end of traj", bool, repeatable=True),
+         Field("arrival time", int, repeatable=True, description="ms since the start of the move, 0 for none")],
+        [Field("Ret code", Enum, ["Success", "Failure"])]),
+Command(0xA8, "Set speed scale",        CommandType.SHORT_ORDER, [Field("Scale", float, default=1, description="0 to 1, 0 pauses the move, kept across moves")], []),
+Command(0xA9, "Prepare splice", CommandType.SHORT_ORDER,
+        [Field("index", int, description="First trajectory point replaced"),
+         Field("x", int, repeatable=True),
+         Field("y", int, repeatable=True),
+         Field("angle", float, repeatable=True),
+         Field("curvature", float, repeatable=True),
+         Field("speed", float, repeatable=True),
+         Field("stop point", bool, repeatable=True),
+         Field("end of traj", bool, repeatable=True)],
+        [Field("Ret code", Enum, ["Success", "Failure"])]),
+Command(0xAA, "Append to splice", CommandType.SHORT_ORDER,
+        [Field("x", int, repeatable=True),
+         Field("y", int, repeatable=True),
+         Field("angle", float, repeatable=True),
+         Field("curvature", float, repeatable=True),
+         Field("speed", float, repeatable=True),
+         Field("stop point", bool, repeatable=True),
+         Field("end of traj", bool, repeatable=True)],
+        [Field("Ret code", Enum, ["Success", "Failure"])]),
+Command(0xAB, "Commit splice",          CommandType.SHORT_ORDER, [], [Field("Ret code", Enum, ["Success", "Failure"])]),
+Command(0xAC, "Store trajectory",       CommandType.SHORT_ORDER,
+        [Field("ID", Enum, ["%d" % i for i in range(32)]),
+         Field("Reset", bool, description="Start a new trajectory. The last frame writes the SD card (tens of ms, before the match)"),
+         Field("x", int, repeatable=True),
+         Field("y", int, repeatable=True),
+         Field("angle", float, repeatable=True),
+         Field("curvature", float, repeatable=True),
+         Field("speed", float, repeatable=True),
+         Field("stop point", bool, repeatable=True),
+         Field("end of traj", bool, repeatable=True)],
+        [Field("Ret code", Enum, ["OK", "Unknown", "Hash mismatch", "Invalid", "Storage error", "Edition failure"]),
+         Field("Hash", int, description="Set once the end point is stored (32 bits, shown signed)")]),
+Command(0xAD, "Load stored trajectory", CommandType.SHORT_ORDER,
+        [Field("ID", Enum, ["%d" % i for i in range(255)] + ["Any (by hash)"], default=255),
+         Field("Hash", int, description="0: any (32 bits, signed)")],
+        [Field("Ret code", Enum, ["OK", "Unknown", "Hash mismatch", "Invalid", "Storage error", "Edition failure"]),
+         Field("Hash", int)]),
+Command(0xFE, "Emergency stop",         CommandType.SHORT_ORDER, [],
+        [Field("Processing time", int, description="us, from the first byte read to the brake start"),
+         Field("Waiting time", int, description="us, upper bound of the time spent before the first byte was read"),
+         Field("Worst delay", int, description="us, since boot")]),
 ]
 
@@ -261,7 +261,8 @@ public class CommProtocol
 		ROBOT_BLOCAGE_EXTERIEUR,
 		ROBOT_BLOCAGE_INTERIEUR,
 		TROP_LOIN,
-		PLUS_DE_POINTS;
+		PLUS_DE_POINTS,
+		ORDRE_REFUSE;
 		
 		private final int masque = 1 << ordinal();
 		
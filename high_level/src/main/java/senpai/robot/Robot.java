@@ -89,6 +89,7 @@ public class Robot
 	private boolean graphicPath;
 	private volatile boolean cinematiqueInitialised = false;
 	private int currentIndexTrajectory = 0;
+	private volatile int predictedArrivalTime = 0; // ms, horloge du bas niveau (0 : inconnue)
 	private int score;
 //	private CircularObstacle[] lidarObs = new CircularObstacle[100]; // pas plus de cent obstacles
 //	private volatile boolean enableLidar;
@@ -671,6 +672,20 @@ public class Robot
 		return currentIndexTrajectory;
 	}
 
+	public void setPredictedArrivalTime(int predictedArrivalTime)
+	{
+		this.predictedArrivalTime = predictedArrivalTime;
+	}
+
+	/**
+	 * Heure d'arrivée prévue au prochain point daté de la trajectoire (ou à sa fin), en ms sur l'horloge du bas niveau.
+	 * Vaut 0 si elle est inconnue.
+	 */
+	public int getPredictedArrivalTime()
+	{
+		return predictedArrivalTime;
+	}
+
 	public void printTemps()
 	{
 		log.write("Temps depuis le début du match : "+(System.currentTimeMillis() - dateDebutMatch), Subject.STATUS);
@@ -131,6 +131,11 @@ public class ThreadCommProcess extends Thread
 							log.write("Capteur " + c.name() + " : " + (m < CommProtocol.EtatCapteur.values().length ? CommProtocol.EtatCapteur.values()[m] : m), Subject.CAPTEURS);
 					}
 					
+					/**
+					 * Heure d'arrivée prévue (horloge du bas niveau, en ms), toujours en fin de trame
+					 */
+					robot.setPredictedArrivalTime(data.getInt(data.capacity() - 4));
+
 					current.enMarcheAvant = enMarcheAvant;
 					current.updateReel(xRobot, yRobot, orientationRobot, courbure);
 					robot.setCurrentTrajectoryIndex(current, indexTrajectory);
@@ -9,18 +9,25 @@
 #include <Printable.h>
 #include <vector>
 #include "SerialAX12.h"
+#include "DynamixelBusMgr.h"
 #include "Singleton.h"
 #include "Serializer.h"
 #include "Config.h"
 #include "CommunicationServer.h"
 #include "PuckScanner.h"
+#include "SensorsMgr.h"
+#include "StepperRamp.h"
 
-#define ACT_MGR_INTERRUPT_PERIOD    (100)       // µs
 #define ACT_MGR_POLL_PERIOD         (5000)      // µs
+#define ACT_MGR_SCAN_POLL_PERIOD    (2000)      // µs (pendant un scan)
+#define ACT_MGR_PREDICTION_HORIZON  (10000)     // µs (durée maximale d'extrapolation de la position d'un AX12)
 #define ACT_MGR_MOVE_TIMEOUT        (12000)     // ms
 #define ACT_MGR_Y_TOLERANCE         (1.5)       // mm
 #define ACT_MGR_Z_TOLERANCE         (0.01)      // mm
 #define ACT_MGR_THETA_TOLERANCE     (5.0)       // deg
+#define ACT_MGR_Y_BLEND             (4.0)       // mm (distance à laquelle un point de passage est considéré atteint)
+#define ACT_MGR_Z_BLEND             (3.0)       // mm
+#define ACT_MGR_THETA_BLEND         (10.0)      // deg
 #define ACT_MGR_Y_MIN               (-23.795)   // mm (47.59 / 2)
 #define ACT_MGR_Y_MAX               (23.795)    // mm
 #define ACT_MGR_Z_MIN               (0.0)       // mm
@@ -36,9 +43,22 @@
 #define ACT_MGR_STEP_PER_TURN       (200)       // step/turn
 #define ACT_MGR_Z_PER_TURN          (8.0)       // mm/turn
 #define ACT_MGR_MAX_SPEED_Y         (1023)      // AX12 speed unit (1023 is max, 1 is min, 0 means non coltrolled)
-#define ACT_MGR_MAX_SPEED_Z         (300)       // rpm
+/*
+    Une interruption par micropas : 16 kHz à la vitesse maximale de 300 rpm,
+    pendant les mouvements de z seulement. L'interruption dure environ 2 µs
+    (impulsion de STEP comprise), soit moins de 4 % du temps CPU au pire.
+*/
+#define ACT_MGR_Z_MAX_STEP_RATE     (16000)     // microstep/s
+#define ACT_MGR_MAX_SPEED_Z         (ACT_MGR_Z_MAX_STEP_RATE * 60 / (ACT_MGR_STEP_PER_TURN * ACT_MGR_MICROSTEP))   // rpm (300)
+#define ACT_MGR_Z_STEP_PULSE        (1)         // µs (durée minimale de l'impulsion de STEP de l'A4988)
+#define ACT_MGR_Z_SPEED_CHANGE      (0.1)       // Variation relative de la vitesse de z qui relance le mouvement en cours
+#define ACT_MGR_Z_ACCELERATION      (5000)      // full step/s²
+#define ACT_MGR_Z_DECELERATION      (5000)      // full step/s²
+#define ACT_MGR_Z_STEP_PRIORITY     (252)       // Priorité de l'interruption de pas du moteur Z
 #define ACT_MGR_MAX_SPEED_THETA     (1023)      // AX12 speed unit
-#define ACT_MGR_SCANNING_SPEED      (130)       // AX12 speed unit
+#define ACT_MGR_AX12_SPEED_UNIT     (0.666)     // deg/s (0.111 rpm)
+#define ACT_MGR_SCANNING_SPEED      (390)       // AX12 speed unit
+#define ACT_MGR_QUEUE_SIZE          (16)        // Nombre de points de passage en attente
 
 
 typedef int32_t ActuatorErrorCode;
@@ -56,6 +76,8 @@ enum ActuatorError
     ACT_TIMED_OUT           = 0x0100,
     ACT_ALREADY_MOVING      = 0x0200,
     ACT_NOT_HOMED           = 0x0400,
+    ACT_PREEMPTED           = 0x0800,
+    ACT_QUEUE_FULL          = 0x1000,
 };
 
 
@@ -80,6 +102,15 @@ public:
             p.theta <= theta + ACT_MGR_THETA_TOLERANCE;
     }
 
+    /* Point de passage : la consigne suivante peut être envoyée sans attendre l'arrêt */
+    bool isCloseTo(const ActuatorPosition & p) const
+    {
+        return
+            fabsf(p.y - y) <= ACT_MGR_Y_BLEND &&
+            fabsf(p.z - z) <= ACT_MGR_Z_BLEND &&
+            fabsf(p.theta - theta) <= ACT_MGR_THETA_BLEND;
+    }
+
     bool isWithinRange() const
     {
         return
@@ -118,6 +149,16 @@ public:
 };
 
 
+/* Point de passage d'une séquence de mouvements, avec ses vitesses maximales */
+struct ActuatorWaypoint
+{
+    ActuatorPosition position;
+    int32_t y_speed;        // AX12 speed unit
+    int32_t z_speed;        // rpm
+    int32_t theta_speed;    // AX12 speed unit
+};
+
+
 class ActuatorMgr : public Singleton<ActuatorMgr>
 {
 public:
@@ -126,13 +167,31 @@ public:
         m_theta_motor(SerialAX12, ID_AX12_ACT_THETA),
         m_z_motor(ACT_MGR_STEP_PER_TURN, PIN_STEPPER_DIR, PIN_STEPPER_STEP,
             PIN_STEPPER_SLEEP, PIN_MICROSTEP_1, PIN_MICROSTEP_2, PIN_MICROSTEP_3),
-        m_puck_scanner(ACT_MGR_Y_MIN, ACT_MGR_Y_MAX)
+        m_z_ramp(ACT_MGR_Z_ACCELERATION * ACT_MGR_MICROSTEP, ACT_MGR_Z_DECELERATION * ACT_MGR_MICROSTEP),
+        m_puck_scanner(ACT_MGR_Y_MIN, ACT_MGR_Y_MAX),
+        m_bus(DynamixelBusMgr::Instance())
     {
+        m_bus.addServo(ID_AX12_ACT_Y, DYN_BUS_PRIORITY_NORMAL);
+        m_bus.addServo(ID_AX12_ACT_THETA, DYN_BUS_PRIORITY_NORMAL);
+        m_y_sample_count = 0;
+        m_theta_sample_count = 0;
+        m_y_sample_time = 0;
+        m_theta_sample_time = 0;
+        m_y_cmd_speed = ACT_MGR_MAX_SPEED_Y;
+        m_theta_cmd_speed = ACT_MGR_MAX_SPEED_THETA;
         m_error_code = ACT_OK;
         m_status = STATUS_IDLE;
         m_left_sensor_value = (SensorValue)SENSOR_DEAD;
         m_right_sensor_value = (SensorValue)SENSOR_DEAD;
-        m_z_current_move_origin = 0;
+        m_left_sensor_time = 0;
+        m_right_sensor_time = 0;
+        m_z_position = 0;
+        m_z_direction = 1;
+        m_z_move_target = 0;
+        m_z_move_rpm = 0;
+        m_queue_head = 0;
+        m_queue_count = 0;
+        m_command_id = 0;
         m_z_homed = false;
         m_composed_move_step = 0;
         m_move_start_time = 0;
@@ -145,7 +204,7 @@ public:
 
     int init()
     {
-        int ret = m_puck_scanner.init();
+        int ret = EXIT_SUCCESS;
 
         if (m_y_motor.init() == DYN_STATUS_OK)
         {
@@ -167,12 +226,37 @@ public:
         m_z_motor.setMicrostep(ACT_MGR_MICROSTEP);
         m_z_motor.disable();
         interrupts();
+        m_z_step_timer.priority(ACT_MGR_Z_STEP_PRIORITY);
 
         return ret;
     }
 
+    /* Les capteurs de la fourche démarrent en arrière plan, cf. sensorsBooting() */
+    void startSensorsInit()
+    {
+        m_puck_scanner.startInit();
+    }
+
+    bool sensorsBooting() const
+    {
+        return m_puck_scanner.isBooting();
+    }
+
+    int sensorsInitResult() const
+    {
+        return m_puck_scanner.initResult();
+    }
+
+    void updateSensorsBoot()
+    {
+        if (m_puck_scanner.isBooting()) {
+            m_puck_scanner.updateInit();
+        }
+    }
+
     void mainLoopControl()
     {
+        updateSensorsBoot();
         readSensorsAndMotors();
         switch (m_status)
         {
@@ -185,10 +269,13 @@ public:
         case STATUS_SCANNING:
             scanningHandler();
             break;
+        case STATUS_TRACKING:
+            trackingHandler();
+            break;
         default:
             break;
         }
-        if (m_status != STATUS_IDLE)
+        if (m_status != STATUS_IDLE && m_status != STATUS_TRACKING)
         {
             if (millis() - m_move_start_time > ACT_MGR_MOVE_TIMEOUT)
             {
@@ -198,14 +285,15 @@ public:
         }
     }
 
-    void interruptControl()
+    /*
+        Interruption de pas du moteur Z : le timer est reprogrammé à chaque pas
+        avec l'intervalle calculé par le profil de vitesse (rampes d'accélération
+        et de décélération, cf. StepperRamp), puis arrêté à la fin du mouvement.
+    */
+    static void zStepInterrupt()
     {
-        static uint32_t last_action_time = 0;
-        static uint32_t wait_time = 0;
-        if (micros() - last_action_time > wait_time) {
-            wait_time = m_z_motor.nextAction();
-            last_action_time = micros();
-        }
+        static ActuatorMgr &actuatorMgr = ActuatorMgr::Instance();
+        actuatorMgr.zStep();
     }
 
     bool commandCompleted() const
@@ -213,6 +301,26 @@ public:
         return m_status == STATUS_IDLE;
     }
 
+    /*
+        Identifiant de la commande en cours, changé à chaque nouveau mouvement
+        (ou préemption). Un ajout en file ne le change pas : la commande se
+        termine quand la file est vide.
+    */
+    uint32_t getCommandId() const
+    {
+        return m_command_id;
+    }
+
+    bool commandCompleted(uint32_t command_id) const
+    {
+        return m_status == STATUS_IDLE || commandPreempted(command_id);
+    }
+
+    bool commandPreempted(uint32_t command_id) const
+    {
+        return m_command_id != command_id;
+    }
+
     ActuatorErrorCode getErrorCode() const
     {
         return m_error_code;
@@ -251,6 +359,26 @@ public:
         }
     }
 
+    void appendTimestampedSensorsValuesToVect(std::vector<uint8_t> & output,
+        const MotionControlSystem & motionControlSystem, uint32_t now) const
+    {
+        if (canUseSensors())
+        {
+            SensorsMgr::appendTimestampedValueToVect(m_left_sensor_value, m_left_sensor_time,
+                motionControlSystem, now, output);
+            SensorsMgr::appendTimestampedValueToVect(m_right_sensor_value, m_right_sensor_time,
+                motionControlSystem, now, output);
+        }
+        else
+        {
+            // Aucune mesure exploitable : pas d'âge
+            SensorsMgr::appendTimestampedValueToVect((SensorValue)NO_OBSTACLE, 0,
+                motionControlSystem, now, output);
+            SensorsMgr::appendTimestampedValueToVect((SensorValue)NO_OBSTACLE, 0,
+                motionControlSystem, now, output);
+        }
+    }
+
     float getLastScanResultY() const
     {
         return m_last_scan_result_y;
@@ -261,6 +389,11 @@ public:
         return m_last_scan_result_d;
     }
 
+    void appendScanCandidatesToVect(std::vector<uint8_t> & output) const
+    {
+        m_puck_scanner.appendCandidatesToVect(output);
+    }
+
     /* Mouvement control */
     void stop() { stopMove(true); }
     int goToHome()
@@ -274,6 +407,72 @@ public:
         m_golden_mode = goldenium;
         return initMove(STATUS_SCANNING, m_current_position);
     }
+
+    /*
+        Suivi du palet pendant l'approche : la fourche balaye en continu et
+        la position du palet sur la table est affinée à chaque mesure
+    */
+    int startPuckTracking()
+    {
+        setSpeedToMax();
+        return initMove(STATUS_TRACKING, m_current_position);
+    }
+
+    /*
+        Fin du suivi : si l'estimation est valide, la fourche est envoyée
+        directement en face du palet. Renvoie EXIT_FAILURE sinon.
+    */
+    int stopPuckTracking()
+    {
+        if (m_status != STATUS_TRACKING) {
+            return EXIT_FAILURE;
+        }
+        float x, y, fork_y;
+        if (!getTrackedPuck(x, y, fork_y)) {
+            finishMove();
+            m_aim_position.y = m_current_position.y;
+            sendAimPosition();
+            return EXIT_FAILURE;
+        }
+        m_puck_scanner.enableTracking(false);
+        setSpeedToMax();
+        m_aim_position.y = constrain(fork_y, ACT_MGR_Y_MIN, ACT_MGR_Y_MAX);
+        m_last_scan_result_y = m_aim_position.y;
+        sendAimPosition();
+        m_status = STATUS_MOVING;
+        m_move_start_time = millis();
+        return EXIT_SUCCESS;
+    }
+
+    bool isTrackingPuck() const
+    {
+        return m_status == STATUS_TRACKING;
+    }
+
+    /* Position du palet sur la table (mm) et décalage de fourche correspondant depuis la position actuelle du robot */
+    bool getTrackedPuck(float &x, float &y, float &fork_y) const
+    {
+        const PuckTracker & tracker = m_puck_scanner.getTracker();
+        x = tracker.getX();
+        y = tracker.getY();
+        Position p = MotionControlSystem::Instance().getPosition();
+        fork_y = -(x - p.x) * sinf(p.orientation) + (y - p.y) * cosf(p.orientation);
+        return tracker.isValid();
+    }
+
+    /* valid (bool), x (int, mm), y (int, mm), fork y (float, mm), nb points (uint), rms (float, mm) */
+    void appendPuckTrackingToVect(std::vector<uint8_t> & output) const
+    {
+        float x, y, fork_y;
+        bool valid = getTrackedPuck(x, y, fork_y);
+        Serializer::writeBool(valid, output);
+        Serializer::writeInt((int32_t)x, output);
+        Serializer::writeInt((int32_t)y, output);
+        Serializer::writeFloat(fork_y, output);
+        Serializer::writeUInt(m_puck_scanner.getTracker().getNbPoints(), output);
+        Serializer::writeFloat(m_puck_scanner.getTracker().getRms(), output);
+    }
+
     int goToPosition(const ActuatorPosition &p)
     {
         setSpeedToMax();
@@ -287,8 +486,68 @@ public:
         return initMove(STATUS_MOVING, p);
     }
 
+    /*
+        Séquence de points de passage, enchaînés sans arrêt intermédiaire.
+        preempt = false : ajout à la suite du mouvement en cours (ou démarrage
+        si l'actionneur est à l'arrêt).
+        preempt = true : la commande en cours et la file sont abandonnées.
+        Seul un mouvement simple peut être prolongé ou préempté (pas la prise
+        d'origine ni le scan). La séquence est refusée en bloc si un point est
+        hors d'atteinte ou si la file est pleine.
+    */
+    ActuatorErrorCode queueWaypoints(const ActuatorWaypoint *waypoints, size_t count, bool preempt)
+    {
+        if (count == 0) {
+            return ACT_OK;
+        }
+        bool idle = m_status == STATUS_IDLE;
+        if (preempt) {
+            if (m_status != STATUS_IDLE && m_status != STATUS_MOVING && m_status != STATUS_TRACKING) {
+                return ACT_ALREADY_MOVING;
+            }
+        }
+        else if (!idle && m_status != STATUS_MOVING) {
+            return ACT_ALREADY_MOVING;
+        }
+        if (!m_z_homed) {
+            return ACT_NOT_HOMED;
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (!waypoints[i].position.isWithinRange()) {
+                return ACT_UNREACHABLE;
+            }
+        }
+        size_t free_slots = (preempt ? ACT_MGR_QUEUE_SIZE : ACT_MGR_QUEUE_SIZE - m_queue_count);
+        if (count - ((preempt || idle) ? 1 : 0) > free_slots) {
+            return ACT_QUEUE_FULL;
+        }
+
+        size_t first = 0;
+        if (preempt || idle)
+        {
+            if (!idle) {
+                finishMove();
+            }
+            setWaypointSpeeds(waypoints[0]);
+            initMove(STATUS_MOVING, waypoints[0].position);
+            first = 1;
+        }
+        for (size_t i = first; i < count; i++)
+        {
+            m_waypoints[(m_queue_head + m_queue_count) % ACT_MGR_QUEUE_SIZE] = waypoints[i];
+            m_queue_count++;
+        }
+        return ACT_OK;
+    }
+
+    size_t getQueuedWaypointsCount() const
+    {
+        return m_queue_count;
+    }
+
     void disableAll()
     {
+        m_bus.waitIdle();
         m_y_motor.enableTorque(false);
         m_theta_motor.enableTorque(false);
         noInterrupts();
@@ -303,6 +562,7 @@ private:
         STATUS_MOVING,
         STATUS_GOING_HOME,
         STATUS_SCANNING,
+        STATUS_TRACKING,
     };
 
     int initMove(ActuatorStatus moveId, const ActuatorPosition &p)
@@ -334,6 +594,7 @@ private:
             enableZMotor(true);
             m_status = moveId;
             m_aim_position = p;
+            m_command_id++;
             sendAimPosition();
             m_move_start_time = millis();
         }
@@ -347,7 +608,9 @@ private:
         }
         m_status = STATUS_IDLE;
         m_composed_move_step = 0;
+        m_queue_count = 0;
         m_puck_scanner.enable(false);
+        m_puck_scanner.enableTracking(false);
         m_puck_scanner.reset();
         readZCurrentPosition();
         m_aim_position = m_current_position;
@@ -359,18 +622,40 @@ private:
     {
         m_status = STATUS_IDLE;
         m_composed_move_step = 0;
+        m_queue_count = 0;
         m_puck_scanner.enable(false);
+        m_puck_scanner.enableTracking(false);
         m_puck_scanner.reset();
     }
 
     void simpleMoveHandler()
     {
-        if (aimPositionReached())
+        if (m_queue_count > 0)
+        {
+            if (waypointReached())
+            {
+                const ActuatorWaypoint & next = m_waypoints[m_queue_head];
+                m_queue_head = (m_queue_head + 1) % ACT_MGR_QUEUE_SIZE;
+                m_queue_count--;
+                setWaypointSpeeds(next);
+                m_aim_position = next.position;
+                sendAimPosition();
+                m_move_start_time = millis();
+            }
+        }
+        else if (aimPositionReached())
         {
             finishMove();
         }
     }
 
+    void setWaypointSpeeds(const ActuatorWaypoint & w)
+    {
+        m_y_speed = constrain(w.y_speed, 0, ACT_MGR_MAX_SPEED_Y);
+        m_z_speed = constrain(w.z_speed, 0, ACT_MGR_MAX_SPEED_Z);
+        m_theta_speed = constrain(w.theta_speed, 0, ACT_MGR_MAX_SPEED_THETA);
+    }
+
     void goHomeHandler()
     {
         switch (m_composed_move_step)
@@ -438,7 +723,7 @@ private:
             m_composed_move_step++;
             break;
         case 1:
-            if (aimPositionReached())
+            if (waypointReached())
             {
                 m_aim_position.y = ACT_MGR_Y_MAX;
                 sendAimPosition();
@@ -460,6 +745,7 @@ private:
                 m_last_scan_result_y = m_aim_position.y;
                 m_puck_scanner.enable(false);
                 sendAimPosition();
+                m_puck_scanner.sendProfile();
                 m_composed_move_step++;
             }
             break;
@@ -474,9 +760,86 @@ private:
         }
     }
 
-    bool aimPositionReached() const
+    void trackingHandler()
+    {
+        switch (m_composed_move_step)
+        {
+        case 0:
+            m_y_speed = ACT_MGR_SCANNING_SPEED;
+            m_puck_scanner.enableTracking(true);
+            m_aim_position.y = ACT_MGR_Y_MIN;
+            m_aim_position.theta = 2; // to make sure the fork is parallel to the ground
+            sendAimPosition();
+            m_composed_move_step++;
+            break;
+        case 1:
+            if (waypointReached())
+            {
+                m_aim_position.y = ACT_MGR_Y_MAX;
+                sendAimPosition();
+                m_composed_move_step++;
+            }
+            break;
+        case 2:
+            if (waypointReached())
+            {
+                m_aim_position.y = ACT_MGR_Y_MIN;
+                sendAimPosition();
+                m_composed_move_step = 1;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    /*
+        La position de z est connue exactement (nombre de pas effectués).
+        Pour les AX12, la position est extrapolée depuis la dernière lecture à
+        la vitesse commandée : l'arrivée est signalée dès qu'elle est prévue,
+        sans attendre la lecture suivante. L'extrapolation est limitée à
+        ACT_MGR_PREDICTION_HORIZON et n'utilise que des lectures postérieures
+        à l'envoi de la consigne, faites pendant que l'AX12 bougeait.
+    */
+    bool aimPositionReached()
+    {
+        readZCurrentPosition();
+        if (fabsf(m_current_position.z - m_aim_position.z) > ACT_MGR_Z_TOLERANCE) {
+            return false;
+        }
+        float y_speed = (m_y_cmd_speed == 0 ? ACT_MGR_MAX_SPEED_Y : m_y_cmd_speed) *
+            ACT_MGR_AX12_SPEED_UNIT / ACT_MGR_Y_CONVERTER;   // mm/s
+        float theta_speed = (m_theta_cmd_speed == 0 ? ACT_MGR_MAX_SPEED_THETA : m_theta_cmd_speed) *
+            ACT_MGR_AX12_SPEED_UNIT;   // deg/s
+        return
+            ax12ArrivalPredicted(ID_AX12_ACT_Y, m_current_position.y, m_aim_position.y,
+                ACT_MGR_Y_TOLERANCE, y_speed, m_y_sample_time) &&
+            ax12ArrivalPredicted(ID_AX12_ACT_THETA, m_current_position.theta, m_aim_position.theta,
+                ACT_MGR_THETA_TOLERANCE, theta_speed, m_theta_sample_time);
+    }
+
+    /* Seule une lecture échantillonnée après la réception de la consigne par l'AX12 est extrapolée */
+    bool ax12ArrivalPredicted(uint8_t id, float position, float aim, float tolerance, float speed,
+        uint32_t sample_time) const
     {
-        return m_current_position.isEqualTo(m_aim_position);
+        float distance = fabsf(aim - position);
+        if (distance <= tolerance) {
+            return true;
+        }
+        uint32_t now = micros();
+        uint32_t goal_time;
+        if (!m_bus.isMoving(id) || !m_bus.getGoalReceivedTime(id, goal_time) ||
+            (int32_t)(sample_time - goal_time) < 0 ||
+            now - sample_time > ACT_MGR_PREDICTION_HORIZON) {
+            return false;
+        }
+        return distance - speed * (now - sample_time) / 1e6 <= tolerance;
+    }
+
+    /* Pour les étapes intermédiaires d'un mouvement composé : enchaînement sans arrêt */
+    bool waypointReached() const
+    {
+        return m_current_position.isCloseTo(m_aim_position);
     }
 
     bool canUseSensors() const
@@ -490,24 +853,69 @@ private:
         return digitalRead(PIN_STEPPER_ENDSTOP) == HIGH;
     }
 
+    /* Les consignes des AX12 partent ensemble (SYNC_WRITE) au prochain DynamixelBusMgr::update() */
     void sendAimPosition()
     {
-        DynamixelStatus dynamixelStatus;
-        dynamixelStatus = m_y_motor.speed(m_y_speed);
-        readDynamixelStatus(dynamixelStatus, ACT_AX12_Y_BLOCKED);
-        dynamixelStatus = m_theta_motor.speed(m_theta_speed);
-        readDynamixelStatus(dynamixelStatus, ACT_AX12_THETA_BLOCKED);
-        m_z_motor.setRPM(m_z_speed);
-        dynamixelStatus = m_y_motor.goalPositionDegree(
-            m_aim_position.y * ACT_MGR_Y_CONVERTER + ACT_MGR_Y_ORIGIN);
-        readDynamixelStatus(dynamixelStatus, ACT_AX12_Y_BLOCKED);
+        uint16_t y_speed = m_y_speed;
+        uint16_t theta_speed = m_theta_speed;
+        float z_speed = m_z_speed;
+        if (m_status != STATUS_GOING_HOME) {
+            // La prise d'origine vise une position fictive en z : pas de synchronisation
+            planAxisSpeeds(y_speed, theta_speed, z_speed);
+        }
+        m_y_cmd_speed = y_speed;
+        m_theta_cmd_speed = theta_speed;
+        m_bus.setGoal(ID_AX12_ACT_Y,
+            m_aim_position.y * ACT_MGR_Y_CONVERTER + ACT_MGR_Y_ORIGIN, y_speed);
         if (m_z_homed)
         {
-            dynamixelStatus = m_theta_motor.goalPositionDegree(
-                m_aim_position.theta + ACT_MGR_THETA_ORIGIN);
-            readDynamixelStatus(dynamixelStatus, ACT_AX12_THETA_BLOCKED);
+            m_bus.setGoal(ID_AX12_ACT_THETA,
+                m_aim_position.theta + ACT_MGR_THETA_ORIGIN, theta_speed);
+        }
+        writeZAimPosition(z_speed);
+    }
+
+    /*
+        Vitesses des trois axes pour une arrivée simultanée : l'axe le plus lent
+        se déplace à sa vitesse maximale (m_y_speed, m_theta_speed, m_z_speed),
+        les autres sont ralentis pour arriver en même temps.
+        Les AX12 sont supposés à vitesse constante, z suit un profil trapézoïdal.
+    */
+    void planAxisSpeeds(uint16_t & y_speed, uint16_t & theta_speed, float & z_speed)
+    {
+        readZCurrentPosition();
+        float y_angle = fabsf(m_aim_position.y - m_current_position.y) * ACT_MGR_Y_CONVERTER;  // deg
+        float theta_angle = m_z_homed ? fabsf(m_aim_position.theta - m_current_position.theta) : 0;  // deg
+        float z_dist = fabsf(m_aim_position.z - m_current_position.z);  // mm
+        float y_max = (m_y_speed == 0 ? ACT_MGR_MAX_SPEED_Y : m_y_speed) * ACT_MGR_AX12_SPEED_UNIT;    // deg/s
+        float theta_max = (m_theta_speed == 0 ? ACT_MGR_MAX_SPEED_THETA : m_theta_speed) * ACT_MGR_AX12_SPEED_UNIT;
+        float z_max = m_z_speed * ACT_MGR_Z_PER_TURN / 60;   // mm/s
+        float z_acc = ACT_MGR_Z_ACCELERATION * ACT_MGR_Z_PER_TURN / ACT_MGR_STEP_PER_TURN;  // mm/s²
+
+        float duration = max(y_angle / y_max, theta_angle / theta_max);   // s
+        if (z_max > 0)
+        {
+            float z_duration = z_dist >= z_max * z_max / z_acc ?
+                z_dist / z_max + z_max / z_acc : 2 * sqrtf(z_dist / z_acc);
+            duration = max(duration, z_duration);
+        }
+        if (duration <= 0) {
+            return;
+        }
+
+        if (y_angle > 0) {
+            y_speed = constrain(ceilf(y_angle / (duration * ACT_MGR_AX12_SPEED_UNIT)), 1, y_max / ACT_MGR_AX12_SPEED_UNIT);
+        }
+        if (theta_angle > 0) {
+            theta_speed = constrain(ceilf(theta_angle / (duration * ACT_MGR_AX12_SPEED_UNIT)), 1, theta_max / ACT_MGR_AX12_SPEED_UNIT);
+        }
+        if (z_dist > 0 && z_max > 0)
+        {
+            // Vitesse de croisière v telle que z_dist = v * (duration - v / z_acc)
+            float delta = z_acc * z_acc * duration * duration - 4 * z_acc * z_dist;
+            float v = delta > 0 ? (z_acc * duration - sqrtf(delta)) / 2 : z_max;
+            z_speed = constrain(v * 60 / ACT_MGR_Z_PER_TURN, 1, m_z_speed);
         }
-        writeZAimPosition();
     }
 
     void readSensorsAndMotors()
@@ -515,41 +923,51 @@ private:
         static uint32_t last_poll_time = 0;
         static uint8_t step = 0;
 
+        readAX12Positions();
+
         uint32_t now = micros();
-        if (now - last_poll_time > ACT_MGR_POLL_PERIOD)
+        bool scanning = m_puck_scanner.isSweeping();
+        if (now - last_poll_time > (scanning ? ACT_MGR_SCAN_POLL_PERIOD : ACT_MGR_POLL_PERIOD))
         {
             last_poll_time = now;
             readZCurrentPosition();
-            if (step == 0)
+            if (scanning)
             {
-                uint16_t angle;
-                DynamixelStatus dynamixelStatus = m_theta_motor.currentPositionDegree(angle);
-                if (angle <= 300) {
-                    m_current_position.theta = constrain((float)angle - ACT_MGR_THETA_ORIGIN,
-                        ACT_MGR_THETA_MIN, ACT_MGR_THETA_MAX);
+                // Theta ne bouge pas pendant un scan : lectures de Y intercalées entre celles des capteurs
+                if (step == 0 || step == 2)
+                {
+                    m_bus.requestRead(ID_AX12_ACT_Y);
+                }
+                else if (step == 1)
+                {
+                    m_puck_scanner.updateLeftSensor(m_left_sensor_value, m_left_sensor_time);
+                }
+                else
+                {
+                    m_puck_scanner.updateRightSensor(m_right_sensor_value, m_right_sensor_time);
                 }
-                readDynamixelStatus(dynamixelStatus, ACT_AX12_THETA_BLOCKED);
+                step = (step + 1) % 4;
+                return;
+            }
+
+            if (step == 0)
+            {
+                m_bus.requestRead(ID_AX12_ACT_THETA);
                 step++;
             }
             else if (step == 1)
             {
-                uint16_t angle;
-                DynamixelStatus dynamixelStatus = m_y_motor.currentPositionDegree(angle);
-                if (angle <= 300) {
-                    m_current_position.y = constrain(((float)angle - ACT_MGR_Y_ORIGIN) / ACT_MGR_Y_CONVERTER,
-                        ACT_MGR_Y_MIN, ACT_MGR_Y_MAX);
-                }
-                readDynamixelStatus(dynamixelStatus, ACT_AX12_Y_BLOCKED);
+                m_bus.requestRead(ID_AX12_ACT_Y);
                 step++;
             }
             else if (step == 2)
             {
-                m_puck_scanner.updateLeftSensor(m_left_sensor_value, m_current_position.y);
+                m_puck_scanner.updateLeftSensor(m_left_sensor_value, m_left_sensor_time);
                 step++;
             }
             else if (step == 3)
             {
-                m_puck_scanner.updateRightSensor(m_right_sensor_value, m_current_position.y);
+                m_puck_scanner.updateRightSensor(m_right_sensor_value, m_right_sensor_time);
                 step = 0;
             }
 
@@ -559,36 +977,102 @@ private:
         }
     }
 
-    void writeZAimPosition()
+    /* Prise en compte des lectures faites par le DynamixelBusMgr, horodatées à la réception de la requête par l'AX12 */
+    void readAX12Positions()
     {
+        uint16_t angle;
+        uint32_t read_time, sample_count;
+        DynamixelStatus dynamixelStatus = m_bus.getPosition(ID_AX12_ACT_Y, angle, read_time, sample_count);
+        if (sample_count != m_y_sample_count)
+        {
+            m_y_sample_count = sample_count;
+            if (!(dynamixelStatus & DYN_STATUS_COM_ERROR) && angle <= 300) {
+                m_current_position.y = constrain(((float)angle - ACT_MGR_Y_ORIGIN) / ACT_MGR_Y_CONVERTER,
+                    ACT_MGR_Y_MIN, ACT_MGR_Y_MAX);
+                m_puck_scanner.registerYPosition(read_time, m_current_position.y);
+                m_y_sample_time = read_time;
+            }
+            readDynamixelStatus(dynamixelStatus, ACT_AX12_Y_BLOCKED);
+        }
+
+        dynamixelStatus = m_bus.getPosition(ID_AX12_ACT_THETA, angle, read_time, sample_count);
+        if (sample_count != m_theta_sample_count)
+        {
+            m_theta_sample_count = sample_count;
+            if (!(dynamixelStatus & DYN_STATUS_COM_ERROR) && angle <= 300) {
+                m_current_position.theta = constrain((float)angle - ACT_MGR_THETA_ORIGIN,
+                    ACT_MGR_THETA_MIN, ACT_MGR_THETA_MAX);
+                m_theta_sample_time = read_time;
+            }
+            readDynamixelStatus(dynamixelStatus, ACT_AX12_THETA_BLOCKED);
+        }
+    }
+
+    /*
+        Si la cible et la vitesse de z n'ont pas changé (à ACT_MGR_Z_SPEED_CHANGE près),
+        le mouvement en cours continue sans repartir de l'arrêt. Sinon il repart de la
+        position courante : le profil de vitesse est calculé au début du mouvement.
+    */
+    void writeZAimPosition(float rpm)
+    {
+        int32_t target = ACT_MGR_MICROSTEP * ACT_MGR_STEP_PER_TURN *
+            m_aim_position.z / ACT_MGR_Z_PER_TURN;
         noInterrupts();
-        m_z_current_move_origin +=
-            m_z_motor.getStepsCompleted() * m_z_motor.getDirection();
-        m_z_motor.stop();
-        float delta_z = ACT_MGR_MICROSTEP * ACT_MGR_STEP_PER_TURN *
-            (m_aim_position.z - m_current_position.z) / ACT_MGR_Z_PER_TURN;
-        m_z_motor.startMove((int32_t)delta_z);
+        if (target == m_z_move_target && m_z_ramp.getStepsRemaining() > 0 &&
+            fabsf(rpm - m_z_move_rpm) <= ACT_MGR_Z_SPEED_CHANGE * m_z_move_rpm)
+        {
+            interrupts();
+            return;
+        }
+        m_z_step_timer.end();
+        int32_t delta = target - m_z_position;
+        m_z_direction = delta >= 0 ? 1 : -1;
+        digitalWriteFast(PIN_STEPPER_DIR, delta >= 0 ? HIGH : LOW);
+        m_z_ramp.start(delta >= 0 ? delta : -delta, rpm * ACT_MGR_STEP_PER_TURN * ACT_MGR_MICROSTEP / 60);
+        m_z_move_target = target;
+        m_z_move_rpm = rpm;
+        if (m_z_ramp.getStepsRemaining() > 0) {
+            m_z_step_timer.begin(zStepInterrupt, 1);
+        }
         interrupts();
     }
 
+    /*
+        Un micropas de z, en interruption : l'intervalle jusqu'au pas suivant est
+        calculé pendant l'impulsion de STEP, seule attente (ACT_MGR_Z_STEP_PULSE).
+    */
+    void zStep()
+    {
+        digitalWriteFast(PIN_STEPPER_STEP, HIGH);
+        m_z_position += m_z_direction;
+        uint32_t wait_time = m_z_ramp.nextStep();
+        delayMicroseconds(ACT_MGR_Z_STEP_PULSE);
+        digitalWriteFast(PIN_STEPPER_STEP, LOW);
+        if (wait_time > 0) {
+            m_z_step_timer.begin(zStepInterrupt, wait_time);
+        }
+        else {
+            m_z_step_timer.end();
+        }
+    }
+
     void readZCurrentPosition()
     {
         noInterrupts();
-        int32_t current_z_pos_step = m_z_current_move_origin +
-            m_z_motor.getStepsCompleted() * m_z_motor.getDirection();
+        int32_t current_z_pos_step = m_z_position;
+        interrupts();
         m_current_position.z = ACT_MGR_Z_PER_TURN * (float)current_z_pos_step /
             (ACT_MGR_STEP_PER_TURN * ACT_MGR_MICROSTEP);
-        interrupts();
     }
 
     void resetZOrigin()
     {
         noInterrupts();
+        m_z_step_timer.end();
+        m_z_ramp.stop();
         m_current_position.z = ACT_MGR_Z_MAX;
-        m_z_current_move_origin = ACT_MGR_STEP_PER_TURN * ACT_MGR_MICROSTEP *
+        m_z_position = ACT_MGR_STEP_PER_TURN * ACT_MGR_MICROSTEP *
             m_current_position.z / ACT_MGR_Z_PER_TURN;
-        m_z_motor.stop();
-        m_z_motor.startMove(0);
         interrupts();
     }
 
@@ -627,13 +1111,27 @@ private:
     ActuatorStatus m_status;
     SensorValue m_left_sensor_value;
     SensorValue m_right_sensor_value;
+    uint32_t m_left_sensor_time;    // µs
+    uint32_t m_right_sensor_time;   // µs
     DynamixelMotor m_y_motor;
     DynamixelMotor m_theta_motor;
-    A4988 m_z_motor;
-    int32_t m_z_current_move_origin; // Position, in steps, of the z-axis when the last move began
+    A4988 m_z_motor;        // Broches du driver (micropas, activation), les pas sont générés par zStep()
+    StepperRamp m_z_ramp;
+    IntervalTimer m_z_step_timer;   // one-shot, reprogrammé à chaque pas
+    volatile int32_t m_z_position;  // Position, in microsteps, of the z-axis
+    int8_t m_z_direction;   // +1 / -1, direction of the current move of the z-axis
+    int32_t m_z_move_target; // Target, in steps, of the last move of the z-axis
+    float m_z_move_rpm;      // Speed of the last move of the z-axis
     uint32_t m_composed_move_step;
     uint32_t m_move_start_time; // ms
     PuckScanner m_puck_scanner;
+    DynamixelBusMgr & m_bus;
+    uint32_t m_y_sample_count;
+    uint32_t m_theta_sample_count;
+    uint32_t m_y_sample_time;       // µs
+    uint32_t m_theta_sample_time;   // µs
+    uint16_t m_y_cmd_speed;         // AX12 speed unit, vitesse planifiée du mouvement en cours
+    uint16_t m_theta_cmd_speed;     // AX12 speed unit
     float m_last_scan_result_y; // y coordinate, result of the last scan
     int32_t m_last_scan_result_d; // distance to the puck, result of the last scan (unit: mm)
     bool m_golden_mode;
@@ -641,6 +1139,10 @@ private:
     uint16_t m_theta_speed;
     uint16_t m_z_speed;
     bool m_z_homed; // is z-axis was homed (the 0 position is set correctly)
+    ActuatorWaypoint m_waypoints[ACT_MGR_QUEUE_SIZE];   // File circulaire des points de passage à venir
+    size_t m_queue_head;
+    size_t m_queue_count;
+    uint32_t m_command_id;
 };
 
 #endif
@@ -0,0 +1,256 @@
+#ifndef BOOT_MGR_h
+#define BOOT_MGR_h
+
+#include <Printable.h>
+#include <vector>
+#include "Config.h"
+#include "Singleton.h"
+#include "Serializer.h"
+#include "CommunicationServer.h"
+#include "SerialAX12.h"
+#include "Dashboard.h"
+#include "DirectionController.h"
+#include "ActuatorMgr.h"
+#include "SensorsMgr.h"
+#include "TrajectoryLibrary.h"
+
+#define BOOT_TOF_TIMEOUT    2000    // ms
+
+
+/*
+    Boot orchestrator: brings the hardware up with as much overlap as possible.
+    The ToF sensors (which dominate the boot time) are powered on in the
+    background first, then Ethernet and the AX12 bus are initialised while
+    they boot. The main loop may start as soon as begin() returns: the sensors
+    keep booting from update().
+    The stages that may wait on a device are run from update() once the motion
+    control is running (controlStarted()): the homing of the actuators, and the
+    trajectory library, mounted there one SD card access per call (reading the
+    SD card takes tens of ms, which must not happen during the match).
+    Every stage is timestamped (µs since begin()) and can be queried; the
+    timeline is printed once the boot is completed.
+*/
+class BootMgr : public Singleton<BootMgr>, public Printable
+{
+public:
+    enum Stage
+    {
+        STAGE_DASHBOARD = 0,
+        STAGE_ETHERNET,
+        STAGE_AX12_BUS,
+        STAGE_DIRECTION,
+        STAGE_ACTUATORS,
+        STAGE_TOF_SENSORS,
+        STAGE_CONTROL,
+        STAGE_TRAJ_LIBRARY,
+        STAGE_COUNT
+    };
+
+    enum StageStatus
+    {
+        STAGE_PENDING = 0,
+        STAGE_RUNNING = 1,
+        STAGE_OK = 2,
+        STAGE_FAILED = 3
+    };
+
+    BootMgr() :
+        dashboard(Dashboard::Instance()),
+        directionController(DirectionController::Instance()),
+        actuatorMgr(ActuatorMgr::Instance()),
+        sensorMgr(SensorsMgr::Instance())
+    {
+        bootStartTime = 0;
+        for (size_t i = 0; i < STAGE_COUNT; i++)
+        {
+            stages[i].start = 0;
+            stages[i].end = 0;
+            stages[i].status = STAGE_PENDING;
+        }
+    }
+
+    /* Bring-up of everything but the interrupt timers, which belong to the main loop */
+    void begin()
+    {
+        bootStartTime = micros();
+
+        startStage(STAGE_DASHBOARD);
+        dashboard.init();
+        endStage(STAGE_DASHBOARD, true);
+
+        startStage(STAGE_TOF_SENSORS);
+        sensorMgr.startInit();
+        actuatorMgr.startSensorsInit();
+        pollSensors();
+
+        startStage(STAGE_ETHERNET);
+        bool ok = Server.begin() == 0;
+        endStage(STAGE_ETHERNET, ok);
+        if (!ok) {
+            dashboard.setErrorLevel(Dashboard::WEAK_ERROR);
+        }
+        pollSensors();
+
+        startStage(STAGE_AX12_BUS);
+        SerialAX12.begin(SERIAL_AX12_BAUDRATE, SERIAL_AX12_TIMEOUT);
+        endStage(STAGE_AX12_BUS, true);
+        pollSensors();
+
+        startStage(STAGE_DIRECTION);
+        ok = directionController.init() == EXIT_SUCCESS;
+        endStage(STAGE_DIRECTION, ok);
+        if (!ok) {
+            dashboard.setErrorLevel(Dashboard::WEAK_ERROR);
+        }
+        pollSensors();
+
+        startStage(STAGE_ACTUATORS);
+        if (actuatorMgr.init() != EXIT_SUCCESS)
+        {
+            endStage(STAGE_ACTUATORS, false);
+            dashboard.setErrorLevel(Dashboard::STRONG_WARNING);
+        }
+        pollSensors();
+    }
+
+    /* To be called once the motion control interrupts are running */
+    void controlStarted()
+    {
+        startStage(STAGE_CONTROL);
+        endStage(STAGE_CONTROL, true);
+    }
+
+    /*
+        To be called from the main loop, never blocks for more than one SD card
+        access: closes the ToF stage once every sensor is done, then, once the
+        motion control runs, starts the homing and mounts the trajectory library.
+    */
+    void update()
+    {
+        if (stages[STAGE_TOF_SENSORS].status == STAGE_RUNNING) {
+            updateSensorsStage();
+        }
+        if (stages[STAGE_CONTROL].status != STAGE_OK) {
+            return;
+        }
+        if (stages[STAGE_ACTUATORS].status == STAGE_RUNNING)
+        {
+            actuatorMgr.goToHome();
+            finishStage(STAGE_ACTUATORS, true);
+        }
+        else if (stages[STAGE_TRAJ_LIBRARY].status != STAGE_OK &&
+            stages[STAGE_TRAJ_LIBRARY].status != STAGE_FAILED)
+        {
+            updateTrajLibraryStage();
+        }
+    }
+
+    bool bootCompleted() const
+    {
+        for (size_t i = 0; i < STAGE_COUNT; i++)
+        {
+            if (stages[i].status != STAGE_OK && stages[i].status != STAGE_FAILED) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /* For each stage: status, start and end (µs since the beginning of the boot) */
+    void appendTimelineToVect(std::vector<uint8_t> & output) const
+    {
+        for (size_t i = 0; i < STAGE_COUNT; i++)
+        {
+            Serializer::writeEnum(stages[i].status, output);
+            Serializer::writeUInt(stages[i].start, output);
+            Serializer::writeUInt(stages[i].end, output);
+        }
+    }
+
+    size_t printTo(Print& p) const
+    {
+        static const char * const stageNames[STAGE_COUNT] = {
+            "Dashboard", "Ethernet", "AX12 bus", "Direction", "Actuators", "ToF sensors", "Control",
+            "Trajectory library" };
+        static const char * const statusNames[] = { "pending", "running", "OK", "failed" };
+        size_t ret = p.println("Boot timeline:");
+        for (size_t i = 0; i < STAGE_COUNT; i++)
+        {
+            ret += p.printf("%s: %s [%u ; %u] us\n", stageNames[i], statusNames[stages[i].status],
+                stages[i].start, stages[i].end);
+        }
+        return ret;
+    }
+
+private:
+    void startStage(Stage stage)
+    {
+        stages[stage].start = micros() - bootStartTime;
+        stages[stage].status = STAGE_RUNNING;
+    }
+
+    void endStage(Stage stage, bool ok)
+    {
+        stages[stage].end = micros() - bootStartTime;
+        stages[stage].status = ok ? STAGE_OK : STAGE_FAILED;
+    }
+
+    void updateSensorsStage()
+    {
+        bool timedOut = micros() - bootStartTime - stages[STAGE_TOF_SENSORS].start > BOOT_TOF_TIMEOUT * 1000;
+        if (!timedOut && (sensorMgr.isBooting() || actuatorMgr.sensorsBooting())) {
+            return;
+        }
+        bool ok = sensorMgr.initResult() == EXIT_SUCCESS &&
+            actuatorMgr.sensorsInitResult() == EXIT_SUCCESS;
+        finishStage(STAGE_TOF_SENSORS, ok);
+        if (!ok) {
+            dashboard.setErrorLevel(Dashboard::STRONG_WARNING);
+        }
+    }
+
+    void updateTrajLibraryStage()
+    {
+        TrajectoryLibrary & library = TrajectoryLibrary::Instance();
+        if (stages[STAGE_TRAJ_LIBRARY].status == STAGE_PENDING) {
+            startStage(STAGE_TRAJ_LIBRARY);
+        }
+        library.initStep();
+        if (library.initDone()) {
+            finishStage(STAGE_TRAJ_LIBRARY, library.isAvailable());
+        }
+    }
+
+    /* Ends a stage run from update(), the last one prints the timeline */
+    void finishStage(Stage stage, bool ok)
+    {
+        endStage(stage, ok);
+        if (bootCompleted()) {
+            Server.print(*this);
+        }
+    }
+
+    /* Lets the sensors move forward in their boot sequence between two blocking stages */
+    void pollSensors()
+    {
+        sensorMgr.updateRecovery();
+        actuatorMgr.updateSensorsBoot();
+    }
+
+    struct StageRecord
+    {
+        uint32_t start; // µs
+        uint32_t end;   // µs
+        StageStatus status;
+    };
+
+    Dashboard & dashboard;
+    DirectionController & directionController;
+    ActuatorMgr & actuatorMgr;
+    SensorsMgr & sensorMgr;
+    uint32_t bootStartTime; // µs
+    StageRecord stages[STAGE_COUNT];
+};
+
+
+#endif
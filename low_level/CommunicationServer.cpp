@@ -1,4 +1,5 @@
 #include "CommunicationServer.h"
+#include "Serializer.h"
 
 CommunicationServer Server = CommunicationServer();
 
@@ -12,9 +13,16 @@ CommunicationServer::CommunicationServer() :
     for (uint8_t i = 0; i < MAX_SOCK_NUM + 1; i++)
     {
         subscriptionList[i] = 0;
+        receivedFrames[i] = 0;
+        reportedFrames[i] = 0;
     }
+    reportedFreeSlots = 0;
+    lastCreditReport = 0;
     subscriptionList[MAX_SOCK_NUM] |= (1 << ERROR);
     bisTraceVectUsed = false;
+    emergencyStopHandler = nullptr;
+    lastReceptionTime = 0;
+    worstEmergencyStopDelay = 0;
 }
 
 int CommunicationServer::begin()
@@ -53,6 +61,8 @@ void CommunicationServer::communicate()
         {
             ethernetClients[socketNb] = client;
             subscriptionList[socketNb] = DEFAULT_SUSCRIPTION;
+            receivedFrames[socketNb] = 0;
+            reportedFrames[socketNb] = 0;
             printf("New client connected on socket %u\n", socketNb);
         }
     }
@@ -66,54 +76,8 @@ void CommunicationServer::communicate()
 #endif
 
     /* Réception des messages */
-    bool receivedAtLeastOneByte = true;
-    uint32_t startReceptionTime = micros();
-    while (micros() - startReceptionTime < MAX_RECEPTION_DURATION && receivedAtLeastOneByte)
-    {
-        receivedAtLeastOneByte = false;
-        if (available() < COMMAND_BUFFER_SIZE - MAX_SOCK_NUM)
-        {
-            for (uint8_t i = 0; i < MAX_SOCK_NUM; i++)
-            {
-                if (ethernetClients[i] && ethernetClients[i].available() > 0)
-                {
-                    receivedAtLeastOneByte = true;
-                    int8_t ret = receptionHandlers[i].addByte(ethernetClients[i].read(), i);
-                    if (ret == 1)
-                    {
-                        printf_err("Drop the byte\n");
-                    }
-                    else if (ret == -1)
-                    {
-                        printf_err("Information frame received\n");
-                    }
-                    if (receptionHandlers[i].available())
-                    {
-                        processOrAddCommandToBuffer(receptionHandlers[i].getCommand());
-                    }
-                }
-            }
-#if SERIAL_ENABLE
-            if (Serial && Serial.available() > 0)
-            {
-                receivedAtLeastOneByte = true;
-                int8_t ret = receptionHandlers[MAX_SOCK_NUM].addByte(Serial.read(), MAX_SOCK_NUM);
-                if (ret == 1)
-                {
-                    printf_err("Drop the byte\n");
-                }
-                else if (ret == -1)
-                {
-                    printf_err("Information frame received\n");
-                }
-                if (receptionHandlers[MAX_SOCK_NUM].available())
-                {
-                    processOrAddCommandToBuffer(receptionHandlers[MAX_SOCK_NUM].getCommand());
-                }
-            }
-#endif
-        }
-    }
+    receive();
+    sendCredits();
 
     /* Envoi des messages à envoi différé (issus des interruptions) */
     noInterrupts();
@@ -143,11 +107,59 @@ void CommunicationServer::communicate()
         {
             ethernetClients[i].stop();
             subscriptionList[i] = 0;
+            receivedFrames[i] = 0;
+            reportedFrames[i] = 0;
             printf("Client %u disconnected\n", i);
         }
     }
 }
 
+void CommunicationServer::receive()
+{
+    bool receivedAtLeastOneByte = true;
+    uint32_t startReceptionTime = micros();
+    while (micros() - startReceptionTime < MAX_RECEPTION_DURATION && receivedAtLeastOneByte)
+    {
+        receivedAtLeastOneByte = false;
+        bool roomForCommands = freeSlots() > MAX_SOCK_NUM;  // Chaque client peut terminer la réception d'une trame
+        for (uint8_t i = 0; i < MAX_SOCK_NUM; i++)
+        {
+            if (ethernetClients[i] && ethernetClients[i].available() > 0 &&
+                (roomForCommands || receptionHandlers[i].canReadWhenFull(ethernetClients[i].peek())))
+            {
+                receivedAtLeastOneByte = true;
+                receiveByte(ethernetClients[i].read(), i);
+            }
+        }
+#if SERIAL_ENABLE
+        if (Serial && Serial.available() > 0 &&
+            (roomForCommands || receptionHandlers[MAX_SOCK_NUM].canReadWhenFull(Serial.peek())))
+        {
+            receivedAtLeastOneByte = true;
+            receiveByte(Serial.read(), MAX_SOCK_NUM);
+        }
+#endif
+    }
+    lastReceptionTime = micros();
+}
+
+void CommunicationServer::receiveByte(uint8_t byte, uint8_t source)
+{
+    int8_t ret = receptionHandlers[source].addByte(byte, source);
+    if (ret == 1)
+    {
+        printf_err("Drop the byte\n");
+    }
+    else if (ret == -1)
+    {
+        printf_err("Information frame received\n");
+    }
+    if (receptionHandlers[source].available())
+    {
+        processOrAddCommandToBuffer(receptionHandlers[source].getCommand(), receptionHandlers[source].getFrameStartTime());
+    }
+}
+
 uint8_t CommunicationServer::available()
 {
     if (cBufferHead >= cBufferTail)
@@ -160,6 +172,44 @@ uint8_t CommunicationServer::available()
     }
 }
 
+uint8_t CommunicationServer::freeSlots()
+{
+    return COMMAND_BUFFER_SIZE - 1 - available();
+}
+
+void CommunicationServer::sendCredits()
+{
+    uint8_t free = freeSlots();
+    bool changed = free != reportedFreeSlots;
+    for (uint8_t i = 0; i < MAX_SOCK_NUM + 1 && !changed; i++)
+    {
+        changed = receivedFrames[i] != reportedFrames[i];
+    }
+    if (!changed || micros() - lastCreditReport < CREDIT_REPORT_PERIOD)
+    {
+        return;
+    }
+    lastCreditReport = micros();
+    reportedFreeSlots = free;
+
+    std::vector<uint8_t> data;
+    for (uint8_t i = 0; i < MAX_SOCK_NUM + 1; i++)
+    {
+        reportedFrames[i] = receivedFrames[i];
+        if (subscribed(i, COMMAND_CREDITS))
+        {
+            data.clear();
+            Serializer::writeEnum(free, data);
+            Serializer::writeEnum(COMMAND_BUFFER_SIZE - 1, data);
+            Serializer::writeUInt(receivedFrames[i], data);
+            sendByte(0xFF, i);
+            sendByte(COMMAND_CREDITS, i);
+            sendByte(data.size(), i);
+            sendVector(data, i);
+        }
+    }
+}
+
 bool CommunicationServer::isConnected(uint8_t client)
 {
     if (client > MAX_SOCK_NUM)
@@ -520,9 +570,18 @@ size_t CommunicationServer::sendCString(const char * str, uint8_t dest)
     }
 }
 
-void CommunicationServer::processOrAddCommandToBuffer(Command command)
+void CommunicationServer::processOrAddCommandToBuffer(Command command, uint32_t frameStartTime)
 {
-    if (command.getId() < CHANNEL_MAX_NB) // Ordre d'inscription/désinscription à traiter
+    if (command.getSource() <= MAX_SOCK_NUM)
+    {
+        receivedFrames[command.getSource()]++;
+    }
+
+    if (command.getId() == EMERGENCY_STOP_ID)
+    {
+        handleEmergencyStop(command, frameStartTime);
+    }
+    else if (command.getId() < CHANNEL_MAX_NB) // Ordre d'inscription/désinscription à traiter
     {
         if (command.getLength() != 1 || command.getSource() > MAX_SOCK_NUM)
         {
@@ -557,3 +616,33 @@ void CommunicationServer::processOrAddCommandToBuffer(Command command)
         }
     }
 }
+
+void CommunicationServer::handleEmergencyStop(Command const & command, uint32_t frameStartTime)
+{
+    /*
+        waitingTime : majorant du temps passé par la trame dans le tampon de réception
+        avant la lecture de son premier octet (temps écoulé depuis la lecture précédente)
+        processingTime : de la lecture du premier octet au début du freinage
+    */
+    uint32_t waitingTime = 0;
+    if ((int32_t)(frameStartTime - lastReceptionTime) > 0)
+    {
+        waitingTime = frameStartTime - lastReceptionTime;
+    }
+    if (emergencyStopHandler != nullptr)
+    {
+        emergencyStopHandler();
+    }
+    uint32_t processingTime = micros() - frameStartTime;
+    if (waitingTime + processingTime > worstEmergencyStopDelay)
+    {
+        worstEmergencyStopDelay = waitingTime + processingTime;
+    }
+
+    std::vector<uint8_t> output;
+    Serializer::writeUInt(processingTime, output);
+    Serializer::writeUInt(waitingTime, output);
+    Serializer::writeUInt(worstEmergencyStopDelay, output);
+    sendAnswer(Command(command.getSource(), command.getId(), output));
+    printf("Emergency stop: %uus (+%uus of waiting at most)\n", processingTime, waitingTime);
+}
@@ -20,13 +20,18 @@
 #define SERIAL_ENABLE 1
 
 /* Configurations diverses */
-#define COMMAND_BUFFER_SIZE     (MAX_SOCK_NUM + 1)
+#ifndef COMMAND_BUFFER_SIZE
+#define COMMAND_BUFFER_SIZE     24          // Nombre d'ordres en attente d'exécution (une place reste toujours libre)
+#endif
+#define COMMAND_BUFFER_BUDGET   8192        // Mémoire maximale occupée par le buffer de réception (octets)
+#define CREDIT_REPORT_PERIOD    1000        // Période minimale entre deux envois des crédits (µs)
 #define OUTPUT_BUFFER_SIZE      255
 #define HEADER_BYTE             0xFF
 #define DEFAULT_SUSCRIPTION     0x06
 #define MAX_RECEPTION_DURATION  500        // µs
 #define ASYNC_TRACE_FILENAME    "ISR"
 #define CHANNEL_MAX_NB          32
+#define EMERGENCY_STOP_ID       0xFE       // Trame prioritaire, traitée dès sa réception
 
 
 enum Channel
@@ -42,10 +47,25 @@ enum Channel
     PID_TRANS               = 0x08,
     PID_TRAJECTORY          = 0x09,
     BLOCKING_MGR            = 0x0A,
-    STOPPING_MGR            = 0x0B
+    STOPPING_MGR            = 0x0B,
+    SENSORS_TIMESTAMPED     = 0x0C,
+    SCAN_PROFILE            = 0x0D,
+    PUCK_TRACKING           = 0x0E,
+    TRAJECTORY_REQUEST      = 0x0F,
+    COMMAND_CREDITS         = 0x10,
+    SENSORS_HEALTH          = 0x11
 };
 
 
+/*
+    Tant qu'une trame par client ne peut pas être stockée, seules les trames
+    déjà commencées et les arrêts d'urgence sont lus
+*/
+static_assert(COMMAND_BUFFER_SIZE > MAX_SOCK_NUM + 2, "COMMAND_BUFFER_SIZE too small for the number of clients");
+static_assert(COMMAND_BUFFER_SIZE <= UINT8_MAX, "COMMAND_BUFFER_SIZE must fit in an uint8_t");
+static_assert(COMMAND_BUFFER_SIZE * (COMMAND_MAX_DATA_SIZE + 2) <= COMMAND_BUFFER_BUDGET, "COMMAND_BUFFER_SIZE exceeds the memory budget");
+
+
 class CommunicationServer
 {
 public:
@@ -58,6 +78,22 @@ public:
     /* Envoie les messages de la file d'attente et lit les messages entrants */
     void communicate();
 
+    /*
+        Lecture des messages entrants uniquement. Peut être appelée entre les
+        étapes de la boucle principale pour réduire le délai de traitement
+        d'un arrêt d'urgence.
+    */
+    void receive();
+
+    /* Nombre d'ordres pouvant encore être stockés dans le buffer de réception */
+    uint8_t freeSlots();
+
+    /* Fonction appelée dès la réception d'une trame EMERGENCY_STOP_ID */
+    void setEmergencyStopHandler(void (*handler)())
+    {
+        emergencyStopHandler = handler;
+    }
+
     /* Renvoie le nombre d'ordres présents dans le buffer de réception */
     uint8_t available();
 
@@ -141,7 +177,22 @@ private:
         Si la commande concerne une inscription/désinscription, mets à jour la subscriptionList
         Sinon, ajoute la commande au buffer des "commandes en attente d'exécution" 
     */
-    void processOrAddCommandToBuffer(Command command);
+    void processOrAddCommandToBuffer(Command command, uint32_t frameStartTime);
+
+    /* Arrêt d'urgence immédiat, puis réponse avec les délais mesurés (µs) */
+    void handleEmergencyStop(Command const & command, uint32_t frameStartTime);
+
+    /* Lecture d'un octet reçu du client donné */
+    void receiveByte(uint8_t byte, uint8_t source);
+
+    /*
+        Contrôle de flux par crédits : chaque client abonné au canal
+        COMMAND_CREDITS reçoit le nombre de places libres dans le buffer et
+        le nombre de trames reçues de sa part. Il peut envoyer autant de
+        trames que de places libres, moins celles envoyées mais pas encore
+        comptées. Envoi à chaque changement, au plus toutes les CREDIT_REPORT_PERIOD µs.
+    */
+    void sendCredits();
 
     /* Indique si le client est abonné à cette chaine */
     bool subscribed(uint8_t client, Channel channel)
@@ -170,6 +221,7 @@ private:
         {
             commandAvailable = false;
             receptionStarted = false;
+            frameStartTime = 0;
         }
 
         /* Renvoie 0 si l'octet a été ajouté, 1 sinon. Revoie -1 en cas de réception d'une trame d'information */
@@ -197,6 +249,7 @@ private:
                 else if(newByte == HEADER_BYTE)
                 {
                     receptionStarted = true;
+                    frameStartTime = micros();
                 }
                 else
                 {
@@ -210,6 +263,23 @@ private:
         {
             return commandAvailable;
         }
+
+        /*
+            Indique si l'octet suivant peut être lu alors que le buffer de
+            commandes n'a plus de place : l'en-tête est lu, puis la trame n'est
+            acceptée que s'il s'agit d'un arrêt d'urgence. Une trame déjà
+            commencée a été acceptée quand il restait de la place pour elle.
+        */
+        bool canReadWhenFull(int nextByte) const
+        {
+            if (commandAvailable) {
+                return false;
+            }
+            if (receptionStarted && receptionBuffer.empty()) {
+                return nextByte == EMERGENCY_STOP_ID;
+            }
+            return true;
+        }
         
         Command getCommand()
         {
@@ -217,11 +287,18 @@ private:
             return lastCommand;
         }
 
+        /* Date de lecture du premier octet de la dernière trame (µs) */
+        uint32_t getFrameStartTime() const
+        {
+            return frameStartTime;
+        }
+
     private:
         std::vector<uint8_t> receptionBuffer;
         bool commandAvailable;
         bool receptionStarted;
         Command lastCommand;
+        uint32_t frameStartTime;
     };
 
     struct ExecTrace
@@ -243,6 +320,15 @@ private:
     std::vector<ExecTrace> asyncTraceVect;
     std::vector<ExecTrace> asyncTraceVectBis;
     volatile bool bisTraceVectUsed;
+
+    void (*emergencyStopHandler)();
+    uint32_t lastReceptionTime;         // Fin de la dernière lecture des messages entrants (µs)
+    uint32_t worstEmergencyStopDelay;   // µs
+
+    uint32_t receivedFrames[MAX_SOCK_NUM + 1];      // Nombre de trames reçues de chaque client depuis sa connexion
+    uint32_t reportedFrames[MAX_SOCK_NUM + 1];      // Valeur de receivedFrames lors du dernier envoi des crédits
+    uint8_t reportedFreeSlots;
+    uint32_t lastCreditReport;                      // µs
 };
 
 
@@ -16,6 +16,10 @@
 #define SERIAL_AX12			    Serial1		// Pins 0 1
 #define SERIAL_AX12_BAUDRATE    1000000
 #define SERIAL_AX12_TIMEOUT     10          // ms  (standard is 50ms, minimum is 2ms)
+#define SERIAL_AX12_DIR_REG     (&UART0_C3) // Registre de direction du half-duplex de Serial1 (utilisé par DynamixelTransport)
+#define SERIAL_AX12_DIR_MASK    UART_C3_TXDIR
+#define SERIAL_AX12_STATUS_REG  (&UART0_S1) // Registre d'tat de Serial1 : fin d'mission (utilis par DynamixelTransport)
+#define SERIAL_AX12_TC_MASK     UART_S1_TC
 
 /* IDs des AX12 */
 #define ID_AX12_DIRECTION   2
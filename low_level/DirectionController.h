@@ -7,6 +7,7 @@
 #include <DynamixelInterface.h>
 #include <DynamixelMotor.h>
 #include "SerialAX12.h"
+#include "DynamixelBusMgr.h"
 #include "Singleton.h"
 #include "Utils.h"
 #include "Config.h"
@@ -34,8 +35,11 @@ class DirectionController : public Singleton<DirectionController>, public Printa
 {
 public:
 	DirectionController() :
-        directionMotor(SerialAX12, ID_AX12_DIRECTION)
+        directionMotor(SerialAX12, ID_AX12_DIRECTION),
+        bus(DynamixelBusMgr::Instance())
 	{
+        bus.addServo(ID_AX12_DIRECTION, DYN_BUS_PRIORITY_HIGH);
+        lastSampleCount = 0;
 		aimCurvature = 0;
 		updateAimAngle();
         realMotorAngle = DIR_ANGLE_ORIGIN;
@@ -55,37 +59,37 @@ public:
     DirectionControllerStatus control()
 	{
 		static uint32_t lastUpdateTime = 0;
-		static bool read = true;
         DirectionControllerStatus ret = DIRECTION_CONTROLLER_OK;
 		
 		if (micros() - lastUpdateTime >= CONTROL_PERIOD)
 		{
-            DynamixelStatus dynamixelStatus = DYN_STATUS_OK;
 			lastUpdateTime = micros();
-            if (read)
+
+            /* Lecture effectue lors du prcdent DynamixelBusMgr::update() */
+            uint16_t angle;
+            uint32_t sampleTime, sampleCount;
+            DynamixelStatus dynamixelStatus = bus.getPosition(ID_AX12_DIRECTION, angle, sampleTime, sampleCount);
+            if (sampleCount != lastSampleCount)
             {
-                uint16_t angle;
-                dynamixelStatus = directionMotor.currentPositionDegree(angle);
-                if (angle <= 300) {
+                lastSampleCount = sampleCount;
+                if (!(dynamixelStatus & DYN_STATUS_COM_ERROR) && angle <= 300) {
                     realMotorAngle = constrain(angle, DIR_ANGLE_MIN, DIR_ANGLE_MAX);
+                    updateRealCurvature();
+                }
+                if (dynamixelStatus != DYN_STATUS_OK)
+                {
+                    Server.printf_err("DirectionController: errno %u\n", dynamixelStatus);
+                }
+                if (dynamixelStatus & (DYN_STATUS_OVERLOAD_ERROR | DYN_STATUS_OVERHEATING_ERROR))
+                {
+                    ret = DIRECTION_CONTROLLER_MOTOR_BLOCKED;
                 }
-                updateRealCurvature();
             }
-            else
-			{
-                updateAimAngle();
-                dynamixelStatus = directionMotor.goalPositionDegree(aimMotorAngle);
-			}
 
-            if (dynamixelStatus != DYN_STATUS_OK)
-            {
-                Server.printf_err("DirectionController: errno %u on operation #%d\n", dynamixelStatus, read);
-            }
-            if (dynamixelStatus & (DYN_STATUS_OVERLOAD_ERROR | DYN_STATUS_OVERHEATING_ERROR))
-            {
-                ret = DIRECTION_CONTROLLER_MOTOR_BLOCKED;
-            }
-            read = !read;
+            /* Consigne et lecture envoyes  chaque priode, en priorit sur le bus */
+            updateAimAngle();
+            bus.setGoalPosition(ID_AX12_DIRECTION, aimMotorAngle);
+            bus.requestRead(ID_AX12_DIRECTION);
             Server.print(DIRECTION, *this);
 		}
 
@@ -94,6 +98,7 @@ public:
 
     void recover()
     {
+        bus.waitIdle();
         directionMotor.recoverTorque();
     }
 	
@@ -175,6 +180,8 @@ private:
 
 	/* L'AX12 de direction */
 	DynamixelMotor directionMotor;
+    DynamixelBusMgr & bus;
+    uint32_t lastSampleCount;
 
     /* Table de conversion Angle-Courbure */
     static float angle_curvature_table[DIR_TABLE_SIZE];
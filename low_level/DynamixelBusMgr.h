@@ -0,0 +1,343 @@
+#ifndef DYNAMIXEL_BUS_MGR_h
+#define DYNAMIXEL_BUS_MGR_h
+
+#include <Arduino.h>
+#include <Dynamixel.h>
+#include "Config.h"
+#include "DynamixelTransport.h"
+#include "Singleton.h"
+
+#define DYN_BUS_MAX_SERVOS          4
+
+/* AX12 control table */
+#define AX12_GOAL_POSITION_ADDR     0x1E    // goal position (2 bytes) followed by moving speed (2 bytes)
+#define AX12_PRESENT_POSITION_ADDR  0x24    // present position, speed and load (2 bytes each), ..., moving (0x2E)
+#define AX12_GOAL_BLOCK_SIZE        4
+#define AX12_PRESENT_BLOCK_SIZE     11
+#define AX12_MOVING_OFFSET          10      // offset of the moving flag in the present block
+#define AX12_POSITION_MAX           1023
+#define AX12_ANGLE_MAX              300     // deg
+
+
+enum DynamixelBusPriority
+{
+    DYN_BUS_PRIORITY_HIGH = 0,      // Steering: served first, at each update
+    DYN_BUS_PRIORITY_NORMAL = 1     // Actuators: served when no steering request is pending
+};
+
+
+/*
+    Owner of the periodic traffic on the AX12 bus.
+    Callers post goals and read requests, update() moves the bus forward
+    without ever waiting for a servo:
+    - every pending goal (position and speed) goes out in a single SYNC_WRITE,
+    - reads are served by priority. Each one gets position, speed, load and
+      the moving flag in a single READ (AX12 servos do not support BULK_READ).
+    Results are cached along with the time at which they were sampled, they
+    become available on a later main loop iteration.
+    Initialisation and torque commands still go through DynamixelMotor (they
+    block), call waitIdle() before using it.
+*/
+class DynamixelBusMgr : public Singleton<DynamixelBusMgr>
+{
+public:
+    DynamixelBusMgr() :
+        transport(SERIAL_AX12, SERIAL_AX12_DIR_REG, SERIAL_AX12_DIR_MASK, SERIAL_AX12_STATUS_REG, SERIAL_AX12_TC_MASK)
+    {
+        nbServos = 0;
+        currentRead = nullptr;
+    }
+
+    void addServo(uint8_t id, DynamixelBusPriority priority)
+    {
+        if (findServo(id) != nullptr || nbServos >= DYN_BUS_MAX_SERVOS) {
+            return;
+        }
+        Servo & s = servos[nbServos];
+        s.id = id;
+        s.priority = priority;
+        s.goalPosition = 0;
+        s.movingSpeed = 0;
+        s.goalPending = false;
+        s.goalSending = false;
+        s.goalSentTime = 0;
+        s.readPending = false;
+        s.presentPosition = 0;
+        s.presentSpeed = 0;
+        s.presentLoad = 0;
+        s.moving = false;
+        s.sampleTime = 0;
+        s.sampleCount = 0;
+        s.status = DYN_STATUS_OK;
+        nbServos++;
+    }
+
+    /* Goal position (deg) and moving speed (AX12 unit), sent during the next update() */
+    void setGoal(uint8_t id, uint16_t angle, uint16_t speed)
+    {
+        Servo *s = findServo(id);
+        if (s != nullptr) {
+            s->goalPosition = degreeToPosition(angle);
+            s->movingSpeed = speed;
+            s->goalPending = true;
+        }
+    }
+
+    /* Goal position (deg), the last moving speed is kept */
+    void setGoalPosition(uint8_t id, uint16_t angle)
+    {
+        Servo *s = findServo(id);
+        if (s != nullptr) {
+            setGoal(id, angle, s->movingSpeed);
+        }
+    }
+
+    void requestRead(uint8_t id)
+    {
+        Servo *s = findServo(id);
+        if (s != nullptr) {
+            s->readPending = true;
+        }
+    }
+
+    /*
+        Last position read (deg), with the time at which it was sampled (µs).
+        sampleCount is incremented at each completed read, successful or not:
+        the position is only updated if the returned status has no DYN_STATUS_COM_ERROR.
+    */
+    DynamixelStatus getPosition(uint8_t id, uint16_t & angle, uint32_t & sampleTime, uint32_t & sampleCount) const
+    {
+        const Servo *s = findServo(id);
+        if (s == nullptr) {
+            return DYN_STATUS_INTERNAL_ERROR;
+        }
+        angle = positionToDegree(s->presentPosition);
+        sampleTime = s->sampleTime;
+        sampleCount = s->sampleCount;
+        return s->status;
+    }
+
+    DynamixelStatus getPosition(uint8_t id, uint16_t & angle) const
+    {
+        uint32_t sampleTime, sampleCount;
+        return getPosition(id, angle, sampleTime, sampleCount);
+    }
+
+    /*
+        Time at which the servo received its last goal (µs), false while this goal
+        is waiting for or being sent: a reading sampled before this time does not
+        reflect the goal yet.
+    */
+    bool getGoalReceivedTime(uint8_t id, uint32_t & receivedTime) const
+    {
+        const Servo *s = findServo(id);
+        if (s == nullptr || s->goalPending || s->goalSending) {
+            return false;
+        }
+        receivedTime = s->goalSentTime;
+        return true;
+    }
+
+    /* Moving flag of the last reading: false once the servo has reached its goal */
+    bool isMoving(uint8_t id) const
+    {
+        const Servo *s = findServo(id);
+        return s != nullptr && s->moving;
+    }
+
+    /* Status of the last reading (a SYNC_WRITE does not return any) */
+    DynamixelStatus getStatus(uint8_t id) const
+    {
+        const Servo *s = findServo(id);
+        if (s == nullptr) {
+            return DYN_STATUS_INTERNAL_ERROR;
+        }
+        return s->status;
+    }
+
+    /* To be called once per main loop iteration, never blocks */
+    void update()
+    {
+        while (true)
+        {
+            if (!transport.isIdle())
+            {
+                if (!transport.poll()) {
+                    return;
+                }
+                endTransaction();
+            }
+            if (!startNextTransaction()) {
+                return;
+            }
+        }
+    }
+
+    /* Waits for the end of the transaction in progress, before a blocking use of the bus */
+    void waitIdle()
+    {
+        while (!transport.isIdle())
+        {
+            if (transport.poll()) {
+                endTransaction();
+            }
+        }
+    }
+
+    static uint16_t degreeToPosition(uint16_t angle)
+    {
+        return min((uint32_t)angle * AX12_POSITION_MAX / AX12_ANGLE_MAX, (uint32_t)AX12_POSITION_MAX);
+    }
+
+    static uint16_t positionToDegree(uint16_t position)
+    {
+        return (uint32_t)position * AX12_ANGLE_MAX / AX12_POSITION_MAX;
+    }
+
+private:
+    struct Servo
+    {
+        uint8_t id;
+        DynamixelBusPriority priority;
+        uint16_t goalPosition;      // AX12 unit
+        uint16_t movingSpeed;       // AX12 unit
+        bool goalPending;
+        bool goalSending;           // in the SYNC_WRITE in progress
+        uint32_t goalSentTime;      // µs, received by the servo
+        bool readPending;
+        uint16_t presentPosition;   // AX12 unit
+        uint16_t presentSpeed;      // AX12 unit
+        uint16_t presentLoad;       // AX12 unit
+        bool moving;
+        uint32_t sampleTime;        // µs
+        uint32_t sampleCount;
+        DynamixelStatus status;
+    };
+
+    Servo *findServo(uint8_t id)
+    {
+        for (size_t i = 0; i < nbServos; i++) {
+            if (servos[i].id == id) {
+                return &servos[i];
+            }
+        }
+        return nullptr;
+    }
+
+    const Servo *findServo(uint8_t id) const
+    {
+        for (size_t i = 0; i < nbServos; i++) {
+            if (servos[i].id == id) {
+                return &servos[i];
+            }
+        }
+        return nullptr;
+    }
+
+    /* Goals first (no status packet to wait for), then reads by priority */
+    bool startNextTransaction()
+    {
+        if (flushGoals()) {
+            return true;
+        }
+        for (size_t i = 0; i < nbServos; i++) {
+            if (servos[i].readPending && servos[i].priority == DYN_BUS_PRIORITY_HIGH) {
+                return startRead(servos[i]);
+            }
+        }
+        for (size_t i = 0; i < nbServos; i++) {
+            if (servos[i].readPending && servos[i].priority == DYN_BUS_PRIORITY_NORMAL) {
+                return startRead(servos[i]);
+            }
+        }
+        return false;
+    }
+
+    bool flushGoals()
+    {
+        uint8_t ids[DYN_BUS_MAX_SERVOS];
+        uint8_t data[DYN_BUS_MAX_SERVOS * AX12_GOAL_BLOCK_SIZE];
+        uint8_t n = 0;
+        for (size_t i = 0; i < nbServos; i++) {
+            Servo & s = servos[i];
+            if (s.goalPending) {
+                ids[n] = s.id;
+                data[n * AX12_GOAL_BLOCK_SIZE] = s.goalPosition & 0xFF;
+                data[n * AX12_GOAL_BLOCK_SIZE + 1] = s.goalPosition >> 8;
+                data[n * AX12_GOAL_BLOCK_SIZE + 2] = s.movingSpeed & 0xFF;
+                data[n * AX12_GOAL_BLOCK_SIZE + 3] = s.movingSpeed >> 8;
+                s.goalPending = false;
+                s.goalSending = true;
+                n++;
+            }
+        }
+        if (n == 0) {
+            return false;
+        }
+        if (!transport.submitSyncWrite(n, ids, AX12_GOAL_POSITION_ADDR, AX12_GOAL_BLOCK_SIZE, data))
+        {
+            for (size_t i = 0; i < nbServos; i++) {
+                servos[i].goalSending = false;
+            }
+            return false;
+        }
+        return true;
+    }
+
+    bool startRead(Servo & s)
+    {
+        s.readPending = false;
+        if (!transport.submitRead(s.id, AX12_PRESENT_POSITION_ADDR, AX12_PRESENT_BLOCK_SIZE)) {
+            return false;
+        }
+        currentRead = &s;
+        return true;
+    }
+
+    void endTransaction()
+    {
+        if (currentRead == nullptr) {
+            endSyncWrite();
+        }
+        else {
+            endRead();
+        }
+    }
+
+    void endSyncWrite()
+    {
+        transport.takeResult(nullptr);
+        for (size_t i = 0; i < nbServos; i++) {
+            if (servos[i].goalSending) {
+                servos[i].goalSending = false;
+                servos[i].goalSentTime = transport.getRequestReceivedTime();
+            }
+        }
+    }
+
+    void endRead()
+    {
+        uint8_t data[AX12_PRESENT_BLOCK_SIZE];
+        DynamixelStatus status = transport.takeResult(data);
+        Servo *s = currentRead;
+        currentRead = nullptr;
+        s->status = status;
+        s->sampleCount++;
+        if (status & DYN_STATUS_COM_ERROR) {
+            return;
+        }
+        s->presentPosition = data[0] | (data[1] << 8);
+        s->presentSpeed = data[2] | (data[3] << 8);
+        s->presentLoad = data[4] | (data[5] << 8);
+        s->moving = data[AX12_MOVING_OFFSET] != 0;
+        s->sampleTime = transport.getRequestReceivedTime();
+    }
+
+    DynamixelTransport transport;
+    Servo servos[DYN_BUS_MAX_SERVOS];
+    size_t nbServos;
+    Servo *currentRead;     // read in progress
+};
+
+
+#endif
@@ -0,0 +1,318 @@
+#ifndef DYNAMIXEL_TRANSPORT_h
+#define DYNAMIXEL_TRANSPORT_h
+
+#include <Arduino.h>
+#include <Dynamixel.h>
+
+#define DYN_TRANSPORT_TIMEOUT       3000    // µs, maximal wait for a status packet
+#define DYN_TRANSPORT_MAX_PACKET    64      // bytes (size of the UART transmit buffer)
+#define DYN_TRANSPORT_BYTE_DURATION 10      // µs (1 Mbaud)
+#define DYN_TRANSPORT_TX_PRIORITY   240     // End of transmission interrupt, above the motion control (253) and the Z steps (252)
+
+/* Protocol 1.0 */
+#define DYN_BROADCAST_ID            0xFE
+#define DYN_INSTR_READ              0x02
+#define DYN_INSTR_WRITE             0x03
+#define DYN_INSTR_SYNC_WRITE        0x83
+
+
+/*
+    Non blocking half-duplex transport for the AX12 bus.
+    A request is submitted (the packet is queued in the UART transmit buffer,
+    which is emptied by the UART interrupt), then poll() parses the status
+    packet as its bytes arrive, until it is complete or the timeout expires.
+    The echo of the instruction packet, if the UART receives it, is skipped.
+    A single transaction may be in flight at a time.
+    As with DynamixelInterface, the UART is switched to write mode for the
+    instruction packet, then back to read mode once the last byte is out,
+    before the servo answers. submit*() returns as soon as the packet is
+    queued: a one-shot timer, armed for the expected end of the packet,
+    checks the transmission complete flag of the UART and switches the
+    direction (poll() does the same check). The timer reacts within a few
+    µs, well inside the return delay of the servos, whatever the duration
+    of the main loop.
+*/
+class DynamixelTransport
+{
+public:
+    /*
+        direction_register: UART control register whose 'direction_mask' bits select write mode (nullptr: full duplex)
+        status_register: UART status register whose 'tx_complete_mask' bit is set once the last byte is out
+        (nullptr: the transmission is assumed complete after its nominal duration)
+    */
+    DynamixelTransport(Stream & serial, volatile uint8_t *direction_register = nullptr, uint8_t direction_mask = 0,
+        volatile uint8_t *status_register = nullptr, uint8_t tx_complete_mask = 0) :
+        m_serial(serial),
+        m_direction_register(direction_register),
+        m_direction_mask(direction_mask),
+        m_status_register(status_register),
+        m_tx_complete_mask(tx_complete_mask)
+    {
+        m_tx_timer.priority(DYN_TRANSPORT_TX_PRIORITY);
+        m_busy = false;
+        m_done = false;
+        m_transmitting = false;
+        m_answer_expected = false;
+        m_id = 0;
+        m_expected_length = 0;
+        m_tx_length = 0;
+        m_rx_index = 0;
+        m_status = DYN_STATUS_OK;
+        m_submit_time = 0;
+        m_completion_time = 0;
+    }
+
+    bool isIdle() const
+    {
+        return !m_busy;
+    }
+
+    bool submitRead(uint8_t id, uint8_t address, uint8_t length)
+    {
+        if (m_busy || length > DYN_TRANSPORT_MAX_PACKET - 6) {
+            return false;
+        }
+        uint8_t params[2] = { address, length };
+        m_expected_length = length;
+        m_answer_expected = true;
+        sendPacket(id, DYN_INSTR_READ, params, 2);
+        return true;
+    }
+
+    bool submitWrite(uint8_t id, uint8_t address, uint8_t length, const uint8_t *data)
+    {
+        if (m_busy || length + 8 > DYN_TRANSPORT_MAX_PACKET) {
+            return false;
+        }
+        uint8_t params[DYN_TRANSPORT_MAX_PACKET];
+        params[0] = address;
+        memcpy(params + 1, data, length);
+        m_expected_length = 0;
+        m_answer_expected = true;
+        sendPacket(id, DYN_INSTR_WRITE, params, length + 1);
+        return true;
+    }
+
+    /* No status packet is returned: the transaction ends with the transmission */
+    bool submitSyncWrite(uint8_t nb_servos, const uint8_t *ids, uint8_t address, uint8_t length, const uint8_t *data)
+    {
+        size_t nb_params = 2 + (size_t)nb_servos * (length + 1);
+        if (m_busy || nb_params + 6 > DYN_TRANSPORT_MAX_PACKET) {
+            return false;
+        }
+        uint8_t params[DYN_TRANSPORT_MAX_PACKET];
+        params[0] = address;
+        params[1] = length;
+        for (size_t i = 0; i < nb_servos; i++)
+        {
+            params[2 + i * (length + 1)] = ids[i];
+            memcpy(params + 3 + i * (length + 1), data + i * length, length);
+        }
+        m_expected_length = 0;
+        m_answer_expected = false;
+        sendPacket(DYN_BROADCAST_ID, DYN_INSTR_SYNC_WRITE, params, nb_params);
+        return true;
+    }
+
+    /* Returns true once the status packet of the current request is complete (or timed out) */
+    bool poll()
+    {
+        if (!m_busy || m_done) {
+            return m_done;
+        }
+        noInterrupts();
+        bool transmitted = endTransmission();
+        interrupts();
+        if (transmitted && !m_answer_expected) {
+            m_done = true;
+        }
+        while (!m_done && m_serial.available() > 0) {
+            parseByte(m_serial.read());
+        }
+        if (!m_done && micros() - m_submit_time > DYN_TRANSPORT_TIMEOUT)
+        {
+            m_status = DYN_STATUS_COM_ERROR | DYN_STATUS_TIMEOUT;
+            m_done = true;
+        }
+        if (m_done) {
+            m_completion_time = micros();
+        }
+        return m_done;
+    }
+
+    /* Ends the transaction, the data read (if any) is copied into 'data' */
+    DynamixelStatus takeResult(uint8_t *data)
+    {
+        if (data != nullptr && m_expected_length > 0 && !(m_status & DYN_STATUS_COM_ERROR)) {
+            memcpy(data, m_rx + 5, m_expected_length);
+        }
+        m_busy = false;
+        m_done = false;
+        return m_status;
+    }
+
+    uint32_t getSubmitTime() const { return m_submit_time; }
+    uint32_t getCompletionTime() const { return m_completion_time; }
+
+    /* The servo samples its registers as soon as it has received the whole request */
+    uint32_t getRequestReceivedTime() const
+    {
+        return m_submit_time + m_tx_length * DYN_TRANSPORT_BYTE_DURATION;
+    }
+
+private:
+    void sendPacket(uint8_t id, uint8_t instruction, const uint8_t *params, size_t nb_params)
+    {
+        // Bytes left from a previous (timed out) transaction
+        while (m_serial.available() > 0) {
+            m_serial.read();
+        }
+
+        m_tx[0] = 0xFF;
+        m_tx[1] = 0xFF;
+        m_tx[2] = id;
+        m_tx[3] = nb_params + 2;
+        m_tx[4] = instruction;
+        memcpy(m_tx + 5, params, nb_params);
+        m_tx_length = nb_params + 6;
+        m_tx[m_tx_length - 1] = checksum(m_tx);
+
+        m_id = id;
+        m_busy = true;
+        m_done = false;
+        m_rx_index = 0;
+        m_status = DYN_STATUS_OK;
+        m_submit_time = micros();
+        m_transmitting = true;
+        writeMode();
+        m_serial.write(m_tx, m_tx_length);
+        transmittingInstance() = this;
+        m_tx_timer.begin(txInterrupt, m_tx_length * DYN_TRANSPORT_BYTE_DURATION);
+    }
+
+    /* End of transmission timer: checks again every byte duration until the last byte is out */
+    static void txInterrupt()
+    {
+        DynamixelTransport *transport = transmittingInstance();
+        if (transport->endTransmission()) {
+            transport->m_tx_timer.end();
+        }
+        else {
+            transport->m_tx_timer.begin(txInterrupt, DYN_TRANSPORT_BYTE_DURATION);
+        }
+    }
+
+    static DynamixelTransport* & transmittingInstance()
+    {
+        static DynamixelTransport* instance = nullptr;
+        return instance;
+    }
+
+    /* Once the last byte is out, releases the bus for the status packet. Returns true if the transmission is over */
+    bool endTransmission()
+    {
+        if (m_transmitting && transmissionComplete())
+        {
+            readMode();
+            m_transmitting = false;
+        }
+        return !m_transmitting;
+    }
+
+    bool transmissionComplete() const
+    {
+        if (micros() - m_submit_time < m_tx_length * DYN_TRANSPORT_BYTE_DURATION) {
+            return false;
+        }
+        return m_status_register == nullptr || (*m_status_register & m_tx_complete_mask) != 0;
+    }
+
+    void writeMode()
+    {
+        if (m_direction_register != nullptr) {
+            *m_direction_register |= m_direction_mask;
+        }
+    }
+
+    void readMode()
+    {
+        if (m_direction_register != nullptr) {
+            *m_direction_register &= ~m_direction_mask;
+        }
+    }
+
+    void parseByte(uint8_t b)
+    {
+        if (m_rx_index < 2)
+        {
+            m_rx_index = (b == 0xFF) ? m_rx_index + 1 : 0;
+            m_rx[0] = 0xFF;
+            m_rx[1] = 0xFF;
+            return;
+        }
+        if (m_rx_index == 2 && b == 0xFF) {
+            return;
+        }
+        if (m_rx_index == 3 && (b < 2 || b + 4 > DYN_TRANSPORT_MAX_PACKET))
+        {
+            m_rx_index = 0;
+            return;
+        }
+        m_rx[m_rx_index++] = b;
+        if (m_rx_index < 4 || m_rx_index < (size_t)m_rx[3] + 4) {
+            return;
+        }
+
+        // Packet complete
+        size_t length = m_rx_index;
+        m_rx_index = 0;
+        if (length == m_tx_length && memcmp(m_rx, m_tx, length) == 0) {
+            return; // Echo of our own instruction packet
+        }
+        if (m_rx[2] != m_id) {
+            return;
+        }
+        if (checksum(m_rx) != m_rx[length - 1]) {
+            m_status = DYN_STATUS_COM_ERROR | DYN_STATUS_CHECKSUM_ERROR;
+        }
+        else if (m_rx[3] != m_expected_length + 2) {
+            m_status = DYN_STATUS_COM_ERROR;
+        }
+        else {
+            m_status = m_rx[4];
+        }
+        m_done = true;
+    }
+
+    static uint8_t checksum(const uint8_t *packet)
+    {
+        uint8_t sum = 0;
+        for (size_t i = 2; i < (size_t)packet[3] + 3; i++) {
+            sum += packet[i];
+        }
+        return ~sum;
+    }
+
+    Stream & m_serial;
+    volatile uint8_t * const m_direction_register;
+    const uint8_t m_direction_mask;
+    volatile uint8_t * const m_status_register;
+    const uint8_t m_tx_complete_mask;
+    IntervalTimer m_tx_timer;
+    bool m_busy;
+    bool m_done;
+    volatile bool m_transmitting;   // UART in write mode, instruction packet not entirely sent
+    bool m_answer_expected;         // A status packet follows the instruction packet
+    uint8_t m_id;                   // ID of the servo expected to answer
+    uint8_t m_expected_length;      // number of data bytes expected in the status packet
+    uint8_t m_tx[DYN_TRANSPORT_MAX_PACKET];
+    size_t m_tx_length;
+    uint8_t m_rx[DYN_TRANSPORT_MAX_PACKET];
+    size_t m_rx_index;
+    DynamixelStatus m_status;
+    uint32_t m_submit_time;         // µs
+    uint32_t m_completion_time;     // µs
+};
+
+
+#endif
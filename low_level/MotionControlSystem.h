@@ -5,9 +5,11 @@
 #include "MoveState.h"
 #include "Position.h"
 #include "TrajectoryPoint.h"
+#include "PositionHistory.h"
 #include "MotionControlTunings.h"
 #include "Singleton.h"
 #include "CommunicationServer.h"
+#include "Serializer.h"
 #include <vector>
 
 
@@ -15,6 +17,11 @@
 #define PERIOD_ASSERV	(1000000 / FREQ_ASSERV)	// Priode d'asservissement (s)
 #define TRAJECTORY_STEP 20			            // Distance entre deux points d'une trajectoire (mm)
 
+#define STREAM_WINDOW_SIZE          64      // Nombre maximal de points non parcourus en mmoire (mode streaming)
+#define STREAM_COMPACT_THRESHOLD    16      // Nombre de points parcourus au-del duquel ils sont librs (mode streaming)
+#define STREAM_REQUEST_MARGIN       200     // Distance ajoute  la distance de freinage pour demander des points (mm)
+#define STREAM_REQUEST_PERIOD       20      // Priode minimale entre deux demandes de points (ms)
+
 #define TRAJECTORY_EDITION_SUCCESS  0
 #define TRAJECTORY_EDITION_FAILURE  1
 
@@ -29,6 +36,21 @@ public:
 		trajectoryIndex = 0;
 		trajectoryComplete = false;
 		moveStatus = MOVE_OK;
+        spliceIndex = 0;
+        spliceComplete = false;
+        streaming = false;
+        trajectoryOffset = 0;
+        holdReceivedPoints = 0;
+        lastStreamRequest = 0;
+        trajectoryStartTime = 0;
+        targetPointIndex = 0;
+        targetPointFound = false;
+        targetPointOutdated = true;
+        predictedArrivalTime = 0;
+        endPointIndex = 0;
+        endPointFound = false;
+        distanceToEnd = 0;
+        distanceToEndKnown = false;
 	}
 
 
@@ -43,6 +65,7 @@ public:
 		static bool wasTravellingToDestination = false;
 
         trajectoryFollower.control();
+        positionHistory.add(micros(), position);
 		if (travellingToDestination)
 		{
             MovePhase movePhase = trajectoryFollower.getMovePhase();
@@ -55,6 +78,8 @@ public:
                     updateDistanceToTravel();
 				    trajectoryFollower.startMove();
 				    wasTravellingToDestination = true;
+                    trajectoryStartTime = millis();
+                    targetPointOutdated = true;
 			    }
                 else if (movePhase == MOVING && !currentTrajectory.at(trajectoryIndex).isStopPoint())
                 {
@@ -72,15 +97,17 @@ public:
                         if (currentTrajectory.size() > trajectoryIndex + 1)
                         {
                             trajectoryIndex++;
+                            targetPointOutdated = true;
                             updateDistanceToTravel();
                             trajectoryFollower.setTrajectoryPoint(currentTrajectory.at(trajectoryIndex));
                         }
-                        else
+                        else if (!streaming || trajectoryComplete)
                         {
                             moveStatus |= EMPTY_TRAJ;
                             stop_and_clear_trajectory_from_interrupt();
                             Server.asynchronous_trace(__LINE__);
                         }
+                        // Sinon, le robot freine jusqu'au dernier point reu en attendant les suivants
                     }
                 }
                 else if (movePhase == MOVE_ENDED)
@@ -91,11 +118,27 @@ public:
                         travellingToDestination = false;
                         wasTravellingToDestination = false;
                     }
+                    else if (trajectoryFollower.isHolding())
+                    {
+                        // Pause, ou attente des points suivants : reprise sur le mme point
+                        if (trajectoryFollower.getSpeedScale() > 0 &&
+                            (!streaming || trajectoryComplete || currentTrajectory.size() + trajectoryOffset > holdReceivedPoints))
+                        {
+                            updateDistanceToTravel();
+                            trajectoryFollower.startMove();
+                            holdReceivedPoints = currentTrajectory.size() + trajectoryOffset;
+                        }
+                    }
+                    else if (streaming && !trajectoryComplete && currentTrajectory.size() <= trajectoryIndex + 1)
+                    {
+                        // Point d'arrt atteint avant la rception des points suivants
+                    }
                     else
                     {
                         if (currentTrajectory.size() > trajectoryIndex + 1)
                         {
                             trajectoryIndex++;
+                            targetPointOutdated = true;
                             updateDistanceToTravel();
                             trajectoryFollower.setTrajectoryPoint(currentTrajectory.at(trajectoryIndex));
                             trajectoryFollower.startMove();
@@ -121,6 +164,11 @@ public:
                 travellingToDestination = false;
                 wasTravellingToDestination = false;
             }
+
+            if (travellingToDestination && wasTravellingToDestination)
+            {
+                updateSchedule();
+            }
 		}
 	}
 
@@ -132,6 +180,87 @@ private:
         trajectoryIndex = 0;
         currentTrajectory.clear();
         trajectoryComplete = false;
+        targetPointOutdated = true;
+        predictedArrivalTime = 0;
+        distanceToEndKnown = false;
+        streaming = false;
+        trajectoryOffset = 0;
+        trajectoryFollower.setWaitingForPoints(false);
+    }
+
+    /*
+        Le point vis est le prochain point planifi, ou  dfaut la fin de la
+        trajectoire. On adapte la vitesse pour arriver  l'heure au point
+        planifi (sans dpasser la vitesse max des points), et on prdit
+        l'heure d'arrive au point vis.
+        La distance restant  parcourir jusqu' la fin de la trajectoire est
+        mise  jour en mme temps, pour getDistanceToEnd().
+    */
+    void updateSchedule()
+    {
+        if (targetPointOutdated)
+        {
+            targetPointFound = false;
+            endPointFound = false;
+            for (size_t i = trajectoryIndex; i < currentTrajectory.size() && !endPointFound; i++)
+            {
+                if (!targetPointFound && (currentTrajectory.at(i).isScheduled() || currentTrajectory.at(i).isEndOfTrajectory()))
+                {
+                    targetPointIndex = i;
+                    targetPointFound = true;
+                }
+                if (currentTrajectory.at(i).isEndOfTrajectory())
+                {
+                    endPointIndex = i;
+                    endPointFound = true;
+                }
+            }
+            targetPointOutdated = false;
+        }
+        if (!targetPointFound)
+        {
+            trajectoryFollower.setScheduledSpeed(0);
+            predictedArrivalTime = 0;
+            distanceToEndKnown = false;
+            return;
+        }
+
+        // Distance restant  parcourir jusqu'au point vis
+        Position trajPoint = currentTrajectory.at(trajectoryIndex).getPosition();
+        float sign = trajectoryFollower.isMovingForward() ? 1 : -1;
+        float distanceToCurrentPoint = ((trajPoint.x - position.x) * cosf(trajPoint.orientation) + (trajPoint.y - position.y) * sinf(trajPoint.orientation)) * sign;
+        float distance = ((float)targetPointIndex - (float)trajectoryIndex) * TRAJECTORY_STEP + MAX(distanceToCurrentPoint, 0);
+        distanceToEnd = ((float)endPointIndex - (float)trajectoryIndex) * TRAJECTORY_STEP + MAX(distanceToCurrentPoint, 0);
+        distanceToEndKnown = endPointFound;
+
+        uint32_t now = millis();
+        float speed = ABS(trajectoryFollower.getMaxMovingSpeed());
+        const TrajectoryPoint & target = currentTrajectory.at(targetPointIndex);
+        if (target.isScheduled())
+        {
+            int32_t timeLeft = (int32_t)(trajectoryStartTime + target.getArrivalTime() - now);
+            if (timeLeft > 0 && distance * 1000 / timeLeft < speed)
+            {
+                speed = distance * 1000 / timeLeft;
+                trajectoryFollower.setScheduledSpeed(speed);
+            }
+            else
+            {
+                // En retard : on roule  la vitesse maximale
+                trajectoryFollower.setScheduledSpeed(0);
+            }
+        }
+        else
+        {
+            trajectoryFollower.setScheduledSpeed(0);
+        }
+
+        if (speed > 0) {
+            predictedArrivalTime = now + (uint32_t)(distance * 1000 / speed);
+        }
+        else {
+            predictedArrivalTime = 0;
+        }
     }
 
     void updateDistanceToTravel()
@@ -143,9 +272,22 @@ private:
             {
                 float distanceToDrive = ((float)i - (float)trajectoryIndex + 1) * TRAJECTORY_STEP;
                 trajectoryFollower.setDistanceToDrive(distanceToDrive);
+                trajectoryFollower.setWaitingForPoints(false);
                 return;
             }
         }
+        if (streaming && !trajectoryComplete)
+        {
+            // On ralentit pour ne pas dpasser le dernier point reu
+            float distanceToDrive = ((float)currentTrajectory.size() - (float)trajectoryIndex) * TRAJECTORY_STEP;
+            trajectoryFollower.setDistanceToDrive(distanceToDrive);
+            trajectoryFollower.setWaitingForPoints(true);
+            if (!trajectoryFollower.isHolding()) {
+                holdReceivedPoints = currentTrajectory.size() + trajectoryOffset;
+            }
+            return;
+        }
+        trajectoryFollower.setWaitingForPoints(false);
         trajectoryFollower.setInfiniteDistanceToDrive();
     }
 
@@ -157,12 +299,18 @@ private:
 	*/
 
  public:
-	void followTrajectory()
+	/*
+		En mode streaming, le mouvement dmarre avant que la trajectoire soit
+		complte : les points suivants sont demands au fur et  mesure (voir
+		updateStreaming) et le robot ralentit s'ils tardent  arriver.
+	*/
+	void followTrajectory(bool streamingMode = false)
 	{
         if (trajectoryFollower.isTrajectoryControlled())
         {
             noInterrupts();
             moveStatus = MOVE_OK;
+            streaming = streamingMode;
             travellingToDestination = true;
             interrupts();
         }
@@ -212,13 +360,22 @@ private:
 	{
 		if (!trajectoryComplete)
 		{
+            if (streaming && currentTrajectory.size() - trajectoryIndex >= STREAM_WINDOW_SIZE)
+            {
+                return TRAJECTORY_EDITION_FAILURE;
+            }
 			noInterrupts();
 			currentTrajectory.push_back(trajectoryPoint);
-			interrupts();
+            targetPointOutdated = true;
 			if (trajectoryPoint.isEndOfTrajectory())
 			{
 				trajectoryComplete = true;
 			}
+            if (streaming && travellingToDestination)
+            {
+                updateDistanceToTravel();
+            }
+			interrupts();
             Position p = trajectoryPoint.getPosition();
             Server.printf(AIM_TRAJECTORY, "%u_%g_%g", millis(), p.x, p.y);
             return TRAJECTORY_EDITION_SUCCESS;
@@ -231,6 +388,11 @@ private:
 
 	uint8_t updateTrajectory(size_t index, TrajectoryPoint trajectoryPoint)
 	{
+        if (index < trajectoryOffset)
+        {
+            return TRAJECTORY_EDITION_FAILURE;
+        }
+        index -= trajectoryOffset;
 		if (index < currentTrajectory.size() && index >= trajectoryIndex)
 		{
 			if (index == trajectoryIndex && travellingToDestination)
@@ -245,6 +407,7 @@ private:
                     trajectoryComplete = false;
                 }
 				currentTrajectory.at(index) = trajectoryPoint;
+                targetPointOutdated = true;
                 if (trajectoryPoint.isEndOfTrajectory())
                 {
                     trajectoryComplete = true;
@@ -264,8 +427,61 @@ private:
 		}
 	}
 
+    /*
+        Remplacement de la fin de la trajectoire pendant le mouvement : les
+        nouveaux points sont accumuls dans un tampon, puis substitus en une
+        seule fois (commitSplice) aux points situs  partir de 'index'.
+        L'interruption d'asservissement ne voit jamais une trajectoire  moiti modifie.
+    */
+    void prepareSplice(size_t index)
+    {
+        spliceBuffer.clear();
+        spliceIndex = index;
+        spliceComplete = false;
+    }
+
+    uint8_t appendToSplice(TrajectoryPoint const & trajectoryPoint)
+    {
+        if (spliceComplete)
+        {
+            return TRAJECTORY_EDITION_FAILURE;
+        }
+        spliceBuffer.push_back(trajectoryPoint);
+        spliceComplete = trajectoryPoint.isEndOfTrajectory();
+        return TRAJECTORY_EDITION_SUCCESS;
+    }
+
+    /* Echoue si le robot a dj atteint le point 'index' */
+    uint8_t commitSplice()
+    {
+        uint8_t ret = TRAJECTORY_EDITION_FAILURE;
+        noInterrupts();
+        size_t index = spliceIndex - trajectoryOffset;
+        if (spliceBuffer.size() > 0 && spliceIndex >= trajectoryOffset && index <= currentTrajectory.size() &&
+            (index > trajectoryIndex || (index == trajectoryIndex && !travellingToDestination)))
+        {
+            currentTrajectory.erase(currentTrajectory.begin() + index, currentTrajectory.end());
+            currentTrajectory.insert(currentTrajectory.end(), spliceBuffer.begin(), spliceBuffer.end());
+            trajectoryComplete = spliceComplete;
+            targetPointOutdated = true;
+            if (travellingToDestination)
+            {
+                updateDistanceToTravel();
+            }
+            ret = TRAJECTORY_EDITION_SUCCESS;
+        }
+        interrupts();
+        spliceBuffer.clear();
+        return ret;
+    }
+
     uint8_t deleteTrajectoryPoints(size_t index)
     {
+        if (index < trajectoryOffset)
+        {
+            return TRAJECTORY_EDITION_FAILURE;
+        }
+        index -= trajectoryOffset;
         if (index < currentTrajectory.size() && index >= trajectoryIndex)
         {
             if (index == trajectoryIndex && travellingToDestination)
@@ -277,6 +493,7 @@ private:
                 noInterrupts();
                 trajectoryComplete = false;
                 currentTrajectory.erase(currentTrajectory.begin() + index, currentTrajectory.end());
+                targetPointOutdated = true;
                 interrupts();
                 return TRAJECTORY_EDITION_SUCCESS;
             }
@@ -296,6 +513,19 @@ private:
 		return p;
 	}
 
+    /* Position du robot  l'instant donn (s), interpole  partir de l'historique */
+    Position getPositionAt(uint32_t timestamp) const
+    {
+        Position p;
+        noInterrupts();
+        if (!positionHistory.getPositionAt(timestamp, p))
+        {
+            p = position;
+        }
+        interrupts();
+        return p;
+    }
+
 	void setPosition(Position p)
 	{
 		noInterrupts();
@@ -312,14 +542,79 @@ private:
 		return ms;
 	}
 
+    /* Indice du point courant depuis le dbut de la trajectoire (les points librs en mode streaming sont compts) */
     size_t getTrajectoryIndex() const
     {
         noInterrupts();
-        size_t ret = trajectoryIndex;
+        size_t ret = trajectoryIndex + trajectoryOffset;
         interrupts();
         return ret;
     }
 
+    /*
+        Mode streaming,  appeler dans la boucle principale durant le suivi de trajectoire :
+        libre les points parcourus et demande les suivants (canal TRAJECTORY_REQUEST)
+        quand ceux qui restent ne couvrent plus la distance de freinage.
+    */
+    void updateStreaming()
+    {
+        noInterrupts();
+        if (!streaming)
+        {
+            interrupts();
+            return;
+        }
+        if (trajectoryIndex >= STREAM_COMPACT_THRESHOLD)
+        {
+            currentTrajectory.erase(currentTrajectory.begin(), currentTrajectory.begin() + trajectoryIndex);
+            trajectoryOffset += trajectoryIndex;
+            trajectoryIndex = 0;
+            targetPointOutdated = true;
+        }
+        size_t remainingPoints = currentTrajectory.size() - trajectoryIndex;
+        size_t nextIndex = currentTrajectory.size() + trajectoryOffset;
+        bool complete = trajectoryComplete;
+        float speed = trajectoryFollower.getCurrentMovingSpeed();
+        interrupts();
+
+        if (complete || remainingPoints >= STREAM_WINDOW_SIZE || millis() - lastStreamRequest < STREAM_REQUEST_PERIOD)
+        {
+            return;
+        }
+        float brakingDistance = speed * speed / (2 * trajectoryFollower.getTunings().maxDeceleration);
+        if (remainingPoints * TRAJECTORY_STEP < brakingDistance + STREAM_REQUEST_MARGIN)
+        {
+            lastStreamRequest = millis();
+            std::vector<uint8_t> request;
+            Serializer::writeUInt(nextIndex, request);
+            Serializer::writeUInt(STREAM_WINDOW_SIZE - remainingPoints, request);
+            Server.sendData(TRAJECTORY_REQUEST, request);
+        }
+    }
+
+    /* Heure (millis) d'arrive prvue au prochain point planifi, ou  la fin de la trajectoire (0 : inconnue) */
+    uint32_t getPredictedArrivalTime() const
+    {
+        noInterrupts();
+        uint32_t ret = predictedArrivalTime;
+        interrupts();
+        return ret;
+    }
+
+    /*
+        Distance restant  parcourir jusqu' la fin de la trajectoire (mm), false
+        si la fin n'a pas encore t reue ou si le robot ne suit pas de trajectoire.
+        Calcule par l'asservissement  chaque priode (updateSchedule).
+    */
+    bool getDistanceToEnd(float & distance) const
+    {
+        noInterrupts();
+        bool known = distanceToEndKnown;
+        distance = distanceToEnd;
+        interrupts();
+        return known;
+    }
+
 	void setMotionControlLevel(uint8_t level)
 	{
 		trajectoryFollower.setMotionControlLevel(level);
@@ -357,6 +652,11 @@ private:
         interrupts();
     }
 
+    void setSpeedScale(float scale)
+    {
+        trajectoryFollower.setSpeedScale(scale);
+    }
+
     void setDistanceToDrive(float distance)
     {
         noInterrupts();
@@ -445,9 +745,32 @@ private:
 	volatile MoveStatus moveStatus;
 	volatile bool travellingToDestination;  // Indique si le robot est en train de parcourir la trajectoire courante
 	volatile size_t trajectoryIndex;  // Point courant de la trajectoire courante
+    PositionHistory positionHistory;  // Positions rcentes, pour dater les mesures des capteurs
 
 	std::vector<TrajectoryPoint> currentTrajectory;
 	bool trajectoryComplete;
+
+    /* Nouvelle fin de trajectoire en cours de construction (boucle principale uniquement) */
+    std::vector<TrajectoryPoint> spliceBuffer;
+    size_t spliceIndex;     // Indice du premier point remplac
+    bool spliceComplete;    // Le tampon contient le point de fin de trajectoire
+
+    /* Mode streaming */
+    volatile bool streaming;
+    volatile size_t trajectoryOffset;   // Nombre de points librs depuis le dbut de la trajectoire
+    size_t holdReceivedPoints;          // Nombre de points reus lors du dernier calcul de la distance  parcourir (hors arrt)
+    uint32_t lastStreamRequest;         // ms
+
+    /* Suivi de l'horaire de la trajectoire */
+    uint32_t trajectoryStartTime;           // millis() au dmarrage du suivi de la trajectoire
+    size_t targetPointIndex;                // Prochain point planifi, ou fin de la trajectoire
+    bool targetPointFound;
+    volatile bool targetPointOutdated;      // La trajectoire a chang, le point vis doit tre recherch
+    volatile uint32_t predictedArrivalTime; // ms
+    size_t endPointIndex;                   // Point de fin de la trajectoire
+    bool endPointFound;
+    volatile float distanceToEnd;           // mm
+    volatile bool distanceToEndKnown;
 };
 
 
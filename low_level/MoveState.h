@@ -17,7 +17,10 @@ enum MStatus
 	FAR_AWAY = 8,
 
 	// Trajectoire errone
-	EMPTY_TRAJ = 16
+	EMPTY_TRAJ = 16,
+
+	// Ordre de suivi de trajectoire refus (mouvement dj command par un autre ordre)
+	MOVE_REFUSED = 32
 };
 
 
@@ -17,6 +17,8 @@
 #include "Singleton.h"
 #include "SmokeMgr.h"
 #include "SensorsMgr.h"
+#include "BootMgr.h"
+#include "TrajectoryLibrary.h"
 
 
 class OrderImmediate
@@ -242,6 +244,50 @@ public:
 };
 
 
+/* Comme AppendToTraj, chaque point ayant en plus une heure d'arrivée (ms depuis le début du suivi, 0 : pas d'horaire) */
+class AppendToTimedTraj : public OrderImmediate, public Singleton<AppendToTimedTraj>
+{
+public:
+    AppendToTimedTraj() {}
+    virtual void execute(std::vector<uint8_t> & io)
+    {
+        uint8_t ret = TRAJECTORY_EDITION_FAILURE;
+        if (io.size() % 26 == 0)
+        {
+            for (size_t i = 0; i < io.size(); i += 26)
+            {
+                size_t index = i;
+                int32_t x = Serializer::readInt(io, index);
+                int32_t y = Serializer::readInt(io, index);
+                float angle = Serializer::readFloat(io, index);
+                float curvature = Serializer::readFloat(io, index);
+                float speed = Serializer::readFloat(io, index);
+                bool stopPoint = Serializer::readBool(io, index);
+                bool endOfTraj = Serializer::readBool(io, index);
+                uint32_t arrivalTime = Serializer::readUInt(io, index);
+                Position p((float)x, (float)y, angle);
+                TrajectoryPoint trajPoint(p, curvature, speed, stopPoint, endOfTraj, arrivalTime);
+                Server.printf(SPY_ORDER, "AppendToTimedTraj (t=%u): ", arrivalTime);
+                Server.println(SPY_ORDER, trajPoint);
+                ret = motionControlSystem.appendToTrajectory(trajPoint);
+                if (ret != TRAJECTORY_EDITION_SUCCESS)
+                {
+                    motionControlSystem.stop_and_clear_trajectory();
+                    Server.printf_err("AppendToTimedTraj: TRAJECTORY_EDITION_FAILURE");
+                    break;
+                }
+            }
+        }
+        else
+        {
+            Server.printf_err("AppendToTimedTraj: wrong number of arguments\n");
+        }
+        io.clear();
+        Serializer::writeEnum(ret, io);
+    }
+};
+
+
 class EditTraj : public OrderImmediate, public Singleton<EditTraj>
 {
 public:
@@ -288,6 +334,164 @@ public:
 };
 
 
+/*
+    Préparation du remplacement de la fin de la trajectoire à partir de l'indice donné.
+    Les points suivant l'indice sont optionnels, d'autres peuvent être ajoutés avec AppendToSplice.
+*/
+class PrepareSplice : public OrderImmediate, public Singleton<PrepareSplice>
+{
+public:
+    PrepareSplice() {}
+    virtual void execute(std::vector<uint8_t> & io)
+    {
+        uint8_t ret = TRAJECTORY_EDITION_FAILURE;
+        if (io.size() >= 4 && (io.size() - 4) % 22 == 0)
+        {
+            size_t index = 0;
+            size_t trajIndex = Serializer::readUInt(io, index);
+            Server.printf(SPY_ORDER, "PrepareSplice at %u\n", trajIndex);
+            motionControlSystem.prepareSplice(trajIndex);
+            ret = appendPoints(io, 4);
+        }
+        else
+        {
+            Server.printf_err("PrepareSplice: wrong number of arguments\n");
+        }
+        io.clear();
+        Serializer::writeEnum(ret, io);
+    }
+
+    /* Ajout au tampon des points (format de AppendToTraj) situés après 'start' */
+    static uint8_t appendPoints(std::vector<uint8_t> const & io, size_t start)
+    {
+        MotionControlSystem & motionControlSystem = MotionControlSystem::Instance();
+        for (size_t i = start; i < io.size(); i += 22)
+        {
+            size_t index = i;
+            int32_t x = Serializer::readInt(io, index);
+            int32_t y = Serializer::readInt(io, index);
+            float angle = Serializer::readFloat(io, index);
+            float curvature = Serializer::readFloat(io, index);
+            float speed = Serializer::readFloat(io, index);
+            bool stopPoint = Serializer::readBool(io, index);
+            bool endOfTraj = Serializer::readBool(io, index);
+            Position p((float)x, (float)y, angle);
+            TrajectoryPoint trajPoint(p, curvature, speed, stopPoint, endOfTraj);
+            if (motionControlSystem.appendToSplice(trajPoint) != TRAJECTORY_EDITION_SUCCESS)
+            {
+                Server.printf_err("Splice: point after the end of trajectory\n");
+                return TRAJECTORY_EDITION_FAILURE;
+            }
+        }
+        return TRAJECTORY_EDITION_SUCCESS;
+    }
+};
+
+
+class AppendToSplice : public OrderImmediate, public Singleton<AppendToSplice>
+{
+public:
+    AppendToSplice() {}
+    virtual void execute(std::vector<uint8_t> & io)
+    {
+        uint8_t ret = TRAJECTORY_EDITION_FAILURE;
+        if (io.size() > 0 && io.size() % 22 == 0)
+        {
+            Server.printf(SPY_ORDER, "AppendToSplice (%u points)\n", io.size() / 22);
+            ret = PrepareSplice::appendPoints(io, 0);
+        }
+        else
+        {
+            Server.printf_err("AppendToSplice: wrong number of arguments\n");
+        }
+        io.clear();
+        Serializer::writeEnum(ret, io);
+    }
+};
+
+
+/* Substitution atomique des points préparés à la fin de la trajectoire. Echoue si le robot a atteint l'indice de raccordement. */
+class CommitSplice : public OrderImmediate, public Singleton<CommitSplice>
+{
+public:
+    CommitSplice() {}
+    virtual void execute(std::vector<uint8_t> & io)
+    {
+        uint8_t ret = TRAJECTORY_EDITION_FAILURE;
+        if (io.size() == 0)
+        {
+            ret = motionControlSystem.commitSplice();
+            Server.printf(SPY_ORDER, "CommitSplice: %u\n", ret);
+        }
+        else
+        {
+            Server.printf_err("CommitSplice: wrong number of arguments\n");
+        }
+        io.clear();
+        Serializer::writeEnum(ret, io);
+    }
+};
+
+
+/*
+    Enregistrement sur le robot d'une trajectoire (éventuellement en plusieurs trames), pour la relancer par son ID ou son hash.
+    La dernière trame écrit la trajectoire sur la carte SD et bloque la boucle principale quelques dizaines d'ms : à envoyer avant le match.
+*/
+class StoreTrajectory : public OrderImmediate, public Singleton<StoreTrajectory>
+{
+public:
+    StoreTrajectory() {}
+    virtual void execute(std::vector<uint8_t> & io)
+    {
+        uint8_t ret = TRAJ_LIB_INVALID;
+        uint32_t hash = 0;
+        if (io.size() >= 2)
+        {
+            size_t index = 0;
+            uint8_t id = Serializer::readEnum(io, index);
+            bool reset = Serializer::readBool(io, index);
+            ret = TrajectoryLibrary::Instance().store(id, reset, io, index, hash);
+            Server.printf(SPY_ORDER, "StoreTrajectory %u: %u (hash %u)", id, ret, hash);
+        }
+        else
+        {
+            Server.printf_err("StoreTrajectory: wrong number of arguments\n");
+        }
+        io.clear();
+        Serializer::writeEnum(ret, io);
+        Serializer::writeInt((int32_t)hash, io);   // Le hash utilise les 32 bits
+    }
+};
+
+
+/* Ajout d'une trajectoire enregistrée à la trajectoire courante (remplace AppendToTraj) */
+class LoadStoredTrajectory : public OrderImmediate, public Singleton<LoadStoredTrajectory>
+{
+public:
+    LoadStoredTrajectory() {}
+    virtual void execute(std::vector<uint8_t> & io)
+    {
+        uint8_t ret = TRAJ_LIB_INVALID;
+        uint32_t hash = 0;
+        if (io.size() == 5)
+        {
+            size_t index = 0;
+            uint8_t id = Serializer::readEnum(io, index);
+            uint32_t expectedHash = (uint32_t)Serializer::readInt(io, index);
+            ret = TrajectoryLibrary::Instance().load(id, expectedHash, hash);
+            Server.printf(SPY_ORDER, "LoadStoredTrajectory %u: %u (hash %u)", id, ret, hash);
+        }
+        else
+        {
+            Server.printf_err("LoadStoredTrajectory: wrong number of arguments\n");
+        }
+        io.clear();
+        Serializer::writeEnum(ret, io);
+        Serializer::writeInt((int32_t)hash, io);   // Le hash utilise les 32 bits
+    }
+};
+
+
 class DeleteTrajPts : public OrderImmediate, public Singleton<DeleteTrajPts>
 {
 public:
@@ -421,6 +625,42 @@ public:
     }
 };
 
+class ActuatorTrackPuck : public OrderImmediate, public Singleton<ActuatorTrackPuck>
+{
+public:
+    ActuatorTrackPuck() {}
+    virtual void execute(std::vector<uint8_t> & io)
+    {
+        if (io.size() == 1)
+        {
+            size_t index = 0;
+            bool enable = Serializer::readBool(io, index);
+            io.clear();
+            int ret;
+            if (enable) {
+                Server.printf(SPY_ORDER, "ActuatorTrackPuck start\n");
+                ret = actuatorMgr.startPuckTracking();
+            }
+            else {
+                Server.printf(SPY_ORDER, "ActuatorTrackPuck stop\n");
+                ret = actuatorMgr.stopPuckTracking();
+            }
+            float x, y, fork_y;
+            bool valid = actuatorMgr.getTrackedPuck(x, y, fork_y);
+            Serializer::writeEnum(ret == EXIT_SUCCESS ? 0 : 1, io);
+            Serializer::writeBool(valid, io);
+            Serializer::writeInt((int32_t)x, io);
+            Serializer::writeInt((int32_t)y, io);
+            Serializer::writeFloat(fork_y, io);
+        }
+        else
+        {
+            Server.printf_err("ActuatorTrackPuck: wrong number of arguments\n");
+            io.clear();
+        }
+    }
+};
+
 class EnableParkingBreak : public OrderImmediate, public Singleton<EnableParkingBreak>
 {
 public:
@@ -648,6 +888,33 @@ public:
 };
 
 
+/*
+    Réduction de la vitesse maximale de tous les points de la trajectoire (facteur entre 0 et 1).
+    0 met le suivi en pause sans erreur. Le facteur reste appliqué aux mouvements suivants.
+*/
+class SetSpeedScale : public OrderImmediate, public Singleton<SetSpeedScale>
+{
+public:
+    SetSpeedScale() {}
+    virtual void execute(std::vector<uint8_t> & io)
+    {
+        if (io.size() == 4)
+        {
+            size_t index = 0;
+            float scale = Serializer::readFloat(io, index);
+            motionControlSystem.setSpeedScale(scale);
+            Server.printf(SPY_ORDER, "SetSpeedScale: %g\n", scale);
+            io.clear();
+        }
+        else
+        {
+            Server.printf_err("SetSpeedScale: wrong number of arguments\n");
+            io.clear();
+        }
+    }
+};
+
+
 class SetAimDistance : public OrderImmediate, public Singleton<SetAimDistance>
 {
 public:
@@ -925,4 +1192,23 @@ public:
 };
 
 
+class GetBootTimeline : public OrderImmediate, public Singleton<GetBootTimeline>
+{
+public:
+    GetBootTimeline() {}
+    virtual void execute(std::vector<uint8_t> & io)
+    {
+        if (io.size() == 0)
+        {
+            BootMgr::Instance().appendTimelineToVect(io);
+        }
+        else
+        {
+            Server.printf_err("GetBootTimeline: wrong number of arguments\n");
+            io.clear();
+        }
+    }
+};
+
+
 #endif
@@ -11,18 +11,51 @@
 #include "SensorsMgr.h"
 #include "Singleton.h"
 
+#define MATCH_DURATION  100000  // ms
+#define JUMPER_POLL_PERIOD  10  // ms, période de lecture du jumper (l'anti-rebond est de 100 ms)
+
+/* Un ordre préempte les ordres de priorité inférieure qui utilisent une même ressource */
+enum OrderPriority
+{
+    ORDER_PRIORITY_LOW = 0,
+    ORDER_PRIORITY_NORMAL = 1,
+    ORDER_PRIORITY_HIGH = 2
+};
+
+/* Ressources utilisées par un ordre long (masque de bits) */
+enum OrderResource
+{
+    ORDER_RESOURCE_NONE     = 0x00,
+    ORDER_RESOURCE_MOTION   = 0x01,
+    ORDER_RESOURCE_ACTUATOR = 0x02
+};
+
+/*
+    Ressources qu'un ordre ne peut pas prendre à un ordre de priorité égale ou
+    supérieure (le nouvel ordre est refusé). Les commandes d'actionneur sont
+    arbitrées par l'ActuatorMgr (préemption, file de points de passage).
+*/
+#define ORDER_EXCLUSIVE_RESOURCES   ORDER_RESOURCE_MOTION
+
+
 class OrderLong
 {
 public:
     OrderLong() :
         motionControlSystem(MotionControlSystem::Instance()),
         actuatorMgr(ActuatorMgr::Instance()),
-        finished(true)
+        finished(true),
+        cancelled(false),
+        inUse(false),
+        sleeping(false),
+        wakeTime(0)
     {}
 
     void launch(const std::vector<uint8_t> & arg)
     {
         finished = false;
+        cancelled = false;
+        sleeping = false;
         _launch(arg);
     }
 
@@ -41,17 +74,128 @@ public:
     /* Méthode à appeler une fois que l'odre est terminé. L'argument est un output, il correspond au contenu du EXECUTION_END. */
     virtual void terminate(std::vector<uint8_t> &) = 0;
 
+    /*
+        Contenu du EXECUTION_END envoyé quand l'ordre n'a pas pu être lancé (pile
+        d'exécution ou instances pleines, ressource prise) : même format que
+        terminate(), avec un code d'échec. A masquer dans les ordres qui ont un
+        code de retour, les autres répondent sans données.
+    */
+    static void refuse(std::vector<uint8_t> &) {}
+
+    /* Annulation (explicite ou par préemption) : l'ordre se termine immédiatement, terminate() est appelée ensuite */
+    void cancel()
+    {
+        if (!finished)
+        {
+            cancelled = true;
+            finished = true;
+            onCancel();
+        }
+    }
+
+    virtual OrderPriority getPriority() const { return ORDER_PRIORITY_NORMAL; }
+    virtual uint8_t getResources() const { return ORDER_RESOURCE_NONE; }
+
+    /*
+        Un ordre endormi n'a rien à faire : onExecute() n'est pas appelée.
+        Les attentes de fin de commande d'actionneur ne dorment pas : leur test
+        (commandCompleted) est une simple comparaison, et la fin peut survenir
+        à chaque itération de l'ActuatorMgr.
+    */
+    bool isSleeping() const
+    {
+        return sleeping && (int32_t)(millis() - wakeTime) < 0;
+    }
+
+    /* Gestion des instances par OrderLongPool */
+    bool isInUse() const { return inUse; }
+    void reserve() { inUse = true; }
+    void release() { inUse = false; }
+
 protected:
+    /* Action à effectuer lors d'une annulation (arrêt du mouvement en cours, etc.) */
+    virtual void onCancel() {}
+
+    void sleepFor(uint32_t duration)
+    {
+        sleeping = true;
+        wakeTime = millis() + duration;
+    }
+
+    /* Arrêt de la commande d'actionneur lancée par l'ordre, si elle n'a pas déjà été remplacée */
+    void stopActuatorCommand(uint32_t command_id)
+    {
+        if (!actuatorMgr.commandPreempted(command_id)) {
+            actuatorMgr.stop();
+        }
+    }
+
+    /* Code d'erreur de la commande d'actionneur lancée par l'ordre (elle a pu être préemptée depuis) */
+    ActuatorErrorCode actuatorErrorCode(uint32_t command_id) const
+    {
+        if (actuatorMgr.commandPreempted(command_id)) {
+            return ACT_PREEMPTED;
+        }
+        return actuatorMgr.getErrorCode();
+    }
+
     MotionControlSystem & motionControlSystem;
     ActuatorMgr & actuatorMgr;
     bool finished;
+    bool cancelled;
+
+private:
+    bool inUse;
+    bool sleeping;
+    uint32_t wakeTime;  // ms
+};
+
+
+/*
+    Chaque ordre long dispose d'un nombre fixe d'instances, ce qui permet
+    d'exécuter plusieurs fois le même ordre en parallèle (chacun avec son état).
+*/
+class OrderLongFactory
+{
+public:
+    /* Renvoie une instance libre, ou NULL si elles sont toutes utilisées */
+    virtual OrderLong* acquire() = 0;
+
+    /* Réponse de l'ordre quand il ne peut pas être lancé, voir OrderLong::refuse */
+    virtual void refuse(std::vector<uint8_t> & output) = 0;
+};
+
+template<class T, size_t N>
+class OrderLongPool : public OrderLongFactory, public Singleton<OrderLongPool<T, N> >
+{
+public:
+    OrderLong* acquire()
+    {
+        for (size_t i = 0; i < N; i++)
+        {
+            if (!instances[i].isInUse())
+            {
+                instances[i].reserve();
+                return &instances[i];
+            }
+        }
+        return (OrderLong*)NULL;
+    }
+
+    void refuse(std::vector<uint8_t> & output)
+    {
+        T::refuse(output);
+    }
+
+private:
+    T instances[N];
 };
 
 
 // ### Définition des ordres longs ###
 
 /*
-class Rien : public OrderLong, public Singleton<Rien>
+class Rien : public OrderLong
 {
 public:
     Rien() {}
@@ -78,7 +222,7 @@ public:
 //*/
 
 
-class FollowTrajectory : public OrderLong, public Singleton<FollowTrajectory>
+class FollowTrajectory : public OrderLong
 {
 public:
     FollowTrajectory() { status = MOVE_OK; }
@@ -89,6 +233,13 @@ public:
             Server.printf(SPY_ORDER, "FollowTrajectory\n");
             motionControlSystem.followTrajectory();
         }
+        else if (input.size() == 1)
+        {
+            size_t index = 0;
+            bool streaming = Serializer::readEnum(input, index) != 0;
+            Server.printf(SPY_ORDER, "FollowTrajectory (streaming: %u)\n", streaming);
+            motionControlSystem.followTrajectory(streaming);
+        }
         else
         {
             Server.printf_err("FollowTrajectory: wrong number of arguments\n");
@@ -96,6 +247,7 @@ public:
     }
     void onExecute()
     {
+        motionControlSystem.updateStreaming();
         if (!motionControlSystem.isMovingToDestination())
         {
             status = motionControlSystem.getMoveStatus();
@@ -107,13 +259,25 @@ public:
         Server.printf(SPY_ORDER, "End FollowTrajectory with status %u\n", status);
         Serializer::writeInt((int32_t)status, output);
     }
+    static void refuse(std::vector<uint8_t> & output)
+    {
+        Serializer::writeInt((int32_t)MOVE_REFUSED, output);
+    }
+    uint8_t getResources() const { return ORDER_RESOURCE_MOTION; }
+
+protected:
+    void onCancel()
+    {
+        motionControlSystem.stop_and_clear_trajectory();
+        status = motionControlSystem.getMoveStatus();
+    }
 
 private:
     MoveStatus status;
 };
 
 
-class Stop : public OrderLong, public Singleton<Stop>
+class Stop : public OrderLong
 {
 public:
     Stop() {}
@@ -137,10 +301,12 @@ public:
         }
     }
     void terminate(std::vector<uint8_t> & output) {}
+    OrderPriority getPriority() const { return ORDER_PRIORITY_HIGH; }
+    uint8_t getResources() const { return ORDER_RESOURCE_MOTION; }
 };
 
 
-class WaitForJumper : public OrderLong, public Singleton<WaitForJumper>
+class WaitForJumper : public OrderLong
 {
 public:
     WaitForJumper()
@@ -155,6 +321,7 @@ public:
     }
     void onExecute()
     {
+        sleepFor(JUMPER_POLL_PERIOD);
         uint8_t jumperDetected = digitalRead(PIN_GET_JUMPER);
         switch (state)
         {
@@ -201,7 +368,7 @@ private:
 };
 
 
-class StartChrono : public OrderLong, public Singleton<StartChrono>
+class StartChrono : public OrderLong
 {
 public:
     StartChrono() { chrono = 0; }
@@ -209,16 +376,20 @@ public:
     {
         Server.printf(SPY_ORDER, "StartChrono");
         chrono = millis();
+        sleepFor(MATCH_DURATION);
     }
     void onExecute()
     {
-        if (millis() - chrono > 100000)
+        if (millis() - chrono > MATCH_DURATION)
         {
             finished = true;
         }
     }
     void terminate(std::vector<uint8_t> & output)
     {
+        if (cancelled) {
+            return;
+        }
         motionControlSystem.stop_and_clear_trajectory();
         actuatorMgr.stop();
         actuatorMgr.disableAll();
@@ -233,7 +404,7 @@ private:
     Contrôle de l'actionneur
 */
 
-class ActuatorGoHome : public OrderLong, public Singleton<ActuatorGoHome>
+class ActuatorGoHome : public OrderLong
 {
 public:
     ActuatorGoHome() {}
@@ -250,6 +421,7 @@ public:
             else
             {
                 ret_code = ACT_OK;
+                command_id = actuatorMgr.getCommandId();
             }
         }
         else
@@ -259,22 +431,35 @@ public:
     }
     void onExecute()
     {
-        if (actuatorMgr.commandCompleted())
+        if (actuatorMgr.commandCompleted(command_id))
         {
             finished = true;
         }
     }
     void terminate(std::vector<uint8_t> & output)
     {
-        ret_code |= actuatorMgr.getErrorCode();
+        ret_code |= actuatorErrorCode(command_id);
         Serializer::writeInt(ret_code, output);
     }
+    static void refuse(std::vector<uint8_t> & output)
+    {
+        Serializer::writeInt(ACT_ALREADY_MOVING, output);
+    }
+
+    uint8_t getResources() const { return ORDER_RESOURCE_ACTUATOR; }
+
+protected:
+    void onCancel()
+    {
+        stopActuatorCommand(command_id);
+    }
 
 private:
     ActuatorErrorCode ret_code;
+    uint32_t command_id;
 };
 
-class ActuatorGoTo : public OrderLong, public Singleton<ActuatorGoTo>
+class ActuatorGoTo : public OrderLong
 {
 public:
     ActuatorGoTo() {}
@@ -297,6 +482,7 @@ public:
             else
             {
                 ret_code = ACT_OK;
+                command_id = actuatorMgr.getCommandId();
             }
         }
         else
@@ -306,22 +492,35 @@ public:
     }
     void onExecute()
     {
-        if (actuatorMgr.commandCompleted())
+        if (actuatorMgr.commandCompleted(command_id))
         {
             finished = true;
         }
     }
     void terminate(std::vector<uint8_t> & output)
     {
-        ret_code |= actuatorMgr.getErrorCode();
+        ret_code |= actuatorErrorCode(command_id);
         Serializer::writeInt(ret_code, output);
     }
+    static void refuse(std::vector<uint8_t> & output)
+    {
+        Serializer::writeInt(ACT_ALREADY_MOVING, output);
+    }
+
+    uint8_t getResources() const { return ORDER_RESOURCE_ACTUATOR; }
+
+protected:
+    void onCancel()
+    {
+        stopActuatorCommand(command_id);
+    }
 
 private:
     ActuatorErrorCode ret_code;
+    uint32_t command_id;
 };
 
-class ActuatorFindPuck : public OrderLong, public Singleton<ActuatorFindPuck>
+class ActuatorFindPuck : public OrderLong
 {
 public:
     ActuatorFindPuck() {}
@@ -340,6 +539,7 @@ public:
             else
             {
                 ret_code = ACT_OK;
+                command_id = actuatorMgr.getCommandId();
             }
         }
         else
@@ -349,24 +549,48 @@ public:
     }
     void onExecute()
     {
-        if (actuatorMgr.commandCompleted())
+        if (actuatorMgr.commandCompleted(command_id))
         {
             finished = true;
         }
     }
     void terminate(std::vector<uint8_t> & output)
     {
-        ret_code |= actuatorMgr.getErrorCode();
+        ret_code |= actuatorErrorCode(command_id);
         Serializer::writeFloat(actuatorMgr.getLastScanResultY(), output);
         Serializer::writeInt(actuatorMgr.getLastScanResultD(), output);
         Serializer::writeInt(ret_code, output);
+        actuatorMgr.appendScanCandidatesToVect(output);
+    }
+    static void refuse(std::vector<uint8_t> & output)
+    {
+        Serializer::writeFloat(0, output);
+        Serializer::writeInt(0, output);
+        Serializer::writeInt(ACT_ALREADY_MOVING, output);
+        Serializer::writeEnum(0, output);
+        for (size_t i = 0; i < SCAN_MAX_CANDIDATES; i++)
+        {
+            Serializer::writeFloat(0, output);
+            Serializer::writeInt(0, output);
+            Serializer::writeFloat(0, output);
+            Serializer::writeFloat(0, output);
+        }
+    }
+
+    uint8_t getResources() const { return ORDER_RESOURCE_ACTUATOR; }
+
+protected:
+    void onCancel()
+    {
+        stopActuatorCommand(command_id);
     }
 
 private:
     ActuatorErrorCode ret_code;
+    uint32_t command_id;
 };
 
-class ActuatorGoToWithSpeed : public OrderLong, public Singleton<ActuatorGoToWithSpeed>
+class ActuatorGoToWithSpeed : public OrderLong
 {
 public:
     ActuatorGoToWithSpeed() {}
@@ -392,6 +616,7 @@ public:
             else
             {
                 ret_code = ACT_OK;
+                command_id = actuatorMgr.getCommandId();
             }
         }
         else
@@ -401,19 +626,110 @@ public:
     }
     void onExecute()
     {
-        if (actuatorMgr.commandCompleted())
+        if (actuatorMgr.commandCompleted(command_id))
         {
             finished = true;
         }
     }
     void terminate(std::vector<uint8_t>& output)
     {
-        ret_code |= actuatorMgr.getErrorCode();
+        ret_code |= actuatorErrorCode(command_id);
         Serializer::writeInt(ret_code, output);
     }
+    static void refuse(std::vector<uint8_t>& output)
+    {
+        Serializer::writeInt(ACT_ALREADY_MOVING, output);
+    }
+
+    uint8_t getResources() const { return ORDER_RESOURCE_ACTUATOR; }
+
+protected:
+    void onCancel()
+    {
+        stopActuatorCommand(command_id);
+    }
+
+private:
+    ActuatorErrorCode ret_code;
+    uint32_t command_id;
+};
+
+/*
+    Séquence de points de passage, chacun avec ses vitesses.
+    Entrée : mode (0 : ajout à la suite, 1 : préemption), puis pour chaque point
+    y, z, theta (float) et vitesses y, z, theta (int).
+    L'ordre se termine quand la file est vide, ou s'il est préempté.
+*/
+class ActuatorGoToWaypoints : public OrderLong
+{
+public:
+    ActuatorGoToWaypoints() {}
+    void _launch(const std::vector<uint8_t>& input)
+    {
+        size_t count = (input.size() - 1) / 24;
+        if (input.size() > 1 && (input.size() - 1) % 24 == 0 && count <= ACT_MGR_QUEUE_SIZE)
+        {
+            Server.printf(SPY_ORDER, "ActuatorGoToWaypoints (%u)", count);
+            ActuatorWaypoint waypoints[ACT_MGR_QUEUE_SIZE];
+            size_t index = 0;
+            bool preempt = Serializer::readEnum(input, index) != 0;
+            for (size_t i = 0; i < count; i++)
+            {
+                waypoints[i].position.y = Serializer::readFloat(input, index);
+                waypoints[i].position.z = Serializer::readFloat(input, index);
+                waypoints[i].position.theta = Serializer::readFloat(input, index);
+                waypoints[i].y_speed = Serializer::readInt(input, index);
+                waypoints[i].z_speed = Serializer::readInt(input, index);
+                waypoints[i].theta_speed = Serializer::readInt(input, index);
+            }
+
+            ret_code = actuatorMgr.queueWaypoints(waypoints, count, preempt);
+            if (ret_code != ACT_OK)
+            {
+                finished = true;
+            }
+            else
+            {
+                command_id = actuatorMgr.getCommandId();
+            }
+        }
+        else
+        {
+            Server.printf_err("ActuatorGoToWaypoints: wrong number of arguments\n");
+            finished = true;
+            ret_code = ACT_UNREACHABLE;
+        }
+    }
+    void onExecute()
+    {
+        if (actuatorMgr.commandCompleted(command_id))
+        {
+            finished = true;
+        }
+    }
+    void terminate(std::vector<uint8_t>& output)
+    {
+        if (ret_code == ACT_OK) {
+            ret_code |= actuatorErrorCode(command_id);
+        }
+        Serializer::writeInt(ret_code, output);
+    }
+    static void refuse(std::vector<uint8_t>& output)
+    {
+        Serializer::writeInt(ACT_ALREADY_MOVING, output);
+    }
+
+    uint8_t getResources() const { return ORDER_RESOURCE_ACTUATOR; }
+
+protected:
+    void onCancel()
+    {
+        stopActuatorCommand(command_id);
+    }
 
 private:
     ActuatorErrorCode ret_code;
+    uint32_t command_id;
 };
 
 #endif
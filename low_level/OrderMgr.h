@@ -4,6 +4,8 @@
 #include "CommunicationServer.h"
 #include "OrderImmediate.h"
 #include "OrderLong.h"
+#include "OrderSequence.h"
+#include "TrajectoryActions.h"
 #include "Command.h"
 
 #define EXEC_STACK_SIZE             16
@@ -14,14 +16,24 @@
 #define NB_IMMEDIATE_ORDER (NB_ORDER - IMMEDIATE_ORDER_START_ID)
 
 
-class OrderMgr
+/* Annulation d'un ordre long (défini après l'OrderMgr, sur lequel il agit) */
+class CancelLongOrder : public OrderImmediate, public Singleton<CancelLongOrder>
+{
+public:
+    CancelLongOrder() {}
+    virtual void execute(std::vector<uint8_t> & io);
+};
+
+
+class OrderMgr : public OrderProvider, public Singleton<OrderMgr>
 {
 public:
     OrderMgr()
     {
+        nbRunningOrders = 0;
         for (size_t i = 0; i < NB_LONG_ORDER; i++)
         {
-            longOrderList[i] = (OrderLong*)NULL;
+            longOrderList[i] = (OrderLongFactory*)NULL;
         }
         for (size_t i = 0; i < NB_IMMEDIATE_ORDER; i++)
         {
@@ -69,16 +81,33 @@ public:
         immediateOrderList[0x1F] = &SetMaxCurvature::Instance();
         immediateOrderList[0x20] = &SetSmoke::Instance();
         immediateOrderList[0x21] = &GetSensorsLastUpdate::Instance();
+        immediateOrderList[0x22] = &GetBootTimeline::Instance();
+        immediateOrderList[0x23] = &ActuatorTrackPuck::Instance();
+        immediateOrderList[0x24] = &CancelLongOrder::Instance();
+        immediateOrderList[0x25] = &AddTrajectoryAction::Instance();
+        immediateOrderList[0x26] = &ClearTrajectoryActions::Instance();
+        immediateOrderList[0x27] = &AppendToTimedTraj::Instance();
+        immediateOrderList[0x28] = &SetSpeedScale::Instance();
+        immediateOrderList[0x29] = &PrepareSplice::Instance();
+        immediateOrderList[0x2A] = &AppendToSplice::Instance();
+        immediateOrderList[0x2B] = &CommitSplice::Instance();
+        immediateOrderList[0x2C] = &StoreTrajectory::Instance();
+        immediateOrderList[0x2D] = &LoadStoredTrajectory::Instance();
 
-        // Ordres longs
-        longOrderList[0x00] = &FollowTrajectory::Instance();
-        longOrderList[0x01] = &Stop::Instance();
-        longOrderList[0x02] = &WaitForJumper::Instance();
-        longOrderList[0x03] = &StartChrono::Instance();
-        longOrderList[0x04] = &ActuatorGoHome::Instance();
-        longOrderList[0x05] = &ActuatorGoTo::Instance();
-        longOrderList[0x06] = &ActuatorFindPuck::Instance();
-        longOrderList[0x07] = &ActuatorGoToWithSpeed::Instance();
+        // Ordres longs (nombre d'instances pouvant s'exécuter simultanément)
+        longOrderList[0x00] = &OrderLongPool<FollowTrajectory, 1>::Instance();
+        longOrderList[0x01] = &OrderLongPool<Stop, 1>::Instance();
+        longOrderList[0x02] = &OrderLongPool<WaitForJumper, 1>::Instance();
+        longOrderList[0x03] = &OrderLongPool<StartChrono, 1>::Instance();
+        longOrderList[0x04] = &OrderLongPool<ActuatorGoHome, 1>::Instance();
+        longOrderList[0x05] = &OrderLongPool<ActuatorGoTo, 2>::Instance();
+        longOrderList[0x06] = &OrderLongPool<ActuatorFindPuck, 1>::Instance();
+        longOrderList[0x07] = &OrderLongPool<ActuatorGoToWithSpeed, 2>::Instance();
+        longOrderList[0x08] = &OrderLongPool<ActuatorGoToWaypoints, 4>::Instance();
+        longOrderList[0x09] = &OrderLongPool<RunSequence, 1>::Instance();
+
+        RunSequence::setOrderProvider(this);
+        TrajectoryActionMgr::Instance().setOrderProvider(this);
     }
 
     void execute()
@@ -90,58 +119,75 @@ public:
             handleNewCommand(command);
         }
         executeStackedOrders();
+        TrajectoryActionMgr::Instance().update();
     }
 
-private:
-    class OrderMemory
+    /*
+        Annulation de toutes les instances en cours de l'ordre long d'ID donné
+        (ID de la trame). Elles répondent immédiatement. Renvoie le nombre
+        d'ordres annulés. Un ordre lancé par une séquence n'est pas concerné
+        (voir RunSequence) : seule la séquence est sur la pile d'exécution.
+    */
+    size_t cancelLongOrder(uint8_t id)
     {
-    public:
-        OrderMemory()
-        {
-            running = false;
-            longOrderIndex = 0;
-            commandId = 0;
-            commandSource = 0;
-        }
-
-        void saveOrder(uint8_t index, Command const & command)
+        size_t count = 0;
+        size_t i = 0;
+        while (i < nbRunningOrders)
         {
-            longOrderIndex = index;
-            commandId = command.getId();
-            commandSource = command.getSource();
-            running = true;
-        }
-
-        void deleteOrder()
-        {
-            running = false;
+            if (runningOrders[i].commandId == id)
+            {
+                runningOrders[i].order->cancel();
+                endOrder(i);
+                count++;
+            }
+            else
+            {
+                i++;
+            }
         }
+        return count;
+    }
 
-        uint8_t getIndex() const
+    /* Une séquence ne peut ni en lancer une autre, ni annuler un ordre (elle-même y comprise) */
+    bool isSequenceable(uint8_t id)
+    {
+        if (id >= IMMEDIATE_ORDER_START_ID)
         {
-            return longOrderIndex;
+            OrderImmediate* order = immediateOrderList[id - IMMEDIATE_ORDER_START_ID];
+            return order != NULL && order != &CancelLongOrder::Instance();
         }
-
-        uint8_t getId() const
+        else if (id >= LONG_ORDER_START_ID)
         {
-            return commandId;
+            OrderLongFactory* factory = longOrderList[id - LONG_ORDER_START_ID];
+            return factory != NULL && factory != &OrderLongPool<RunSequence, 1>::Instance();
         }
+        return false;
+    }
 
-        uint8_t getSource() const
+    OrderLong* acquireLongOrder(uint8_t id)
+    {
+        if (id >= LONG_ORDER_START_ID && id < IMMEDIATE_ORDER_START_ID && longOrderList[id - LONG_ORDER_START_ID] != NULL)
         {
-            return commandSource;
+            return longOrderList[id - LONG_ORDER_START_ID]->acquire();
         }
+        return (OrderLong*)NULL;
+    }
 
-        bool isRunning() const
+    OrderImmediate* getImmediateOrder(uint8_t id)
+    {
+        if (id >= IMMEDIATE_ORDER_START_ID)
         {
-            return running;
+            return immediateOrderList[id - IMMEDIATE_ORDER_START_ID];
         }
+        return (OrderImmediate*)NULL;
+    }
 
-    private:
-        uint8_t longOrderIndex;
+private:
+    struct RunningOrder
+    {
+        OrderLong* order;
         uint8_t commandId;
         uint8_t commandSource;
-        bool running;
     };
 
     void handleNewCommand(Command const & command)
@@ -172,14 +218,7 @@ private:
                 uint8_t index = id - LONG_ORDER_START_ID;
                 if (index < NB_LONG_ORDER && longOrderList[index] != NULL)
                 {
-                    if (addOrderToStack(index, command) == 0)
-                    {
-                        longOrderList[index]->launch(data);
-                    }
-                    else
-                    {
-                        Server.printf_err("Too many long orders already running\n");
-                    }
+                    launchLongOrder(index, command, data);
                 }
                 else
                 {
@@ -199,44 +238,152 @@ private:
         }
     }
 
-    void executeStackedOrders()
+    void launchLongOrder(uint8_t index, Command const & command, std::vector<uint8_t> const & data)
+    {
+        if (nbRunningOrders >= EXEC_STACK_SIZE)
+        {
+            Server.printf_err("Too many long orders already running\n");
+            refuseLongOrder(*longOrderList[index], command);
+            return;
+        }
+        OrderLong* order = longOrderList[index]->acquire();
+        if (order == NULL)
+        {
+            Server.printf_err("No free instance of long order %u\n", index);
+            refuseLongOrder(*longOrderList[index], command);
+            return;
+        }
+        if (isResourceTaken(*order))
+        {
+            Server.printf_err("Long order %u: resource used by an order of same or higher priority\n", index);
+            order->release();
+            refuseLongOrder(*longOrderList[index], command);
+            return;
+        }
+
+        preemptOrders(*order);
+
+        // Les ordres sont rangés par priorité décroissante (ordre d'arrivée à priorité égale)
+        size_t position = nbRunningOrders;
+        while (position > 0 && runningOrders[position - 1].order->getPriority() < order->getPriority())
+        {
+            runningOrders[position] = runningOrders[position - 1];
+            position--;
+        }
+        runningOrders[position].order = order;
+        runningOrders[position].commandId = command.getId();
+        runningOrders[position].commandSource = command.getSource();
+        nbRunningOrders++;
+
+        order->launch(data);
+    }
+
+    /* Réponse immédiate (EXECUTION_END) à un ordre long qui n'a pas pu être lancé */
+    void refuseLongOrder(OrderLongFactory & factory, Command const & command)
+    {
+        std::vector<uint8_t> output_data;
+        factory.refuse(output_data);
+        Command answer(command.getSource(), command.getId(), output_data);
+        Server.sendAnswer(answer);
+    }
+
+    /* Une ressource exclusive demandée par le nouvel ordre est utilisée par un ordre de priorité égale ou supérieure */
+    bool isResourceTaken(OrderLong const & newOrder) const
     {
-        for (size_t i = 0; i < EXEC_STACK_SIZE; i++)
+        for (size_t i = 0; i < nbRunningOrders; i++)
         {
-            if (orderStack[i].isRunning())
+            OrderLong const * order = runningOrders[i].order;
+            if ((order->getResources() & newOrder.getResources() & ORDER_EXCLUSIVE_RESOURCES) &&
+                order->getPriority() >= newOrder.getPriority())
             {
-                uint8_t index = orderStack[i].getIndex();
-                longOrderList[index]->onExecute();
-                if (longOrderList[index]->isFinished())
-                {
-                    std::vector<uint8_t> output_data;
-                    longOrderList[index]->terminate(output_data);
-                    Command answer(orderStack[i].getSource(), orderStack[i].getId(), output_data);
-                    Server.sendAnswer(answer);
-                    orderStack[i].deleteOrder();
-                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /* Annulation des ordres de priorité inférieure utilisant une ressource demandée par le nouvel ordre */
+    void preemptOrders(OrderLong const & newOrder)
+    {
+        size_t i = 0;
+        while (i < nbRunningOrders)
+        {
+            OrderLong* order = runningOrders[i].order;
+            if ((order->getResources() & newOrder.getResources()) &&
+                order->getPriority() < newOrder.getPriority())
+            {
+                order->cancel();
+                endOrder(i);
+            }
+            else
+            {
+                i++;
             }
         }
     }
 
-    int addOrderToStack(uint8_t index, Command const & command)
+    void executeStackedOrders()
     {
-        for (size_t i = 0; i < EXEC_STACK_SIZE; i++)
+        size_t i = 0;
+        while (i < nbRunningOrders)
         {
-            if (!orderStack[i].isRunning())
+            OrderLong* order = runningOrders[i].order;
+            if (!order->isFinished() && !order->isSleeping())
+            {
+                order->onExecute();
+            }
+            if (order->isFinished())
             {
-                orderStack[i].saveOrder(index, command);
-                return 0;
+                endOrder(i);
             }
+            else
+            {
+                i++;
+            }
+        }
+    }
+
+    /* Envoi du EXECUTION_END et libération de l'instance */
+    void endOrder(size_t i)
+    {
+        OrderLong* order = runningOrders[i].order;
+        std::vector<uint8_t> output_data;
+        order->terminate(output_data);
+        Command answer(runningOrders[i].commandSource, runningOrders[i].commandId, output_data);
+        Server.sendAnswer(answer);
+        order->release();
+        for (size_t j = i + 1; j < nbRunningOrders; j++)
+        {
+            runningOrders[j - 1] = runningOrders[j];
         }
-        return -1;
+        nbRunningOrders--;
     }
 
-    OrderMemory orderStack[EXEC_STACK_SIZE];
-    OrderLong* longOrderList[NB_LONG_ORDER];
+    RunningOrder runningOrders[EXEC_STACK_SIZE];
+    size_t nbRunningOrders;
+    OrderLongFactory* longOrderList[NB_LONG_ORDER];
     OrderImmediate* immediateOrderList[NB_IMMEDIATE_ORDER];
 };
 
 
+inline void CancelLongOrder::execute(std::vector<uint8_t> & io)
+{
+    if (io.size() == 4)
+    {
+        size_t index = 0;
+        uint8_t id = Serializer::readInt(io, index);
+        Server.printf(SPY_ORDER, "CancelLongOrder %u", id);
+        size_t count = OrderMgr::Instance().cancelLongOrder(id);
+        io.clear();
+        Serializer::writeInt(count, io);
+    }
+    else
+    {
+        Server.printf_err("CancelLongOrder: wrong number of arguments\n");
+        io.clear();
+    }
+}
+
+
 #endif
 
@@ -0,0 +1,349 @@
+#ifndef _ORDER_SEQUENCE_h
+#define _ORDER_SEQUENCE_h
+
+#include <vector>
+#include "Serializer.h"
+#include "CommunicationServer.h"
+#include "OrderImmediate.h"
+#include "OrderLong.h"
+
+#define SEQ_MAX_INSTRUCTIONS    32
+#define SEQ_MAX_STEPS_PER_LOOP  8   // Nombre maximal d'instructions exécutées par appel à onExecute()
+
+
+/* Accès aux ordres depuis une séquence (implémenté par l'OrderMgr) */
+class OrderProvider
+{
+public:
+    /* Indique si l'ordre d'ID donné existe et peut être appelé depuis une séquence */
+    virtual bool isSequenceable(uint8_t id) = 0;
+
+    /* Instance libre de l'ordre long d'ID donné (ID de la trame), ou NULL */
+    virtual OrderLong* acquireLongOrder(uint8_t id) = 0;
+
+    /* Ordre immédiat d'ID donné (ID de la trame), ou NULL */
+    virtual OrderImmediate* getImmediateOrder(uint8_t id) = 0;
+};
+
+
+/*
+    Séquence d'ordres exécutée localement, sans aller-retour avec le haut
+    niveau entre les étapes. L'entrée est le programme, une suite
+    d'instructions (entiers en little endian) :
+    - CALL     0x01 | id (1) | timeout ms (2, 0: aucun) | taille args (1) | args
+        Exécute l'ordre immédiat ou long d'ID donné. Sa sortie devient le
+        résultat courant. Un ordre long qui dépasse son timeout est annulé.
+    - JUMP_IF  0x02 | condition (1) | offset (1) | masque (4) | valeur (4) | cible (1)
+        Saute à l'instruction d'indice 'cible' si la condition est vraie :
+        0: (résultat[offset] & masque) == valeur
+        1: (résultat[offset] & masque) != valeur
+        2: le dernier CALL a dépassé son timeout
+    - JUMP     0x03 | cible (1)
+    - END      0x04 | code (1)
+    La fin du programme équivaut à END 0.
+    Réponse : code de fin (1), nombre de CALL exécutés (int), indice de la
+    dernière instruction (int), puis la sortie du dernier CALL.
+    Les ordres longs appelés ne sont pas sur la pile d'exécution de l'OrderMgr :
+    CancelLongOrder avec leur ID ne les atteint pas (il faut annuler la
+    séquence, qui annule son ordre en cours), et l'arbitrage des ressources
+    (refus, préemption) ne voit que la séquence, avec sa priorité et ses
+    ressources (mouvement et actionneurs) quel que soit l'ordre en cours.
+*/
+class RunSequence : public OrderLong
+{
+public:
+    RunSequence()
+    {
+        reset();
+    }
+
+    static void setOrderProvider(OrderProvider * provider)
+    {
+        orderProvider() = provider;
+    }
+
+    void _launch(const std::vector<uint8_t> & input)
+    {
+        reset();
+        program = input;
+        if (orderProvider() == NULL || !parse())
+        {
+            Server.printf_err("RunSequence: invalid program\n");
+            endCode = SEQ_INVALID_PROGRAM;
+            finished = true;
+            return;
+        }
+        Server.printf(SPY_ORDER, "RunSequence (%u instructions)", nbInstructions);
+    }
+
+    void onExecute()
+    {
+        for (size_t i = 0; i < SEQ_MAX_STEPS_PER_LOOP && !finished; i++)
+        {
+            if (currentOrder != NULL)
+            {
+                if (!updateCurrentOrder()) {
+                    return;
+                }
+            }
+            else
+            {
+                step();
+            }
+        }
+    }
+
+    void terminate(std::vector<uint8_t> & output)
+    {
+        Serializer::writeEnum(endCode, output);
+        Serializer::writeInt(nbCalls, output);
+        Serializer::writeInt(pc, output);
+        output.insert(output.end(), result.begin(), result.end());
+    }
+
+    static void refuse(std::vector<uint8_t> & output)
+    {
+        Serializer::writeEnum(SEQ_REFUSED, output);
+        Serializer::writeInt(0, output);
+        Serializer::writeInt(0, output);
+    }
+
+    uint8_t getResources() const { return ORDER_RESOURCE_MOTION | ORDER_RESOURCE_ACTUATOR; }
+
+protected:
+    void onCancel()
+    {
+        if (currentOrder != NULL)
+        {
+            currentOrder->cancel();
+            endCurrentOrder();
+        }
+        endCode = SEQ_CANCELLED;
+    }
+
+private:
+    enum Opcode
+    {
+        OP_CALL = 0x01,
+        OP_JUMP_IF = 0x02,
+        OP_JUMP = 0x03,
+        OP_END = 0x04
+    };
+
+    enum Condition
+    {
+        COND_EQUAL = 0,
+        COND_NOT_EQUAL = 1,
+        COND_TIMED_OUT = 2
+    };
+
+    /* Codes de fin réservés (les codes donnés par END sont libres en dessous) */
+    enum EndCode
+    {
+        SEQ_REFUSED = 0xFC,
+        SEQ_INVALID_PROGRAM = 0xFD,
+        SEQ_RUNTIME_ERROR = 0xFE,
+        SEQ_CANCELLED = 0xFF
+    };
+
+    static OrderProvider* & orderProvider()
+    {
+        static OrderProvider* provider = NULL;
+        return provider;
+    }
+
+    void reset()
+    {
+        nbInstructions = 0;
+        pc = 0;
+        nbCalls = 0;
+        endCode = 0;
+        timedOut = false;
+        currentOrder = NULL;
+        callStartTime = 0;
+        callTimeout = 0;
+        result.clear();
+    }
+
+    /* Découpage du programme en instructions et vérification des sauts */
+    bool parse()
+    {
+        size_t i = 0;
+        while (i < program.size())
+        {
+            if (nbInstructions >= SEQ_MAX_INSTRUCTIONS) {
+                return false;
+            }
+            instructions[nbInstructions++] = i;
+            size_t length;
+            switch (program[i])
+            {
+            case OP_CALL:
+                if (i + 5 > program.size() || !orderProvider()->isSequenceable(program[i + 1])) {
+                    return false;
+                }
+                length = 5 + program[i + 4];
+                break;
+            case OP_JUMP_IF:
+                length = 12;
+                break;
+            case OP_JUMP:
+            case OP_END:
+                length = 2;
+                break;
+            default:
+                return false;
+            }
+            i += length;
+        }
+        if (i != program.size()) {
+            return false;
+        }
+        for (size_t k = 0; k < nbInstructions; k++)
+        {
+            size_t start = instructions[k];
+            uint8_t target;
+            if (program[start] == OP_JUMP_IF) {
+                target = program[start + 11];
+            }
+            else if (program[start] == OP_JUMP) {
+                target = program[start + 1];
+            }
+            else {
+                continue;
+            }
+            if (target > nbInstructions) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void step()
+    {
+        if (pc >= nbInstructions)
+        {
+            finished = true;
+            return;
+        }
+        size_t index = instructions[pc];
+        switch (program[index])
+        {
+        case OP_CALL:
+            startCall(index);
+            break;
+        case OP_JUMP_IF:
+            if (conditionMet(index)) {
+                pc = program[index + 11];
+            }
+            else {
+                pc++;
+            }
+            break;
+        case OP_JUMP:
+            pc = program[index + 1];
+            break;
+        case OP_END:
+            endCode = program[index + 1];
+            finished = true;
+            break;
+        default:
+            break;
+        }
+    }
+
+    void startCall(size_t index)
+    {
+        uint8_t id = program[index + 1];
+        callTimeout = program[index + 2] | (program[index + 3] << 8);
+        std::vector<uint8_t> args(program.begin() + index + 5, program.begin() + index + 5 + program[index + 4]);
+        timedOut = false;
+        result.clear();
+        nbCalls++;
+
+        OrderImmediate* immediateOrder = orderProvider()->getImmediateOrder(id);
+        if (immediateOrder != NULL)
+        {
+            immediateOrder->execute(args);
+            result = args;
+            pc++;
+            return;
+        }
+        currentOrder = orderProvider()->acquireLongOrder(id);
+        if (currentOrder == NULL)
+        {
+            // Toutes les instances de l'ordre sont déjà utilisées
+            runtimeError(id);
+            return;
+        }
+        callStartTime = millis();
+        currentOrder->launch(args);
+    }
+
+    /* Renvoie true si l'ordre long en cours est terminé */
+    bool updateCurrentOrder()
+    {
+        if (!currentOrder->isFinished() && !currentOrder->isSleeping()) {
+            currentOrder->onExecute();
+        }
+        if (!currentOrder->isFinished() && callTimeout > 0 && millis() - callStartTime > callTimeout)
+        {
+            currentOrder->cancel();
+            timedOut = true;
+        }
+        if (!currentOrder->isFinished()) {
+            return false;
+        }
+        endCurrentOrder();
+        pc++;
+        return true;
+    }
+
+    void endCurrentOrder()
+    {
+        result.clear();
+        currentOrder->terminate(result);
+        currentOrder->release();
+        currentOrder = NULL;
+    }
+
+    bool conditionMet(size_t index)
+    {
+        uint8_t condition = program[index + 1];
+        if (condition == COND_TIMED_OUT) {
+            return timedOut;
+        }
+        size_t offset = program[index + 2];
+        if (offset + 4 > result.size()) {
+            return false;
+        }
+        size_t i = index + 3;
+        int32_t mask = Serializer::readInt(program, i);
+        int32_t value = Serializer::readInt(program, i);
+        int32_t field = Serializer::readInt(result, offset);
+        bool equal = (field & mask) == value;
+        return condition == COND_EQUAL ? equal : !equal;
+    }
+
+    void runtimeError(uint8_t id)
+    {
+        Server.printf_err("RunSequence: cannot run order %u\n", id);
+        endCode = SEQ_RUNTIME_ERROR;
+        finished = true;
+    }
+
+    std::vector<uint8_t> program;
+    size_t instructions[SEQ_MAX_INSTRUCTIONS];  // Position de chaque instruction dans le programme
+    size_t nbInstructions;
+    size_t pc;                      // Indice de l'instruction en cours
+    int32_t nbCalls;
+    uint8_t endCode;
+    bool timedOut;                  // Le dernier CALL a dépassé son timeout
+    OrderLong* currentOrder;        // Ordre long en cours d'exécution
+    uint32_t callStartTime;         // ms
+    uint32_t callTimeout;           // ms
+    std::vector<uint8_t> result;    // Sortie du dernier CALL
+};
+
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef POSITION_HISTORY_h
+#define POSITION_HISTORY_h
+
+#include "Position.h"
+#include "Utils.h"
+
+#define POSITION_HISTORY_SIZE   128     // Nombre de positions mémorisées (une par période d'asservissement)
+
+
+/*
+    Historique horodaté des dernières positions du robot.
+    Rempli depuis l'interruption d'asservissement, il permet de retrouver la
+    position du robot à l'instant où une mesure (capteur, ...) a été effectuée.
+*/
+class PositionHistory
+{
+public:
+    PositionHistory()
+    {
+        head = 0;
+        count = 0;
+    }
+
+    /* A appeller depuis l'interruption d'asservissement */
+    void add(uint32_t timestamp, volatile const Position & p)
+    {
+        Sample & s = samples[head];
+        s.timestamp = timestamp;
+        s.x = p.x;
+        s.y = p.y;
+        s.orientation = p.orientation;
+        head = (head + 1) % POSITION_HISTORY_SIZE;
+        if (count < POSITION_HISTORY_SIZE)
+        {
+            count++;
+        }
+    }
+
+    /*
+        Position interpolée à l'instant donné (µs).
+        Si l'instant est hors de l'historique, renvoie la position la plus proche.
+        Renvoie false si l'historique est vide.
+    */
+    bool getPositionAt(uint32_t timestamp, Position & p) const
+    {
+        if (count == 0)
+        {
+            return false;
+        }
+        const Sample & newest = at(count - 1);
+        if ((int32_t)(timestamp - newest.timestamp) >= 0)
+        {
+            newest.toPosition(p);
+            return true;
+        }
+        const Sample & oldest = at(0);
+        if ((int32_t)(timestamp - oldest.timestamp) <= 0)
+        {
+            oldest.toPosition(p);
+            return true;
+        }
+
+        /* Recherche dichotomique du dernier échantillon antérieur à timestamp */
+        size_t low = 0;
+        size_t high = count - 1;
+        while (high - low > 1)
+        {
+            size_t mid = (low + high) / 2;
+            if ((int32_t)(timestamp - at(mid).timestamp) >= 0)
+            {
+                low = mid;
+            }
+            else
+            {
+                high = mid;
+            }
+        }
+
+        const Sample & a = at(low);
+        const Sample & b = at(high);
+        float k = (float)(timestamp - a.timestamp) / (float)(b.timestamp - a.timestamp);
+        float deltaOrientation = b.orientation - a.orientation;
+        if (deltaOrientation > PI)
+        {
+            deltaOrientation -= TWO_PI;
+        }
+        else if (deltaOrientation < -PI)
+        {
+            deltaOrientation += TWO_PI;
+        }
+        p.x = a.x + k * (b.x - a.x);
+        p.y = a.y + k * (b.y - a.y);
+        p.setOrientation(a.orientation + k * deltaOrientation);
+        return true;
+    }
+
+private:
+    struct Sample
+    {
+        uint32_t timestamp; // µs
+        float x;            // mm
+        float y;            // mm
+        float orientation;  // radians
+
+        void toPosition(Position & p) const
+        {
+            p.x = x;
+            p.y = y;
+            p.orientation = orientation;
+        }
+    };
+
+    /* i-ème échantillon, du plus ancien (0) au plus récent (count - 1) */
+    const Sample & at(size_t i) const
+    {
+        return samples[(head + POSITION_HISTORY_SIZE - count + i) % POSITION_HISTORY_SIZE];
+    }
+
+    Sample samples[POSITION_HISTORY_SIZE];
+    size_t head;
+    size_t count;
+};
+
+
+#endif
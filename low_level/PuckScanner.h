@@ -4,26 +4,20 @@
 #include <ToF_sensor.h>
 #include "Config.h"
 #include "CommunicationServer.h"
+#include "Serializer.h"
+#include "MotionControlSystem.h"
+#include "PuckTracker.h"
+#include "ScanProfile.h"
 
-#define SCAN_SENSOR_MIN             (5)      // mm
-#define SCAN_SENSOR_MAX             (200)     // mm
-#define SCAN_RESOLUTION             (101)     // resolution spaciale selon l'axe Y
 #define SCAN_LEFT_SENSOR_POSITION	(-43.83)  // mm
 #define SCAN_RIGHT_SENSOR_POSITION	(43.83)   // mm
 #define SCAN_LEFT_SENSOR_OFFSET     (4)       // mm
 #define SCAN_RIGHT_SENSOR_OFFSET    (-2)       // mm
-
-/* Detection tuning for standard puck */
-#define SCAN_EDGE_MIN_HEIGHT        (15.0)    // mm
-#define SCAN_EDGE_MAX_WIDTH         (4)       // index
-#define SCAN_EDGES_MIN_DIST         (45)      // index
-#define SCAN_EDGES_MAX_DIST         (65)      // index
-
-/* Detection tuning for Goldenium */
-#define SCAN_EDGE_MIN_HEIGHT_GOLD   (30.0)    // mm
-#define SCAN_EDGE_MAX_WIDTH_GOLD    (4)       // index
-#define SCAN_EDGES_MIN_DIST_GOLD    (50)      // index
-#define SCAN_EDGES_MAX_DIST_GOLD    (70)      // index
+#define SCAN_Y_HISTORY_SIZE         (8)       // number of timestamped fork Y readings kept
+#define SCAN_SAMPLE_LATENCY         (3000)    // µs, mean delay between the middle of a range measure and its reading
+#define SCAN_SENSOR_X               (83.0)    // mm, distance between the robot center and the fork sensors, along the robot axis
+#define SCAN_SENSOR_MEDIAN_SIZE     (3)
+#define SCAN_SENSOR_HAMPEL_MIN_DEV  (15)      // mm, deviation always accepted by the Hampel filter (stable window, null MAD)
 
 
 class PuckScanner
@@ -32,149 +26,139 @@ public:
     PuckScanner(float y_min, float y_max) :
         m_left_sensor(I2C_ADDR_TOF_FOURCHE_AVG, PIN_EN_TOF_FOURCHE_AVG, SCAN_SENSOR_MIN, SCAN_SENSOR_MAX, "FourcheG", &Serial),
         m_right_sensor(I2C_ADDR_TOF_FOURCHE_AVD, PIN_EN_TOF_FOURCHE_AVD, SCAN_SENSOR_MIN, SCAN_SENSOR_MAX, "FourcheD", &Serial),
-        m_y_min(y_min + SCAN_LEFT_SENSOR_POSITION), m_y_max(y_max + SCAN_RIGHT_SENSOR_POSITION)
+        m_profile(y_min + SCAN_LEFT_SENSOR_POSITION, y_max + SCAN_RIGHT_SENSOR_POSITION)
     {
         m_scan_enabled = false;
+        m_tracking_enabled = false;
+        m_y_head = 0;
+        m_y_count = 0;
+        m_left_sensor.filter().setThreshold(HAMPEL_DEFAULT_THRESHOLD, SCAN_SENSOR_HAMPEL_MIN_DEV);
+        m_right_sensor.filter().setThreshold(HAMPEL_DEFAULT_THRESHOLD, SCAN_SENSOR_HAMPEL_MIN_DEV);
+        m_profile_report.reserve(2 * sizeof(float) + SCAN_RESOLUTION);
+        reset();
     }
 
-    int init()
+    /* Non-blocking power on of the sensors, driven by updateInit() */
+    void startInit()
     {
-        int ret = EXIT_SUCCESS;
-        if (m_left_sensor.powerON() != EXIT_SUCCESS) { ret = EXIT_FAILURE; }
-        if (m_right_sensor.powerON() != EXIT_SUCCESS) { ret = EXIT_FAILURE; }
-        return ret;
+        m_left_sensor.startPowerON();
+        m_right_sensor.startPowerON();
     }
 
-    void reset() { m_raw_scan_data.clear(); }
-    void enable(bool e) { m_scan_enabled = e; }
-
-    void updateLeftSensor(SensorValue& s_val, float y)
+    void updateInit()
     {
-        registerSensorUpdate(m_left_sensor.getMeasure(), s_val, y + SCAN_LEFT_SENSOR_POSITION, SCAN_LEFT_SENSOR_OFFSET);
+        m_left_sensor.updatePowerON();
+        m_right_sensor.updatePowerON();
     }
-    void updateRightSensor(SensorValue& s_val, float y)
+
+    bool isBooting() const
     {
-        registerSensorUpdate(m_right_sensor.getMeasure(), s_val, y + SCAN_RIGHT_SENSOR_POSITION, SCAN_RIGHT_SENSOR_OFFSET);
+        return m_left_sensor.isBooting() || m_right_sensor.isBooting();
     }
 
-    int compute(bool goldenium, float& y, int32_t& puck_distance)
+    int initResult() const
     {
-        puck_distance = SCAN_SENSOR_MAX;
-
-        /* Index sensing values by their Y-coordinate */
-        std::vector<int32_t> preprocess_data[SCAN_RESOLUTION];
-        for (size_t i = 0; i < m_raw_scan_data.size(); i++) {
-            int32_t d = m_raw_scan_data.at(i).distance;
-            size_t idx = m_raw_scan_data.at(i).index;
-            if (d >= 0 && idx < SCAN_RESOLUTION) {
-                preprocess_data[idx].push_back(d);
-            }
+        if (m_left_sensor.getBootState() == TOF_ON && m_right_sensor.getBootState() == TOF_ON) {
+            return EXIT_SUCCESS;
         }
+        return EXIT_FAILURE;
+    }
 
-        /* Merge sensing values with the same Y-coordinate and mark empty areas */
-        int32_t scan_data[SCAN_RESOLUTION];
-        for (size_t i = 0; i < SCAN_RESOLUTION; i++) {
-            if (preprocess_data[i].size() == 0) {
-                scan_data[i] = -1;
-            }
-            else {
-                int32_t sum = 0;
-                for (size_t j = 0; j < preprocess_data[i].size(); j++) {
-                    sum += preprocess_data[i].at(j);
-                }
-                scan_data[i] = sum / preprocess_data[i].size();
-            }
+    void reset()
+    {
+        m_profile.reset();
+    }
+    /* While scanning or tracking, the sensors run at their fastest rate */
+    void enable(bool e)
+    {
+        if (e && !m_scan_enabled) {
+            m_profile.clearCandidates();
         }
+        m_scan_enabled = e;
+        updateFastMode();
+    }
+    bool isEnabled() const { return m_scan_enabled; }
 
-        /* Fill empty areas with linear interpolation */
-        size_t pre_index = findNextFilledPoint(scan_data, 0);
-        size_t next_index = findNextFilledPoint(scan_data, pre_index + 1);
-        if (pre_index < SCAN_RESOLUTION) {
-            for (size_t i = 0; i < pre_index; i++) {
-                scan_data[i] = scan_data[pre_index];
-            }
-        }
-        else {
-            return EXIT_FAILURE;
-        }
-        while (next_index < SCAN_RESOLUTION) {
-            for (size_t i = pre_index + 1; i < next_index; i++) {
-                scan_data[i] = interpolate(scan_data, i, pre_index, next_index);
-            }
-            pre_index = next_index;
-            next_index = findNextFilledPoint(scan_data, next_index + 1);
-        }
-        for (size_t i = pre_index + 1; i < SCAN_RESOLUTION; i++) {
-            scan_data[i] = scan_data[pre_index];
+    /*
+        Tracking: every sample is placed in the table frame using the robot
+        position at the time of the measure, and fed to the puck tracker
+    */
+    void enableTracking(bool e)
+    {
+        if (e && !m_tracking_enabled) {
+            m_tracker.reset();
         }
+        m_tracking_enabled = e;
+        updateFastMode();
+    }
+    bool isTracking() const { return m_tracking_enabled; }
+    const PuckTracker & getTracker() const { return m_tracker; }
 
-        /* Search for the minimum distance */
-        for (size_t i = 0; i < SCAN_RESOLUTION; i++) {
-            puck_distance = min(scan_data[i], puck_distance);
-        }
+    bool isSweeping() const { return m_scan_enabled || m_tracking_enabled; }
 
-        Server.printf("min dist = %d\n", puck_distance);
-        Server.printf("index;distance\n");
-        for(size_t i = 0; i < SCAN_RESOLUTION; i++) {
-            Server.printf("%u;%d\n", i, scan_data[i]);
+    /* Timestamped reading of the fork Y position (t in µs, y in mm) */
+    void registerYPosition(uint32_t t, float y)
+    {
+        m_y_history[m_y_head].time = t;
+        m_y_history[m_y_head].y = y;
+        m_y_head = (m_y_head + 1) % SCAN_Y_HISTORY_SIZE;
+        if (m_y_count < SCAN_Y_HISTORY_SIZE) {
+            m_y_count++;
         }
+    }
 
-        /* Edge detection */
-        int32_t width, height, puck_min_size, puck_max_size;
-        if (goldenium) {
-            width = SCAN_EDGE_MAX_WIDTH_GOLD;
-            height = SCAN_EDGE_MIN_HEIGHT_GOLD;
-            puck_min_size = SCAN_EDGES_MIN_DIST_GOLD;
-            puck_max_size = SCAN_EDGES_MAX_DIST_GOLD;
-        }
-        else {
-            width = SCAN_EDGE_MAX_WIDTH;
-            height = SCAN_EDGE_MIN_HEIGHT;
-            puck_min_size = SCAN_EDGES_MIN_DIST;
-            puck_max_size = SCAN_EDGES_MAX_DIST;
-        }
+    void updateLeftSensor(SensorValue& s_val, uint32_t& s_time)
+    {
+        registerSensorUpdate(m_left_sensor.getMeasure(), s_val, s_time, SCAN_LEFT_SENSOR_POSITION, SCAN_LEFT_SENSOR_OFFSET);
+    }
+    void updateRightSensor(SensorValue& s_val, uint32_t& s_time)
+    {
+        registerSensorUpdate(m_right_sensor.getMeasure(), s_val, s_time, SCAN_RIGHT_SENSOR_POSITION, SCAN_RIGHT_SENSOR_OFFSET);
+    }
 
-        int32_t puck_start_pos = 0;
-        bool e = false;
-        bool foundFallingEdge = false;
-        for (size_t i = 0; i < SCAN_RESOLUTION - (size_t)width; i++) {
-            int32_t delta = scan_data[i + width] - scan_data[i];
-            if (!e && abs(delta) > height) {
-                e = true;
-                // New edge found
-                if (foundFallingEdge && delta > 0) {
-                    // Rising edge found after registering a falling edge
-                    foundFallingEdge = false;
-                    int32_t puck_end_pos = i + (width / 2);
-                    int32_t puck_size = puck_end_pos - puck_start_pos;
-                    if (puck_size < puck_max_size && puck_size > puck_min_size) {
-                        // Puck found
-                        y = (indexToMm(puck_start_pos) + indexToMm(puck_end_pos)) / 2;
-                        Server.printf("Scan success, y = %g\n", y);
-                        return EXIT_SUCCESS;
-                    }
-                }
-                else if (delta < 0) {
-                    // Registering the falling edge
-                    foundFallingEdge = true;
-                    puck_start_pos = i + (width / 2);
-                }
-            }
-            else if (e && abs(delta) <= height) {
-                e = false;
-            }
+    /* Search for the pucks in the profile recorded since the last reset(), see ScanProfile */
+    int compute(bool goldenium, float& y, int32_t& puck_distance)
+    {
+        if (m_profile.compute(goldenium, y, puck_distance) != EXIT_SUCCESS) {
+            Server.printf("Scan failure (confidence %g)\n", m_profile.getConfidence());
+            return EXIT_FAILURE;
         }
-        // Puck not found
-        Server.printf("Scan failure\n");
-        return EXIT_FAILURE;
+        Server.printf("Scan success, y = %g (confidence %g, %u candidates)\n", y, m_profile.getConfidence(), m_profile.getNbCandidates());
+        return EXIT_SUCCESS;
+    }
+
+    /* Confidence of the last detection, in [0, 1] */
+    float getConfidence() const
+    {
+        return m_profile.getConfidence();
+    }
+
+    /* Candidates found by the last call to compute(), see ScanProfile::appendCandidatesToVect */
+    void appendCandidatesToVect(std::vector<uint8_t> & output) const
+    {
+        m_profile.appendCandidatesToVect(output);
+    }
+
+    /* Sends the profile computed by the last call to compute() as a single frame, see ScanProfile::appendProfileToVect */
+    void sendProfile()
+    {
+        m_profile_report.clear();
+        m_profile.appendProfileToVect(m_profile_report);
+        Server.sendData(SCAN_PROFILE, m_profile_report);
     }
 
 private:
-    void registerSensorUpdate(SensorValue input, SensorValue& output, float y, int32_t offset)
+    struct YReading {
+        uint32_t time;  // µs
+        float y;        // mm
+    };
+
+    void registerSensorUpdate(SensorValue input, SensorValue& output, uint32_t& output_time, float sensor_position, int32_t offset)
     {
         if (input == SENSOR_NOT_UPDATED) {
             return;
         }
+        output_time = micros() - SCAN_SAMPLE_LATENCY;
 
         SensorValue input_offset;
         if (input == SENSOR_DEAD || input == OBSTACLE_TOO_CLOSE || input == NO_OBSTACLE) {
@@ -189,77 +173,108 @@ private:
 
         output = input_offset;
         if (m_scan_enabled) {
-            m_raw_scan_data.push_back(RawScanPoint(input_offset, y, m_y_min, m_y_max));
+            addToBin(input_offset, yAt(output_time) + sensor_position);
+        }
+        if (m_tracking_enabled && input_offset > SCAN_SENSOR_MIN && input_offset < SCAN_SENSOR_MAX) {
+            addToTracker(input_offset, yAt(output_time) + sensor_position, output_time);
         }
     }
 
-    size_t findNextFilledPoint(int32_t tab[SCAN_RESOLUTION], size_t start)
+    void addToTracker(SensorValue distance, float lateral, uint32_t capture_time)
     {
-        for (size_t i = start; i < SCAN_RESOLUTION; i++) {
-            if (tab[i] >= 0) {
-                return i;
-            }
-        }
-        return SCAN_RESOLUTION;
+        Position p = MotionControlSystem::Instance().getPositionAt(capture_time);
+        float ux = cosf(p.orientation);
+        float uy = sinf(p.orientation);
+        float forward = SCAN_SENSOR_X + distance;
+        // Fork y axis points to the left of the robot
+        m_tracker.addPoint(p.x + forward * ux - lateral * uy, p.y + forward * uy + lateral * ux, ux, uy);
     }
 
-    int32_t interpolate(int32_t tab[SCAN_RESOLUTION], size_t index, size_t pre_index, size_t next_index)
+    /*
+        The Hampel filter is causal: a real edge is only accepted one sample
+        after it is seen (about 0.9 mm at the scan speed of 92 mm/s with a
+        sample every 10 ms), which would shift the puck found by a one-way
+        scan. While sweeping the filter lets every distance through (no
+        deviation between two distances reaches SCAN_SENSOR_MAX), the spikes
+        being rejected by the template correlation of ScanProfile and by the
+        gate of PuckTracker. Otherwise it cleans the obstacle readings.
+    */
+    void updateFastMode()
     {
-        float a = (float)(tab[next_index] - tab[pre_index]) / (float)(next_index - pre_index);
-        return round((float)tab[pre_index] + (float)(index - pre_index) * a);
+        m_left_sensor.setFastMode(isSweeping());
+        m_right_sensor.setFastMode(isSweeping());
+        if (isSweeping())
+        {
+            m_left_sensor.filter().setThreshold(0, SCAN_SENSOR_MAX);
+            m_right_sensor.filter().setThreshold(0, SCAN_SENSOR_MAX);
+        }
+        else
+        {
+            m_left_sensor.filter().setThreshold(HAMPEL_DEFAULT_THRESHOLD, SCAN_SENSOR_HAMPEL_MIN_DEV);
+            m_right_sensor.filter().setThreshold(HAMPEL_DEFAULT_THRESHOLD, SCAN_SENSOR_HAMPEL_MIN_DEV);
+        }
     }
 
-    static int32_t mmToIndex(float y, float y_min, float y_max)
+    /*
+        Fork Y position at the given time (µs), interpolated between the two
+        surrounding readings. After the last reading, the motion is extrapolated
+        for at most one reading period.
+    */
+    float yAt(uint32_t t) const
     {
-        return round((constrain(y, y_min, y_max) - y_min) * (SCAN_RESOLUTION - 1) / (y_max - y_min));
+        if (m_y_count == 0) {
+            return 0;
+        }
+        if (m_y_count == 1 || (int32_t)(t - yReading(0).time) <= 0) {
+            return yReading(0).y;
+        }
+        size_t i = 1;
+        while (i < m_y_count - 1 && (int32_t)(t - yReading(i).time) > 0) {
+            i++;
+        }
+        const YReading & a = yReading(i - 1);
+        const YReading & b = yReading(i);
+        if (b.time == a.time) {
+            return b.y;
+        }
+        float k = (float)(t - a.time) / (float)(b.time - a.time);
+        return a.y + constrain(k, 0.0f, 2.0f) * (b.y - a.y);
     }
 
-    int32_t mmToIndex(float y)
+    /* i-th Y reading, from the oldest (0) to the newest (m_y_count - 1) */
+    const YReading & yReading(size_t i) const
     {
-        return mmToIndex(y, m_y_min, m_y_max);
+        return m_y_history[(m_y_head + SCAN_Y_HISTORY_SIZE - m_y_count + i) % SCAN_Y_HISTORY_SIZE];
     }
 
-    float indexToMm(int32_t index)
+    void addToBin(SensorValue v, float y)
     {
-        return m_y_min + (float)index * (m_y_max - m_y_min) / ((float)SCAN_RESOLUTION - 1);
+        int32_t distance;
+        if (v == OBSTACLE_TOO_CLOSE) {
+            distance = SCAN_SENSOR_MIN;
+        }
+        else if (v == NO_OBSTACLE) {
+            distance = SCAN_SENSOR_MAX;
+        }
+        else if (v > SCAN_SENSOR_MAX || v < SCAN_SENSOR_MIN) {
+            return;
+        }
+        else {
+            distance = v;
+        }
+        m_profile.addMeasure(distance, y);
     }
 
-    ToF_shortRange m_left_sensor;
-    ToF_shortRange m_right_sensor;
+    ToF_shortRange_med<SCAN_SENSOR_MEDIAN_SIZE, Hampel> m_left_sensor;
+    ToF_shortRange_med<SCAN_SENSOR_MEDIAN_SIZE, Hampel> m_right_sensor;
     bool m_scan_enabled;
-    const float m_y_min;
-    const float m_y_max;
-
-    struct RawScanPoint {
-        RawScanPoint(SensorValue v, float y, float y_min, float y_max)
-        {
-            if (v == OBSTACLE_TOO_CLOSE) {
-                distance = SCAN_SENSOR_MIN;
-            }
-            else if (v == NO_OBSTACLE) {
-                distance = SCAN_SENSOR_MAX;
-            }
-            else if (v > SCAN_SENSOR_MAX || v < SCAN_SENSOR_MIN) {
-                distance = -1;
-            }
-            else {
-                distance = v;
-            }
-            index = mmToIndex(y, y_min, y_max);
-        }
-        size_t index;
-        int32_t distance;
-    };
-    std::vector<RawScanPoint> m_raw_scan_data;
-
-    struct Edge {
-        Edge(bool rising, size_t position) {
-            this->rising = rising;
-            this->position = position;
-        }
-        bool rising;
-        size_t position;
-    };
+    bool m_tracking_enabled;
+    PuckTracker m_tracker;
+    ScanProfile m_profile;
+    std::vector<uint8_t> m_profile_report;
+    YReading m_y_history[SCAN_Y_HISTORY_SIZE];
+    size_t m_y_head;
+    size_t m_y_count;
 };
 
 
@@ -0,0 +1,174 @@
+#ifndef _PUCK_TRACKER_h
+#define _PUCK_TRACKER_h
+
+#include <Arduino.h>
+
+#define PUCK_RADIUS                 (38.0)    // mm
+#define PUCK_TRACKER_HISTORY        (32)      // Nombre de points du bord utilisés pour l'estimation
+#define PUCK_TRACKER_MIN_POINTS     (6)       // Nombre de points nécessaires pour une estimation valide
+#define PUCK_TRACKER_GATE           (40.0)    // mm, écart maximal entre un nouveau point et le bord estimé du palet
+#define PUCK_TRACKER_ITERATIONS     (3)       // Itérations de Gauss-Newton à chaque nouveau point
+#define PUCK_TRACKER_DAMPING        (0.1)     // Amortissement de Levenberg-Marquardt, relatif à la trace de J'J
+
+
+/*
+    Estimation de la position d'un palet (repère de la table) à partir de
+    points de son bord, chacun vu selon une direction de capteur connue.
+    Le centre est obtenu par ajustement d'un cercle de rayon connu (moindres
+    carrés, quelques itérations de Gauss-Newton à chaque point ajouté, en
+    partant de l'estimation précédente). Le centre est gardé derrière les
+    points selon la direction des capteurs : sur un arc court et bruité, les
+    moindres carrés peuvent sinon converger vers le cercle symétrique, du
+    côté des capteurs. Les points trop éloignés de
+    l'estimation courante sont rejetés ; après trop de rejets consécutifs,
+    l'estimation repart de zéro.
+*/
+class PuckTracker
+{
+public:
+    PuckTracker()
+    {
+        reset();
+    }
+
+    void reset()
+    {
+        m_head = 0;
+        m_count = 0;
+        m_rejected = 0;
+        m_center_x = 0;
+        m_center_y = 0;
+        m_rms = 0;
+    }
+
+    /* (px, py) : point du bord dans le repère de la table (mm), (ux, uy) : vecteur unitaire de la direction du capteur */
+    void addPoint(float px, float py, float ux, float uy)
+    {
+        if (m_count == 0)
+        {
+            // Le centre se trouve derrière le premier point vu
+            m_center_x = px + PUCK_RADIUS * ux;
+            m_center_y = py + PUCK_RADIUS * uy;
+        }
+        else if (isValid() && fabsf(distanceToCenter(px, py) - PUCK_RADIUS) > PUCK_TRACKER_GATE)
+        {
+            m_rejected++;
+            if (m_rejected > PUCK_TRACKER_HISTORY) {
+                reset();
+            }
+            return;
+        }
+        m_rejected = 0;
+
+        m_points[m_head].x = px;
+        m_points[m_head].y = py;
+        m_points[m_head].ux = ux;
+        m_points[m_head].uy = uy;
+        m_head = (m_head + 1) % PUCK_TRACKER_HISTORY;
+        if (m_count < PUCK_TRACKER_HISTORY) {
+            m_count++;
+        }
+        fit();
+    }
+
+    bool isValid() const
+    {
+        return m_count >= PUCK_TRACKER_MIN_POINTS;
+    }
+
+    float getX() const { return m_center_x; }
+    float getY() const { return m_center_y; }
+    float getRms() const { return m_rms; }
+    size_t getNbPoints() const { return m_count; }
+
+private:
+    float distanceToCenter(float px, float py) const
+    {
+        return sqrtf((px - m_center_x) * (px - m_center_x) + (py - m_center_y) * (py - m_center_y));
+    }
+
+    void fit()
+    {
+        for (size_t it = 0; it < PUCK_TRACKER_ITERATIONS; it++)
+        {
+            // Equations normales (J'J) delta = -J'r, avec r_i = |p_i - c| - R
+            float a11 = 0, a12 = 0, a22 = 0, b1 = 0, b2 = 0, sq = 0;
+            for (size_t i = 0; i < m_count; i++)
+            {
+                float dx = m_points[i].x - m_center_x;
+                float dy = m_points[i].y - m_center_y;
+                float d = sqrtf(dx * dx + dy * dy);
+                if (d < 1e-3) {
+                    continue;
+                }
+                float jx = -dx / d;
+                float jy = -dy / d;
+                float r = d - PUCK_RADIUS;
+                a11 += jx * jx;
+                a12 += jx * jy;
+                a22 += jy * jy;
+                b1 -= jx * r;
+                b2 -= jy * r;
+                sq += r * r;
+            }
+            m_rms = sqrtf(sq / m_count);
+
+            // Amortissement : les points ne couvrent que la face avant du palet, et
+            // les premiers, proches les uns des autres, ne contraignent pas le centre le long de la corde
+            float damping = PUCK_TRACKER_DAMPING * (a11 + a22) + 1e-6;
+            a11 += damping;
+            a22 += damping;
+            float det = a11 * a22 - a12 * a12;
+            if (det <= 0) {
+                return;
+            }
+            m_center_x += (a22 * b1 - a12 * b2) / det;
+            m_center_y += (a11 * b2 - a12 * b1) / det;
+            keepCenterBehindPoints();
+        }
+    }
+
+    /* Symétrique du centre par rapport à la corde des points, s'il est passé du côté des capteurs */
+    void keepCenterBehindPoints()
+    {
+        float mx = 0, my = 0, ux = 0, uy = 0;
+        for (size_t i = 0; i < m_count; i++)
+        {
+            mx += m_points[i].x;
+            my += m_points[i].y;
+            ux += m_points[i].ux;
+            uy += m_points[i].uy;
+        }
+        float norm = sqrtf(ux * ux + uy * uy);
+        if (norm < 1e-3) {
+            return;
+        }
+        ux /= norm;
+        uy /= norm;
+        float depth = (m_center_x - mx / m_count) * ux + (m_center_y - my / m_count) * uy;
+        if (depth < 0)
+        {
+            m_center_x -= 2 * depth * ux;
+            m_center_y -= 2 * depth * uy;
+        }
+    }
+
+    struct Point
+    {
+        float x;    // mm
+        float y;    // mm
+        float ux;   // Direction du capteur qui a vu le point
+        float uy;
+    };
+
+    Point m_points[PUCK_TRACKER_HISTORY];
+    size_t m_head;      // Prochain emplacement écrit dans 'm_points'
+    size_t m_count;     // Nombre de points enregistrés
+    size_t m_rejected;  // Nombre de points rejetés consécutivement
+    float m_center_x;   // mm
+    float m_center_y;   // mm
+    float m_rms;        // mm, résidu de l'ajustement
+};
+
+
+#endif
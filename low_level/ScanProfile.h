@@ -0,0 +1,384 @@
+#ifndef _SCAN_PROFILE_h
+#define _SCAN_PROFILE_h
+
+#include <Arduino.h>
+#include <vector>
+#include "Serializer.h"
+
+#define SCAN_SENSOR_MIN             (5)       // mm
+#define SCAN_SENSOR_MAX             (200)     // mm
+#define SCAN_RESOLUTION             (101)     // resolution spaciale selon l'axe Y
+#define SCAN_PROFILE_EMPTY_BIN      (0xFF)    // valeur envoyée pour une case sans mesure
+
+/* Corrélation avec le gabarit */
+#define SCAN_TEMPLATE_SHOULDER      (6)       // index, largeur de fond de chaque côté du palet (tronquée aux extrémités du scan)
+#define SCAN_MIN_CONFIDENCE         (0.6)     // corrélation minimale entre le profil et le gabarit
+#define SCAN_MAX_CANDIDATES         (4)       // nombre maximal de palets trouvés par un scan
+
+/* Détection d'un palet standard */
+#define SCAN_PUCK_MIN_CONTRAST      (15.0)    // mm
+#define SCAN_PUCK_MIN_WIDTH         (45)      // index
+#define SCAN_PUCK_MAX_WIDTH         (65)      // index
+
+/* Détection du Goldenium */
+#define SCAN_PUCK_MIN_CONTRAST_GOLD (30.0)    // mm
+#define SCAN_PUCK_MIN_WIDTH_GOLD    (50)      // index
+#define SCAN_PUCK_MAX_WIDTH_GOLD    (70)      // index
+
+
+/*
+    Profil de distances relevé par la fourche selon l'axe Y, et recherche des
+    palets dans ce profil. Ne dépend d'aucun matériel : le PuckScanner y place
+    les mesures, les tests sur PC (host_test) y rejouent des profils enregistrés.
+*/
+class ScanProfile
+{
+public:
+    /* [yMin ; yMax] : positions (mm) des extrémités du profil */
+    ScanProfile(float yMin, float yMax) :
+        yMin(yMin), yMax(yMax)
+    {
+        lastConfidence = 0;
+        nbCandidates = 0;
+        reset();
+    }
+
+    void reset()
+    {
+        for (size_t i = 0; i < SCAN_RESOLUTION; i++)
+        {
+            binSum[i] = 0;
+            binCount[i] = 0;
+        }
+        profileValid = false;
+    }
+
+    void clearCandidates()
+    {
+        nbCandidates = 0;
+    }
+
+    /* Mesure 'distance' (mm) prise à la position 'y' (mm) */
+    void addMeasure(int32_t distance, float y)
+    {
+        if (distance > SCAN_SENSOR_MAX || distance < SCAN_SENSOR_MIN) {
+            return;
+        }
+        size_t index = mmToIndex(y);
+        if (index < SCAN_RESOLUTION && binCount[index] < UINT16_MAX)
+        {
+            binSum[index] += distance;
+            binCount[index]++;
+        }
+    }
+
+    /*
+        Calcul du profil à partir des mesures, puis recherche des palets.
+        En cas de succès, 'y' et 'puckDistance' sont ceux du meilleur candidat.
+    */
+    int compute(bool goldenium, float & y, int32_t & puckDistance)
+    {
+        puckDistance = SCAN_SENSOR_MAX;
+        nbCandidates = 0;
+
+        /* Moyenne de chaque case, les cases vides sont marquées */
+        for (size_t i = 0; i < SCAN_RESOLUTION; i++)
+        {
+            if (binCount[i] == 0) {
+                profile[i] = -1;
+            }
+            else {
+                profile[i] = binSum[i] / (int32_t)binCount[i];
+            }
+        }
+
+        /* Remplissage des cases vides par interpolation linéaire */
+        size_t preIndex = findNextFilledPoint(0);
+        size_t nextIndex = findNextFilledPoint(preIndex + 1);
+        if (preIndex >= SCAN_RESOLUTION) {
+            return EXIT_FAILURE;
+        }
+        for (size_t i = 0; i < preIndex; i++) {
+            profile[i] = profile[preIndex];
+        }
+        while (nextIndex < SCAN_RESOLUTION)
+        {
+            for (size_t i = preIndex + 1; i < nextIndex; i++) {
+                profile[i] = interpolate(i, preIndex, nextIndex);
+            }
+            preIndex = nextIndex;
+            nextIndex = findNextFilledPoint(nextIndex + 1);
+        }
+        for (size_t i = preIndex + 1; i < SCAN_RESOLUTION; i++) {
+            profile[i] = profile[preIndex];
+        }
+        profileValid = true;
+
+        /* Distance minimale */
+        for (size_t i = 0; i < SCAN_RESOLUTION; i++) {
+            puckDistance = min(profile[i], puckDistance);
+        }
+
+        /*
+            Corrélation du profil avec un gabarit en créneau (fond, palet, fond)
+            pour chaque largeur de palet admise et chaque position. Le score est
+            le coefficient de corrélation entre le profil et le gabarit, le
+            meilleur donne la confiance.
+        */
+        float minContrast;
+        int32_t minWidth, maxWidth;
+        if (goldenium)
+        {
+            minContrast = SCAN_PUCK_MIN_CONTRAST_GOLD;
+            minWidth = SCAN_PUCK_MIN_WIDTH_GOLD;
+            maxWidth = SCAN_PUCK_MAX_WIDTH_GOLD;
+        }
+        else
+        {
+            minContrast = SCAN_PUCK_MIN_CONTRAST;
+            minWidth = SCAN_PUCK_MIN_WIDTH;
+            maxWidth = SCAN_PUCK_MAX_WIDTH;
+        }
+
+        prefixSum[0] = 0;
+        prefixSq[0] = 0;
+        for (size_t i = 0; i < SCAN_RESOLUTION; i++)
+        {
+            prefixSum[i + 1] = prefixSum[i] + profile[i];
+            prefixSq[i + 1] = prefixSq[i] + profile[i] * profile[i];
+        }
+
+        /*
+            Meilleure largeur pour chaque position du palet dans le gabarit. Le
+            fond est tronqué aux extrémités du scan, pour que deux palets côte à
+            côte soient tous deux trouvés (leurs largeurs font au moins
+            2 * SCAN_PUCK_MIN_WIDTH, il ne reste pas la place pour quatre fonds).
+        */
+        float scoreAt[SCAN_RESOLUTION];
+        int32_t widthAt[SCAN_RESOLUTION];
+        for (size_t begin = 0; begin < SCAN_RESOLUTION; begin++)
+        {
+            scoreAt[begin] = 0;
+            widthAt[begin] = 0;
+        }
+        for (int32_t w = minWidth; w <= maxWidth && w < SCAN_RESOLUTION; w++)
+        {
+            for (int32_t begin = 0; begin + w <= SCAN_RESOLUTION; begin++)
+            {
+                float contrast;
+                float score = matchScore(begin, w, contrast);
+                if (contrast >= minContrast && score > scoreAt[begin])
+                {
+                    scoreAt[begin] = score;
+                    widthAt[begin] = w;
+                }
+            }
+        }
+
+        /* Candidats, par confiance décroissante, sans chevauchement entre deux palets */
+        float bestScore = 0;
+        while (nbCandidates < SCAN_MAX_CANDIDATES)
+        {
+            int32_t bestBegin = -1;
+            bestScore = 0;
+            for (int32_t begin = 0; begin < SCAN_RESOLUTION; begin++)
+            {
+                if (scoreAt[begin] > bestScore && !overlapsCandidate(begin, widthAt[begin]))
+                {
+                    bestScore = scoreAt[begin];
+                    bestBegin = begin;
+                }
+            }
+            if (bestBegin < 0 || bestScore < SCAN_MIN_CONFIDENCE) {
+                break;
+            }
+            addCandidate(bestBegin, widthAt[bestBegin], bestScore);
+            scoreAt[bestBegin] = 0;
+        }
+
+        if (nbCandidates == 0)
+        {
+            lastConfidence = bestScore;
+            return EXIT_FAILURE;
+        }
+        y = candidates[0].y;
+        puckDistance = candidates[0].distance;
+        lastConfidence = candidates[0].confidence;
+        return EXIT_SUCCESS;
+    }
+
+    /* Confiance de la dernière détection, dans [0, 1] */
+    float getConfidence() const { return lastConfidence; }
+
+    size_t getNbCandidates() const { return nbCandidates; }
+    float getCandidateY(size_t i) const { return candidates[i].y; }
+    float getCandidateWidth(size_t i) const { return candidates[i].width; }
+
+    /*
+        Candidats trouvés par le dernier appel à compute(), par confiance décroissante :
+        nombre de candidats (Enum), puis pour chacun y (float, mm), distance (int, mm),
+        largeur (float, mm) et confiance (float). La trame a toujours SCAN_MAX_CANDIDATES
+        candidats, les derniers sont nuls.
+    */
+    void appendCandidatesToVect(std::vector<uint8_t> & output) const
+    {
+        Serializer::writeEnum(nbCandidates, output);
+        for (size_t i = 0; i < SCAN_MAX_CANDIDATES; i++)
+        {
+            bool found = i < nbCandidates;
+            Serializer::writeFloat(found ? candidates[i].y : 0, output);
+            Serializer::writeInt(found ? candidates[i].distance : 0, output);
+            Serializer::writeFloat(found ? candidates[i].width : 0, output);
+            Serializer::writeFloat(found ? candidates[i].confidence : 0, output);
+        }
+    }
+
+    /*
+        Profil calculé par le dernier appel à compute() : y_min (float), y_max (float),
+        puis un octet par case (distance en mm, SCAN_PROFILE_EMPTY_BIN sans profil)
+    */
+    void appendProfileToVect(std::vector<uint8_t> & output) const
+    {
+        Serializer::writeFloat(yMin, output);
+        Serializer::writeFloat(yMax, output);
+        for (size_t i = 0; i < SCAN_RESOLUTION; i++)
+        {
+            if (profileValid) {
+                output.push_back((uint8_t)constrain(profile[i], 0, SCAN_SENSOR_MAX));
+            }
+            else {
+                output.push_back(SCAN_PROFILE_EMPTY_BIN);
+            }
+        }
+    }
+
+    float indexToMm(float index) const
+    {
+        return yMin + index * (yMax - yMin) / ((float)SCAN_RESOLUTION - 1);
+    }
+
+private:
+    struct ScanCandidate
+    {
+        float y;            // mm
+        int32_t distance;   // mm
+        float width;        // mm
+        float confidence;   // [0, 1]
+        int32_t beginIndex;
+        int32_t endIndex;
+    };
+
+    /* La partie palet [begin ; begin + width[ d'un gabarit chevauche un palet déjà trouvé */
+    bool overlapsCandidate(int32_t begin, int32_t width) const
+    {
+        int32_t end = begin + width;
+        for (size_t i = 0; i < nbCandidates; i++)
+        {
+            if (begin < candidates[i].endIndex && candidates[i].beginIndex < end) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void addCandidate(int32_t begin, int32_t width, float score)
+    {
+        /* Position du pic à une fraction de case près : parabole passant par les scores des positions voisines */
+        float center = begin + (width - 1) / 2.0;
+        if (begin > 0 && begin + width < SCAN_RESOLUTION)
+        {
+            float contrast;
+            float sPrev = matchScore(begin - 1, width, contrast);
+            float sNext = matchScore(begin + 1, width, contrast);
+            float curvature = sPrev - 2 * score + sNext;
+            if (curvature < 0) {
+                center += constrain(0.5 * (sPrev - sNext) / curvature, -0.5, 0.5);
+            }
+        }
+
+        ScanCandidate & c = candidates[nbCandidates];
+        c.beginIndex = begin;
+        c.endIndex = c.beginIndex + width;
+        c.y = indexToMm(center);
+        c.width = width * (yMax - yMin) / ((float)SCAN_RESOLUTION - 1);
+        c.confidence = score;
+        c.distance = SCAN_SENSOR_MAX;
+        for (int32_t i = c.beginIndex; i < c.endIndex; i++) {
+            c.distance = min(profile[i], c.distance);
+        }
+        nbCandidates++;
+    }
+
+    size_t findNextFilledPoint(size_t start) const
+    {
+        for (size_t i = start; i < SCAN_RESOLUTION; i++)
+        {
+            if (profile[i] >= 0) {
+                return i;
+            }
+        }
+        return SCAN_RESOLUTION;
+    }
+
+    int32_t interpolate(size_t index, size_t preIndex, size_t nextIndex) const
+    {
+        float a = (float)(profile[nextIndex] - profile[preIndex]) / (float)(nextIndex - preIndex);
+        return round((float)profile[preIndex] + (float)(index - preIndex) * a);
+    }
+
+    int32_t mmToIndex(float y) const
+    {
+        return round((constrain(y, yMin, yMax) - yMin) * (SCAN_RESOLUTION - 1) / (yMax - yMin));
+    }
+
+    /*
+        Coefficient de corrélation entre le profil et un gabarit en créneau dont
+        la partie palet couvre [inBegin ; inBegin + width[, calculé à partir des
+        sommes cumulées. Le fond est tronqué aux extrémités du scan.
+        'contrast' est la distance moyenne du fond moins celle du palet (mm).
+    */
+    float matchScore(int32_t inBegin, int32_t width, float & contrast) const
+    {
+        int32_t inEnd = inBegin + width;
+        int32_t start = max(inBegin - SCAN_TEMPLATE_SHOULDER, 0);
+        int32_t end = min(inEnd + SCAN_TEMPLATE_SHOULDER, SCAN_RESOLUTION);
+        float nIn = width;
+        float nOut = end - start - width;
+        if (nOut <= 0)
+        {
+            contrast = 0;
+            return 0;
+        }
+        float sumIn = prefixSum[inEnd] - prefixSum[inBegin];
+        float sumOut = prefixSum[end] - prefixSum[start] - sumIn;
+        float sqIn = prefixSq[inEnd] - prefixSq[inBegin];
+        float sqOut = prefixSq[end] - prefixSq[start] - sqIn;
+        float meanIn = sumIn / nIn;
+        float meanOut = sumOut / nOut;
+        contrast = meanOut - meanIn;
+
+        float within = max(sqIn - sumIn * meanIn + sqOut - sumOut * meanOut, 0.0f);
+        float between = nIn * nOut / (nIn + nOut) * contrast * contrast;
+        if (between + within <= 0) {
+            return 0;
+        }
+        float r = sqrtf(between / (between + within));
+        return contrast >= 0 ? r : -r;
+    }
+
+    const float yMin;
+    const float yMax;
+
+    int32_t binSum[SCAN_RESOLUTION];        // Somme des distances mesurées dans chaque case (mm)
+    uint16_t binCount[SCAN_RESOLUTION];     // Nombre de mesures dans chaque case
+    int32_t profile[SCAN_RESOLUTION];       // Profil interpolé, sortie de compute() (mm)
+    bool profileValid;
+    int32_t prefixSum[SCAN_RESOLUTION + 1]; // Sommes cumulées du profil, utilisées par matchScore()
+    int32_t prefixSq[SCAN_RESOLUTION + 1];  // Sommes cumulées du carré du profil
+    float lastConfidence;
+    ScanCandidate candidates[SCAN_MAX_CANDIDATES];
+    size_t nbCandidates;
+};
+
+
+#endif
@@ -5,6 +5,7 @@
 #include <ToF_sensor.h>
 #include "Config.h"
 #include "Serializer.h"
+#include "MotionControlSystem.h"
 
 #define SENSOR_UPDATE_PERIOD    5000 // s
 #define NB_SENSORS              6
@@ -13,6 +14,9 @@
 #define TOF_LR_MIN_RANGE        30
 #define TOF_LR_MAX_RANGE        700
 #define TOF_LR_MEDIAN_SIZE      3
+#define TOF_LR_HAMPEL_MIN_DEV   15  // mm, cart toujours accept par le filtre de Hampel (fentre stable, MAD nulle)
+#define TOF_RECOVERY_RETRY_PERIOD   500 // ms
+#define SENSOR_NO_MEASURE_AGE   UINT32_MAX  // s, ge envoy pour un capteur qui n'a encore rien mesur
 
 
 class SensorsMgr : public Printable, public Singleton<SensorsMgr>
@@ -20,24 +24,21 @@ class SensorsMgr : public Printable, public Singleton<SensorsMgr>
 public:
     SensorsMgr()
     {
-        sensors[AVG] = new ToF_longRange(I2C_ADDR_TOF_AVG, PIN_EN_TOF_AVG,
-            TOF_LR_MIN_RANGE, TOF_LR_MAX_RANGE, "AVG", &Serial);
-        sensors[AVD] = new ToF_longRange(I2C_ADDR_TOF_AVD, PIN_EN_TOF_AVD,
-            TOF_LR_MIN_RANGE, TOF_LR_MAX_RANGE, "AVD", &Serial);
-        sensors[FARG] = new ToF_longRange(I2C_ADDR_TOF_FLAN_ARG, PIN_EN_TOF_FLAN_ARG,
-            TOF_LR_MIN_RANGE, TOF_LR_MAX_RANGE, "FlanARG", &Serial);
-        sensors[FARD] = new ToF_longRange(I2C_ADDR_TOF_FLAN_ARD, PIN_EN_TOF_FLAN_ARD,
-            TOF_LR_MIN_RANGE, TOF_LR_MAX_RANGE, "FlanARD", &Serial);
-        sensors[ARG] = new ToF_longRange(I2C_ADDR_TOF_ARG, PIN_EN_TOF_ARG,
-            TOF_LR_MIN_RANGE, TOF_LR_MAX_RANGE, "ARG", &Serial);
-        sensors[ARD] = new ToF_longRange(I2C_ADDR_TOF_ARD, PIN_EN_TOF_ARD,
-            TOF_LR_MIN_RANGE, TOF_LR_MAX_RANGE, "ARD", &Serial);
+        sensors[AVG] = newLongRangeSensor(I2C_ADDR_TOF_AVG, PIN_EN_TOF_AVG, "AVG");
+        sensors[AVD] = newLongRangeSensor(I2C_ADDR_TOF_AVD, PIN_EN_TOF_AVD, "AVD");
+        sensors[FARG] = newLongRangeSensor(I2C_ADDR_TOF_FLAN_ARG, PIN_EN_TOF_FLAN_ARG, "FlanARG");
+        sensors[FARD] = newLongRangeSensor(I2C_ADDR_TOF_FLAN_ARD, PIN_EN_TOF_FLAN_ARD, "FlanARD");
+        sensors[ARG] = newLongRangeSensor(I2C_ADDR_TOF_ARG, PIN_EN_TOF_ARG, "ARG");
+        sensors[ARD] = newLongRangeSensor(I2C_ADDR_TOF_ARD, PIN_EN_TOF_ARD, "ARD");
 
         members_allocated = true;
         for (size_t i = 0; i < NB_SENSORS; i++)
         {
             sensorsValues[i] = (SensorValue)SENSOR_DEAD;
             sensorsLastUpdateTime[i] = 0;
+            sensorsCaptureTime[i] = 0;
+            recoveryStartTime[i] = 0;
+            restartCount[i] = 0;
             if (sensors[i] == nullptr)
             {
                 members_allocated = false;
@@ -45,26 +46,56 @@ public:
         }
     }
 
-    int init()
+    /*
+        Dmarrage non bloquant de tous les capteurs : la libration des XSHUT
+        est chelonne par les capteurs eux-mmes (une seule puce  la fois sur
+        l'adresse I2C par dfaut), l'avancement est fait par updateRecovery()
+    */
+    void startInit()
+    {
+        if (!members_allocated) {
+            return;
+        }
+        for (size_t i = 0; i < NB_SENSORS; i++)
+        {
+            recoveryStartTime[i] = millis();
+            sensors[i]->startPowerON();
+        }
+    }
+
+    bool isBooting() const
+    {
+        if (!members_allocated) {
+            return false;
+        }
+        for (size_t i = 0; i < NB_SENSORS; i++)
+        {
+            if (sensors[i]->isBooting()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    int initResult() const
     {
         if (!members_allocated) {
             return EXIT_FAILURE;
         }
-        int ret = EXIT_SUCCESS;
         for (size_t i = 0; i < NB_SENSORS; i++)
         {
-            if (sensors[i]->powerON() != EXIT_SUCCESS)
-            {
-                ret = EXIT_FAILURE;
+            if (sensors[i]->getBootState() != TOF_ON) {
+                return EXIT_FAILURE;
             }
         }
-        return ret;
+        return EXIT_SUCCESS;
     }
 
     void update(int moving_dir = 0)
     {
         static uint32_t lastUpdateTime = 0;
         static size_t step = 0;
+        updateRecovery();
         uint32_t now = micros();
         if (now - lastUpdateTime > SENSOR_UPDATE_PERIOD)
         {
@@ -98,14 +129,25 @@ public:
         if (!members_allocated || i >= NB_SENSORS) {
             return;
         }
+        if (sensors[i]->isBooting()) {
+            // Le capteur est en cours de redmarrage, il sera pris en compte par updateRecovery()
+            sensorsValues[i] = (SensorValue)SENSOR_DEAD;
+            return;
+        }
         uint32_t update_start = millis();
         SensorValue val = sensors[i]->getMeasure();
         uint32_t update_end = millis();
         uint32_t update_duration = update_end - update_start;
         bool needSensorReset = false;
-        if (val != SENSOR_NOT_UPDATED) {
+        if (val == (SensorValue)SENSOR_DEAD) {
+            // Capteur hors service (dmarrage chou) : nouvelle tentative priodique
+            sensorsValues[i] = val;
+            needSensorReset = update_end - recoveryStartTime[i] > TOF_RECOVERY_RETRY_PERIOD;
+        }
+        else if (val != (SensorValue)SENSOR_NOT_UPDATED) {
             sensorsValues[i] = val;
             sensorsLastUpdateTime[i] = update_end;
+            sensorsCaptureTime[i] = micros();
         }
         else if (update_duration > SENSOR_UPDATE_PERIOD) {
             Server.printf_err("SensorsMgr::updateNow(%u) took %ums and failed\n", i, update_duration);
@@ -117,14 +159,31 @@ public:
         }
 
         if (needSensorReset) {
-            Server.printf("Attempting to restart sensor #%u\n", i);
-            sensors[i]->standby();
-            int ret = sensors[i]->powerON();
-            if (ret == EXIT_SUCCESS) {
-                Server.printf("Restarted successfully\n");
+            startRecovery(i);
+        }
+    }
+
+    /* Fait avancer le redmarrage des capteurs en cours de reset, sans bloquer */
+    void updateRecovery()
+    {
+        if (!members_allocated) {
+            return;
+        }
+        for (size_t i = 0; i < NB_SENSORS; i++)
+        {
+            if (!sensors[i]->isBooting()) {
+                continue;
             }
-            else {
-                Server.printf("Restart failed\n");
+            sensors[i]->updatePowerON();
+            if (!sensors[i]->isBooting()) {
+                uint32_t duration = millis() - recoveryStartTime[i];
+                if (sensors[i]->getBootState() == TOF_ON) {
+                    Server.printf("Sensor #%u powered on (%ums)\n", i, duration);
+                    sensorsLastUpdateTime[i] = millis();
+                }
+                else {
+                    Server.printf("Sensor #%u power on failed (%ums)\n", i, duration);
+                }
             }
         }
     }
@@ -145,6 +204,49 @@ public:
         }
     }
 
+    /*
+        Etat de sant des capteurs : pour chaque capteur, son tat de dmarrage
+        (SensorBootState), le nombre de redmarrages et l'ge de la dernire
+        mesure (ms)
+    */
+    void appendHealthToVect(std::vector<uint8_t> & output) const
+    {
+        for (size_t i = 0; i < NB_SENSORS; i++)
+        {
+            uint8_t state = members_allocated ? (uint8_t)sensors[i]->getBootState() : (uint8_t)TOF_FAILED;
+            Serializer::writeEnum(state, output);
+            Serializer::writeUInt(restartCount[i], output);
+            Serializer::writeUInt(getLastUpdateTime(i), output);
+        }
+    }
+
+    /*
+        Trame horodate : pour chaque capteur, la valeur, son ge (s) et la
+        position du robot au moment de la mesure. Sans mesure (captureTime nul),
+        l'ge vaut SENSOR_NO_MEASURE_AGE et la position est la position actuelle.
+    */
+    void appendTimestampedValuesToVect(std::vector<uint8_t> & output,
+        const MotionControlSystem & motionControlSystem, uint32_t now) const
+    {
+        for (size_t i = 0; i < NB_SENSORS; i++)
+        {
+            appendTimestampedValueToVect(sensorsValues[i], sensorsCaptureTime[i],
+                motionControlSystem, now, output);
+        }
+    }
+
+    static void appendTimestampedValueToVect(SensorValue value, uint32_t captureTime,
+        const MotionControlSystem & motionControlSystem, uint32_t now, std::vector<uint8_t> & output)
+    {
+        bool measured = captureTime != 0;
+        Position p = motionControlSystem.getPositionAt(measured ? captureTime : now);
+        Serializer::writeInt(value, output);
+        Serializer::writeUInt(measured ? now - captureTime : SENSOR_NO_MEASURE_AGE, output);
+        Serializer::writeInt((int32_t)p.x, output);
+        Serializer::writeInt((int32_t)p.y, output);
+        Serializer::writeFloat(p.orientation, output);
+    }
+
     size_t printTo(Print& p) const
     {
         size_t ret = 0;
@@ -157,7 +259,11 @@ public:
             ret += p.print(sensors[i]->name);
             ret += p.print("=");
             SensorValue val = sensorsValues[i];
-            if (val == (SensorValue)SENSOR_DEAD)
+            if (sensors[i]->isBooting())
+            {
+                ret += p.print("Boot ");
+            }
+            else if (val == (SensorValue)SENSOR_DEAD)
             {
                 ret += p.print("HS ");
             }
@@ -184,9 +290,30 @@ public:
 private:
     ToF_sensor *sensors[NB_SENSORS];
     SensorValue sensorsValues[NB_SENSORS];
-    uint32_t sensorsLastUpdateTime[NB_SENSORS];
+    uint32_t sensorsLastUpdateTime[NB_SENSORS];   // ms
+    uint32_t sensorsCaptureTime[NB_SENSORS];      // s
+    uint32_t recoveryStartTime[NB_SENSORS];       // ms
+    uint32_t restartCount[NB_SENSORS];
     bool members_allocated;
 
+    static ToF_sensor* newLongRangeSensor(uint8_t address, uint8_t pinStandby, const char *name)
+    {
+        ToF_longRange_med<TOF_LR_MEDIAN_SIZE, Hampel> *sensor = new ToF_longRange_med<TOF_LR_MEDIAN_SIZE, Hampel>(
+            address, pinStandby, TOF_LR_MIN_RANGE, TOF_LR_MAX_RANGE, name, &Serial);
+        if (sensor != nullptr) {
+            sensor->filter().setThreshold(HAMPEL_DEFAULT_THRESHOLD, TOF_LR_HAMPEL_MIN_DEV);
+        }
+        return sensor;
+    }
+
+    void startRecovery(size_t i)
+    {
+        Server.printf("Attempting to restart sensor #%u\n", i);
+        recoveryStartTime[i] = millis();
+        restartCount[i]++;
+        sensors[i]->startPowerON();
+    }
+
     enum Index
     {
         AVG = 0,
@@ -0,0 +1,110 @@
+#ifndef _STEPPER_RAMP_h
+#define _STEPPER_RAMP_h
+
+#include <Arduino.h>
+
+#define STEPPER_RAMP_C0_FACTOR  (0.676)     // Correction du premier intervalle de l'approximation (D. Austin)
+
+
+/*
+    Profil de vitesse trapézoïdal d'un moteur pas à pas, calculé pas par pas
+    (D. Austin, "Generate stepper-motor speed profiles in real time",
+    c(n) = c(n-1) - 2 c(n-1) / (4n + 1), c(0) premier intervalle) :
+    nextStep() donne l'intervalle jusqu'au pas suivant en quelques opérations,
+    sans attente, et peut donc être appelée depuis l'interruption de pas.
+    Unités : micropas, micropas/s, micropas/s², µs.
+*/
+class StepperRamp
+{
+public:
+    StepperRamp(float acceleration, float deceleration) :
+        acceleration(acceleration),
+        deceleration(deceleration)
+    {
+        stop();
+    }
+
+    /* Mouvement de 'steps' micropas depuis l'arrêt, à la vitesse de croisière 'speed' */
+    void start(uint32_t steps, float speed)
+    {
+        if (speed <= 0)
+        {
+            stop();
+            return;
+        }
+        remaining = steps;
+        completed = 0;
+        accelerationSteps = (uint32_t)(speed * speed / (2 * acceleration));
+        decelerationSteps = (uint32_t)(speed * speed / (2 * deceleration));
+        if (accelerationSteps + decelerationSteps > steps)
+        {
+            // La vitesse de croisière n'est pas atteinte
+            accelerationSteps = (uint32_t)(steps * deceleration / (acceleration + deceleration));
+            decelerationSteps = steps - accelerationSteps;
+        }
+        cruiseInterval = 1e6 / speed;
+        interval = 1e6 * STEPPER_RAMP_C0_FACTOR * sqrtf(2 / acceleration);
+        if (interval < cruiseInterval) {
+            interval = cruiseInterval;
+        }
+    }
+
+    void stop()
+    {
+        remaining = 0;
+        completed = 0;
+        accelerationSteps = 0;
+        decelerationSteps = 0;
+        interval = 0;
+        cruiseInterval = 0;
+    }
+
+    /* Un pas vient d'être fait : renvoie l'intervalle jusqu'au suivant (µs), 0 si le mouvement est terminé */
+    uint32_t nextStep()
+    {
+        if (remaining == 0) {
+            return 0;
+        }
+        remaining--;
+        completed++;
+        if (remaining == 0) {
+            return 0;
+        }
+
+        // Le i-ème intervalle vaut c(i-1) en accélération, c(remaining-1) en décélération
+        if (remaining <= decelerationSteps)
+        {
+            interval += 2 * interval / (4 * remaining - 1);
+        }
+        else if (completed <= accelerationSteps)
+        {
+            if (completed > 1) {
+                interval -= 2 * interval / (4 * completed - 3);
+            }
+            if (interval < cruiseInterval) {
+                interval = cruiseInterval;
+            }
+        }
+        else
+        {
+            interval = cruiseInterval;
+        }
+        return interval < 1 ? 1 : (uint32_t)(interval + 0.5f);
+    }
+
+    uint32_t getStepsRemaining() const { return remaining; }
+    uint32_t getStepsCompleted() const { return completed; }
+
+private:
+    const float acceleration;   // micropas/s²
+    const float deceleration;   // micropas/s²
+    uint32_t remaining;
+    uint32_t completed;
+    uint32_t accelerationSteps;
+    uint32_t decelerationSteps;
+    float interval;             // µs, jusqu'au prochain pas
+    float cruiseInterval;       // µs
+};
+
+
+#endif
@@ -0,0 +1,245 @@
+#ifndef _TRAJECTORY_ACTIONS_h
+#define _TRAJECTORY_ACTIONS_h
+
+#include <vector>
+#include "Serializer.h"
+#include "CommunicationServer.h"
+#include "MotionControlSystem.h"
+#include "ActuatorMgr.h"
+#include "OrderImmediate.h"
+#include "OrderSequence.h"
+#include "Singleton.h"
+
+#define TRAJ_ACTIONS_MAX    8
+
+#define TRAJ_ACTION_OK      0
+#define TRAJ_ACTION_INVALID 1
+#define TRAJ_ACTION_FULL    2
+
+
+enum TrajectoryTrigger
+{
+    TRAJ_TRIGGER_INDEX = 0,             // Le point courant de la trajectoire atteint l'indice donné
+    TRAJ_TRIGGER_DISTANCE_TO_END = 1    // La distance restant à parcourir passe sous la valeur donnée (mm)
+};
+
+enum TrajectoryActionType
+{
+    TRAJ_ACTION_ACTUATOR = 0,           // Mouvement de l'actionneur
+    TRAJ_ACTION_IMMEDIATE_ORDER = 1     // Exécution d'un ordre immédiat (sa réponse n'est pas envoyée)
+};
+
+
+/*
+    Actions déclenchées en un point de la trajectoire suivie, pour que
+    l'actionneur (ou tout autre ordre immédiat) se mette en mouvement pendant
+    que le robot roule, au lieu d'attendre la fin de FollowTrajectory.
+    Les actions enregistrées concernent la prochaine trajectoire suivie (ou
+    celle en cours). Celles qui n'ont pas été déclenchées quand le robot
+    cesse de suivre la trajectoire sont abandonnées.
+*/
+class TrajectoryActionMgr : public Singleton<TrajectoryActionMgr>
+{
+public:
+    TrajectoryActionMgr() :
+        motionControlSystem(MotionControlSystem::Instance()),
+        actuatorMgr(ActuatorMgr::Instance())
+    {
+        orderProvider = (OrderProvider*)NULL;
+        wasMoving = false;
+    }
+
+    void setOrderProvider(OrderProvider * provider)
+    {
+        orderProvider = provider;
+    }
+
+    /*
+        Lecture d'une action : déclencheur (Enum), valeur (int), type (Enum), puis
+        - actionneur : mode (Enum, 0: à la suite, 1: préemption) et point de passage
+          (y, z, theta en float, vitesses y, z, theta en int)
+        - ordre immédiat : ID de l'ordre (Enum) et ses arguments
+    */
+    uint8_t add(const std::vector<uint8_t> & input)
+    {
+        if (input.size() < 7) {
+            return TRAJ_ACTION_INVALID;
+        }
+        if (actions.size() >= TRAJ_ACTIONS_MAX) {
+            return TRAJ_ACTION_FULL;
+        }
+
+        TrajectoryAction action;
+        size_t index = 0;
+        action.trigger = (TrajectoryTrigger)Serializer::readEnum(input, index);
+        action.value = Serializer::readInt(input, index);
+        action.type = (TrajectoryActionType)Serializer::readEnum(input, index);
+        if (action.trigger != TRAJ_TRIGGER_INDEX && action.trigger != TRAJ_TRIGGER_DISTANCE_TO_END) {
+            return TRAJ_ACTION_INVALID;
+        }
+
+        if (action.type == TRAJ_ACTION_ACTUATOR)
+        {
+            if (input.size() != index + 25) {
+                return TRAJ_ACTION_INVALID;
+            }
+            action.preempt = Serializer::readEnum(input, index) != 0;
+            action.waypoint.position.y = Serializer::readFloat(input, index);
+            action.waypoint.position.z = Serializer::readFloat(input, index);
+            action.waypoint.position.theta = Serializer::readFloat(input, index);
+            action.waypoint.y_speed = Serializer::readInt(input, index);
+            action.waypoint.z_speed = Serializer::readInt(input, index);
+            action.waypoint.theta_speed = Serializer::readInt(input, index);
+        }
+        else if (action.type == TRAJ_ACTION_IMMEDIATE_ORDER)
+        {
+            action.orderId = Serializer::readEnum(input, index);
+            if (orderProvider == NULL || orderProvider->getImmediateOrder(action.orderId) == NULL) {
+                return TRAJ_ACTION_INVALID;
+            }
+            action.args.assign(input.begin() + index, input.end());
+        }
+        else
+        {
+            return TRAJ_ACTION_INVALID;
+        }
+
+        actions.push_back(action);
+        return TRAJ_ACTION_OK;
+    }
+
+    void clear()
+    {
+        actions.clear();
+    }
+
+    size_t size() const
+    {
+        return actions.size();
+    }
+
+    /* A appeler à chaque itération de la boucle principale */
+    void update()
+    {
+        bool moving = motionControlSystem.isMovingToDestination();
+        if (!moving)
+        {
+            if (wasMoving && actions.size() > 0)
+            {
+                Server.printf(SPY_ORDER, "%u trajectory action(s) dropped", actions.size());
+                actions.clear();
+            }
+            wasMoving = false;
+            return;
+        }
+        wasMoving = true;
+
+        size_t trajectoryIndex = motionControlSystem.getTrajectoryIndex();
+        float distanceToEnd;
+        bool endKnown = motionControlSystem.getDistanceToEnd(distanceToEnd);
+
+        size_t i = 0;
+        while (i < actions.size())
+        {
+            const TrajectoryAction & action = actions.at(i);
+            bool due;
+            if (action.trigger == TRAJ_TRIGGER_INDEX) {
+                due = (int32_t)trajectoryIndex >= action.value;
+            }
+            else {
+                due = endKnown && distanceToEnd <= action.value;
+            }
+
+            if (due)
+            {
+                // L'action est retirée avant son exécution, un ordre immédiat pouvant modifier la liste
+                TrajectoryAction dueAction = action;
+                actions.erase(actions.begin() + i);
+                fire(dueAction, trajectoryIndex);
+            }
+            else
+            {
+                i++;
+            }
+        }
+    }
+
+private:
+    struct TrajectoryAction
+    {
+        TrajectoryTrigger trigger;
+        int32_t value;                  // Indice du point, ou distance (mm)
+        TrajectoryActionType type;
+        bool preempt;
+        ActuatorWaypoint waypoint;
+        uint8_t orderId;
+        std::vector<uint8_t> args;
+    };
+
+    void fire(TrajectoryAction & action, size_t trajectoryIndex)
+    {
+        if (action.type == TRAJ_ACTION_ACTUATOR)
+        {
+            Server.printf(SPY_ORDER, "Trajectory action (index %u): actuator", trajectoryIndex);
+            ActuatorErrorCode err = actuatorMgr.queueWaypoints(&action.waypoint, 1, action.preempt);
+            if (err != ACT_OK) {
+                Server.printf_err("Trajectory action: actuator error %u\n", err);
+            }
+        }
+        else
+        {
+            Server.printf(SPY_ORDER, "Trajectory action (index %u): order %u", trajectoryIndex, action.orderId);
+            OrderImmediate* order = orderProvider->getImmediateOrder(action.orderId);
+            if (order != NULL) {
+                order->execute(action.args);
+            }
+        }
+    }
+
+    MotionControlSystem & motionControlSystem;
+    ActuatorMgr & actuatorMgr;
+    OrderProvider* orderProvider;
+    std::vector<TrajectoryAction> actions;
+    bool wasMoving;     // Le robot suivait une trajectoire lors de la dernière mise à jour
+};
+
+
+class AddTrajectoryAction : public OrderImmediate, public Singleton<AddTrajectoryAction>
+{
+public:
+    AddTrajectoryAction() {}
+    virtual void execute(std::vector<uint8_t> & io)
+    {
+        uint8_t ret = TrajectoryActionMgr::Instance().add(io);
+        if (ret == TRAJ_ACTION_OK) {
+            Server.printf(SPY_ORDER, "AddTrajectoryAction");
+        }
+        else {
+            Server.printf_err("AddTrajectoryAction: error %u\n", ret);
+        }
+        io.clear();
+        Serializer::writeEnum(ret, io);
+    }
+};
+
+class ClearTrajectoryActions : public OrderImmediate, public Singleton<ClearTrajectoryActions>
+{
+public:
+    ClearTrajectoryActions() {}
+    virtual void execute(std::vector<uint8_t> & io)
+    {
+        if (io.size() == 0)
+        {
+            Server.printf(SPY_ORDER, "ClearTrajectoryActions");
+            TrajectoryActionMgr::Instance().clear();
+        }
+        else
+        {
+            Server.printf_err("ClearTrajectoryActions: wrong number of arguments\n");
+            io.clear();
+        }
+    }
+};
+
+
+#endif
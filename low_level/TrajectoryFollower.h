@@ -17,6 +17,7 @@
 #define TIMEOUT_MOVE_INIT		1000		// Dure maximale le la phase "MOVE_INIT" d'une trajectoire. Unit : ms
 #define INFINITE_DISTANCE		INT32_MAX
 #define PARKING_MAX_SPEED       500         // mm/s (vitesse max en mode asservissement sur place)
+#define HOLD_DISTANCE_TOLERANCE 20          // Distance restant  parcourir en dessous de laquelle un arrt en attente de points n'est pas un blocage. Unit : mm
 
 
 class TrajectoryFollower
@@ -43,6 +44,10 @@ public:
         setMotionControlLevel(4);
         curvatureOrder = 0;
         currentMovingSpeed = 0;
+        speedScale = 1;
+        lastSpeedSetPoint = 0;
+        waitingForPoints = false;
+        holding = false;
         enableParkingBreak(false);
         updateTunings();
 	}
@@ -104,6 +109,12 @@ public:
 				movingSpeedSetPoint = ABS(maxMovingSpeed);
 			}
 
+			// Vitesse impose par l'horaire de la trajectoire
+			if (scheduledSpeed > 0 && movingSpeedSetPoint > scheduledSpeed)
+			{
+				movingSpeedSetPoint = scheduledSpeed;
+			}
+
 			// Limitation de l'acclration et de la dclration
 			if ((movingSpeedSetPoint - previousMovingSpeedSetpoint) * freqAsserv > maxAcceleration)
 			{
@@ -223,6 +234,7 @@ public:
 		if (movePhase == MOVE_ENDED)
 		{
 			movePhase = MOVE_INIT;
+            holding = false;
             moveInitTimer = millis();
 		}
 		else
@@ -251,8 +263,62 @@ public:
         return currentMovingSpeed;
     }
 
+    /*
+        Indique que la distance  parcourir s'arrte au dernier point reu de la
+        trajectoire (mode streaming) : s'arrter  cette distance n'est pas un blocage
+    */
+    void setWaitingForPoints(bool waiting)
+    {
+        waitingForPoints = waiting;
+    }
+
+    /* Le mouvement s'est termin par un arrt voulu hors d'un point d'arrt, il peut tre repris sur le mme point */
+    bool isHolding() const
+    {
+        return movePhase == MOVE_ENDED && holding;
+    }
+
+    /* Vitesse permettant d'arriver  l'heure au prochain point planifi (0 : pas de contrainte). Unit : mm/s */
+    void setScheduledSpeed(float speed)
+    {
+        if (speed > 0 && speed < minAimSpeed)
+        {
+            speed = minAimSpeed;
+        }
+        scheduledSpeed = speed;
+    }
+
+    float getMaxMovingSpeed() const
+    {
+        return maxMovingSpeed;
+    }
+
+    /*
+        Facteur appliqu  la vitesse maximale, pris en compte ds la prochaine priode d'asservissement (entre 0 et 1).
+        0 met le mouvement en pause : le robot s'arrte sans erreur et repart quand le facteur redevient positif.
+        Le facteur est conserv d'un mouvement  l'autre.
+    */
+    void setSpeedScale(float scale)
+    {
+        if (scale < 0) {
+            scale = 0;
+        }
+        else if (scale > 1) {
+            scale = 1;
+        }
+        noInterrupts();
+        speedScale = scale;
+        interrupts();
+    }
+
+    float getSpeedScale() const
+    {
+        return speedScale;
+    }
+
     void emergency_stop_from_interrupt()
     {
+        holding = false;
         if (movePhase != MOVE_ENDED)
         {
             if (translationControlled)
@@ -406,6 +472,7 @@ private:
 		movingSpeedSetPoint = 0;
 		previousMovingSpeedSetpoint = 0;
         maxMovingSpeed = parkingMaxMovingSpeed;
+        scheduledSpeed = 0;
         motor.run(0);
 		translationPID.resetIntegralError();
 		translationPID.resetDerivativeError();
@@ -421,7 +488,11 @@ private:
                 if (movePhase == MOVING)
                 {
                     movePhase = MOVE_ENDED;
-                    if (trajectoryControlled && !trajectoryPoint.isStopPoint())
+                    if (trajectoryControlled && isHoldRequested())
+                    {
+                        holding = true;
+                    }
+                    else if (trajectoryControlled && !trajectoryPoint.isStopPoint())
                     {
                         moveStatus |= EXT_BLOCKED;
                         Server.asynchronous_trace(__LINE__);
@@ -437,6 +508,13 @@ private:
         }
 	}
 
+    /* Arrt voulu : pause (facteur d'chelle nul), ou distance  parcourir jusqu'au dernier point reu atteinte */
+    bool isHoldRequested() const
+    {
+        return speedScale == 0 ||
+            (waitingForPoints && translationSetPoint - currentTranslation < HOLD_DISTANCE_TOLERANCE);
+    }
+
 	void checkPosition()
 	{
 		if (movePhase == MOVING && trajectoryControlled)
@@ -476,19 +554,38 @@ private:
             movingSpeedSetPoint = -ABS(maxMovingSpeed);
         }
 
-        if (ABS(movingSpeedSetPoint) < stoppedSpeed)
+        // Facteur d'chelle global (hors frein de parking) : la consigne rejoint la vitesse rduite sans dpasser la dclration maximale
+        float scaledMaxSpeed = ABS(maxMovingSpeed) * speedScale;
+        if (movePhase == MOVING && ABS(movingSpeedSetPoint) > scaledMaxSpeed)
         {
+            float limit = MAX(scaledMaxSpeed, lastSpeedSetPoint - maxDeceleration / freqAsserv);
+            if (ABS(movingSpeedSetPoint) > limit)
+            {
+                movingSpeedSetPoint = movingSpeedSetPoint > 0 ? limit : -limit;
+                if (previousMovingSpeedSetpoint > limit) {
+                    previousMovingSpeedSetpoint = limit;    // L'acclration reprend depuis la vitesse rduite
+                }
+            }
+        }
+
+        // La vitesse rduite par le facteur d'chelle peut tre infrieure  minAimSpeed
+        float minSpeed = movePhase == MOVING ? MIN(minAimSpeed, scaledMaxSpeed) : minAimSpeed;
+        if (ABS(movingSpeedSetPoint) < stoppedSpeed ||
+            (movePhase == MOVING && speedScale == 0 && ABS(movingSpeedSetPoint) < minAimSpeed))
+        {
+            // En pause, la consigne passe  0 ds qu'elle est sous minAimSpeed pour que le robot s'arrte
             movingSpeedSetPoint = 0;
         }
-        else if (ABS(movingSpeedSetPoint) < minAimSpeed)
+        else if (ABS(movingSpeedSetPoint) < minSpeed)
         {
             if (movingSpeedSetPoint > 0) {
-                movingSpeedSetPoint = minAimSpeed;
+                movingSpeedSetPoint = minSpeed;
             }
             else {
-                movingSpeedSetPoint = -minAimSpeed;
+                movingSpeedSetPoint = -minSpeed;
             }
         }
+        lastSpeedSetPoint = ABS(movingSpeedSetPoint);
     }
 
     void updateTunings()
@@ -543,6 +640,21 @@ private:
 	/* Vitesse (algbrique) de translation maximale : une vitesse ngative correspond  une marche arrire */
 	float maxMovingSpeed;				// (mm/s)
 
+    /* Vitesse impose par l'horaire de la trajectoire, infrieure  maxMovingSpeed (vaut 0 si aucun horaire) */
+    float scheduledSpeed;               // (mm/s)
+
+    /* Facteur (entre 0 et 1) appliqu  la vitesse maximale, pour ralentir sans modifier la trajectoire */
+    volatile float speedScale;
+
+    /* Dernire consigne de vitesse envoye aux moteurs, pour limiter la dclration due  speedScale */
+    float lastSpeedSetPoint;            // (mm/s)
+
+    /* Mode streaming : la distance  parcourir s'arrte au dernier point reu */
+    volatile bool waitingForPoints;
+
+    /* Le dernier mouvement s'est termin par un arrt voulu (voir isHoldRequested) */
+    volatile bool holding;
+
     /* Acclrations maximale (variation maximale de movingSpeedSetpoint) */
     float maxAcceleration;              // (mm*s^-2)
     float maxDeceleration;              // (mm*s^-2)
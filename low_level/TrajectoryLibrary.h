@@ -0,0 +1,359 @@
+#ifndef _TRAJECTORY_LIBRARY_h
+#define _TRAJECTORY_LIBRARY_h
+
+#include <Arduino.h>
+#include <SD.h>
+#include <vector>
+#include "Serializer.h"
+#include "CommunicationServer.h"
+#include "MotionControlSystem.h"
+#include "TrajectoryPoint.h"
+#include "Singleton.h"
+
+#define TRAJ_LIB_MAX_ID         32      // Nombre de trajectoires pouvant être enregistrées
+#define TRAJ_LIB_MAX_POINTS     256     // Nombre maximal de points par trajectoire
+#define TRAJ_LIB_CACHE_SIZE     2       // Nombre de trajectoires gardées en RAM
+#define TRAJ_LIB_POINT_SIZE     22      // octets (format de AppendToTraj)
+#define TRAJ_LIB_ANY_ID         0xFF    // Recherche par hash uniquement
+
+enum TrajectoryLibraryStatus
+{
+    TRAJ_LIB_OK = 0,
+    TRAJ_LIB_UNKNOWN = 1,           // Aucune trajectoire enregistrée sous cet ID (ou avec ce hash)
+    TRAJ_LIB_HASH_MISMATCH = 2,     // La trajectoire enregistrée n'a pas le hash attendu
+    TRAJ_LIB_INVALID = 3,           // Trajectoire mal formée, trop longue, ou ID invalide
+    TRAJ_LIB_STORAGE_ERROR = 4,     // Carte SD absente ou erreur d'écriture
+    TRAJ_LIB_EDITION_FAILURE = 5    // La trajectoire courante n'accepte pas les points
+};
+
+
+/*
+    Trajectoires enregistrées sur la carte SD, pour éviter d'envoyer point par
+    point les chemins connus à l'avance. Chaque trajectoire est identifiée par
+    un ID et par le hash (FNV-1a) de son contenu : le haut niveau peut lancer
+    une trajectoire dont il connaît le hash sans la renvoyer.
+    Fichier "TRAJxx.BIN" : hash (4 octets), puis les points au format de AppendToTraj.
+    Les trajectoires récemment utilisées restent en RAM.
+    Accès à la carte SD bloquants : l'initialisation (montage et lecture des
+    32 en-têtes, quelques dizaines d'ms) est faite par le BootMgr depuis la
+    boucle principale, un en-tête par appel de initStep() ; l'enregistrement d'une
+    trajectoire écrit son fichier immédiatement (quelques dizaines d'ms), il
+    est donc à faire avant le match ; le chargement d'une trajectoire absente
+    du cache lit son fichier (quelques ms).
+*/
+class TrajectoryLibrary : public Singleton<TrajectoryLibrary>
+{
+public:
+    TrajectoryLibrary() :
+        motionControlSystem(MotionControlSystem::Instance())
+    {
+        mounted = false;
+        nextHeader = 0;
+        sdAvailable = false;
+        useCounter = 0;
+        for (size_t i = 0; i < TRAJ_LIB_MAX_ID; i++) {
+            storedHash[i] = 0;
+        }
+        for (size_t i = 0; i < TRAJ_LIB_CACHE_SIZE; i++) {
+            cache[i].id = TRAJ_LIB_ANY_ID;
+            cache[i].hash = 0;
+            cache[i].lastUse = 0;
+        }
+        uploadId = TRAJ_LIB_ANY_ID;
+    }
+
+    /*
+        Réception d'une partie de la trajectoire 'id'. 'reset' indique le
+        début d'une nouvelle trajectoire. Elle est enregistrée dès que le point
+        de fin de trajectoire est reçu, 'hash' vaut alors son hash (0 sinon).
+    */
+    TrajectoryLibraryStatus store(uint8_t id, bool reset, std::vector<uint8_t> const & points, size_t start, uint32_t & hash)
+    {
+        hash = 0;
+        if (id >= TRAJ_LIB_MAX_ID || (points.size() - start) % TRAJ_LIB_POINT_SIZE != 0) {
+            return TRAJ_LIB_INVALID;
+        }
+        if (reset || id != uploadId)
+        {
+            uploadId = id;
+            uploadBuffer.clear();
+        }
+        if (uploadBuffer.size() + points.size() - start > TRAJ_LIB_MAX_POINTS * TRAJ_LIB_POINT_SIZE)
+        {
+            uploadId = TRAJ_LIB_ANY_ID;
+            uploadBuffer.clear();
+            return TRAJ_LIB_INVALID;
+        }
+        uploadBuffer.insert(uploadBuffer.end(), points.begin() + start, points.end());
+        if (uploadBuffer.empty() || !isEndOfTrajectory(uploadBuffer, uploadBuffer.size() - TRAJ_LIB_POINT_SIZE)) {
+            return TRAJ_LIB_OK;
+        }
+
+        hash = computeHash(uploadBuffer);
+        TrajectoryLibraryStatus ret = writeFile(id, hash, uploadBuffer);
+        if (ret == TRAJ_LIB_OK)
+        {
+            storedHash[id] = hash;
+            CacheEntry & entry = findCacheSlot(id);
+            entry.id = id;
+            entry.hash = hash;
+            entry.points.swap(uploadBuffer);
+            entry.lastUse = ++useCounter;
+        }
+        uploadId = TRAJ_LIB_ANY_ID;
+        uploadBuffer.clear();
+        return ret;
+    }
+
+    /*
+        Ajout de la trajectoire enregistrée à la trajectoire courante.
+        Recherche par ID (et vérification du hash s'il est non nul), ou par hash si id vaut TRAJ_LIB_ANY_ID.
+    */
+    TrajectoryLibraryStatus load(uint8_t id, uint32_t expectedHash, uint32_t & hash)
+    {
+        hash = 0;
+        CacheEntry *entry = NULL;
+        TrajectoryLibraryStatus ret = lookup(id, expectedHash, entry);
+        if (ret != TRAJ_LIB_OK) {
+            return ret;
+        }
+        hash = entry->hash;
+        entry->lastUse = ++useCounter;
+
+        std::vector<uint8_t> const & points = entry->points;
+        for (size_t i = 0; i < points.size(); i += TRAJ_LIB_POINT_SIZE)
+        {
+            if (motionControlSystem.appendToTrajectory(readPoint(points, i)) != TRAJECTORY_EDITION_SUCCESS)
+            {
+                motionControlSystem.stop_and_clear_trajectory();
+                return TRAJ_LIB_EDITION_FAILURE;
+            }
+        }
+        return TRAJ_LIB_OK;
+    }
+
+    /* Montage de la carte SD et lecture des hash des trajectoires enregistrées. Renvoie false sans carte SD. */
+    /* Termine l'initialisation d'un bloc (quelques dizaines d'ms) */
+    bool init()
+    {
+        while (!initDone()) {
+            initStep();
+        }
+        return sdAvailable;
+    }
+
+    /*
+        Une étape de l'initialisation, de quelques ms au plus : le montage de la
+        carte SD au premier appel, puis la lecture d'un en-tête par appel.
+        La bibliothèque n'est utilisable qu'une fois tous les en-têtes lus.
+    */
+    void initStep()
+    {
+        if (initDone()) {
+            return;
+        }
+        if (!mounted)
+        {
+            mounted = true;
+            if (!SD.begin(BUILTIN_SDCARD))
+            {
+                Server.printf_err("TrajectoryLibrary: no SD card\n");
+                nextHeader = TRAJ_LIB_MAX_ID;
+            }
+            return;
+        }
+        char name[16];
+        fileName(nextHeader, name);
+        File file = SD.open(name, FILE_READ);
+        if (file)
+        {
+            uint8_t header[4];
+            if (file.read(header, 4) == 4) {
+                storedHash[nextHeader] = header[0] | (header[1] << 8) | (header[2] << 16) | ((uint32_t)header[3] << 24);
+            }
+            file.close();
+        }
+        nextHeader++;
+        sdAvailable = nextHeader == TRAJ_LIB_MAX_ID;
+    }
+
+    bool initDone() const { return mounted && nextHeader >= TRAJ_LIB_MAX_ID; }
+    bool isAvailable() const { return sdAvailable; }
+
+    static TrajectoryPoint readPoint(std::vector<uint8_t> const & data, size_t index)
+    {
+        int32_t x = Serializer::readInt(data, index);
+        int32_t y = Serializer::readInt(data, index);
+        float angle = Serializer::readFloat(data, index);
+        float curvature = Serializer::readFloat(data, index);
+        float speed = Serializer::readFloat(data, index);
+        bool stopPoint = Serializer::readBool(data, index);
+        bool endOfTraj = Serializer::readBool(data, index);
+        Position p((float)x, (float)y, angle);
+        return TrajectoryPoint(p, curvature, speed, stopPoint, endOfTraj);
+    }
+
+private:
+    struct CacheEntry
+    {
+        uint8_t id;
+        uint32_t hash;
+        std::vector<uint8_t> points;
+        uint32_t lastUse;
+    };
+
+    TrajectoryLibraryStatus lookup(uint8_t id, uint32_t expectedHash, CacheEntry* & entry)
+    {
+        init();
+        if (id == TRAJ_LIB_ANY_ID)
+        {
+            if (expectedHash == 0) {
+                return TRAJ_LIB_INVALID;
+            }
+            for (size_t i = 0; i < TRAJ_LIB_MAX_ID; i++)
+            {
+                if (storedHash[i] == expectedHash)
+                {
+                    id = i;
+                    break;
+                }
+            }
+            if (id == TRAJ_LIB_ANY_ID) {
+                return TRAJ_LIB_UNKNOWN;
+            }
+        }
+        else if (id >= TRAJ_LIB_MAX_ID) {
+            return TRAJ_LIB_INVALID;
+        }
+
+        if (storedHash[id] == 0) {
+            return TRAJ_LIB_UNKNOWN;
+        }
+        if (expectedHash != 0 && storedHash[id] != expectedHash) {
+            return TRAJ_LIB_HASH_MISMATCH;
+        }
+
+        for (size_t i = 0; i < TRAJ_LIB_CACHE_SIZE; i++)
+        {
+            if (cache[i].id == id && cache[i].hash == storedHash[id])
+            {
+                entry = &cache[i];
+                return TRAJ_LIB_OK;
+            }
+        }
+
+        CacheEntry & slot = findCacheSlot(id);
+        TrajectoryLibraryStatus ret = readFile(id, slot);
+        if (ret == TRAJ_LIB_OK) {
+            entry = &slot;
+        }
+        return ret;
+    }
+
+    TrajectoryLibraryStatus writeFile(uint8_t id, uint32_t hash, std::vector<uint8_t> const & points)
+    {
+        init();
+        if (!sdAvailable) {
+            return TRAJ_LIB_STORAGE_ERROR;
+        }
+        char name[16];
+        fileName(id, name);
+        SD.remove(name);
+        storedHash[id] = 0;
+        File file = SD.open(name, FILE_WRITE);
+        if (!file) {
+            return TRAJ_LIB_STORAGE_ERROR;
+        }
+        std::vector<uint8_t> header;
+        Serializer::writeInt((int32_t)hash, header);    // writeUInt tronquerait les hash >= 2^31
+        bool success = file.write(header.data(), header.size()) == header.size() &&
+            file.write(points.data(), points.size()) == points.size();
+        file.close();
+        if (!success)
+        {
+            SD.remove(name);
+            return TRAJ_LIB_STORAGE_ERROR;
+        }
+        return TRAJ_LIB_OK;
+    }
+
+    TrajectoryLibraryStatus readFile(uint8_t id, CacheEntry & entry)
+    {
+        if (!sdAvailable) {
+            return TRAJ_LIB_STORAGE_ERROR;
+        }
+        char name[16];
+        fileName(id, name);
+        File file = SD.open(name, FILE_READ);
+        if (!file) {
+            return TRAJ_LIB_STORAGE_ERROR;
+        }
+        size_t size = file.size();
+        entry.id = TRAJ_LIB_ANY_ID;
+        entry.points.resize(size > 4 ? size - 4 : 0);
+        uint8_t header[4];
+        bool success = size > 4 && (size - 4) % TRAJ_LIB_POINT_SIZE == 0 &&
+            file.read(header, 4) == 4 &&
+            file.read(entry.points.data(), entry.points.size()) == (int)entry.points.size();
+        file.close();
+        if (!success || computeHash(entry.points) != storedHash[id])
+        {
+            entry.points.clear();
+            return TRAJ_LIB_STORAGE_ERROR;
+        }
+        entry.id = id;
+        entry.hash = storedHash[id];
+        return TRAJ_LIB_OK;
+    }
+
+    /* Emplacement de la trajectoire 'id' si elle est en cache, sinon le moins récemment utilisé */
+    CacheEntry & findCacheSlot(uint8_t id)
+    {
+        size_t oldest = 0;
+        for (size_t i = 0; i < TRAJ_LIB_CACHE_SIZE; i++)
+        {
+            if (cache[i].id == id) {
+                return cache[i];
+            }
+            if (cache[i].lastUse < cache[oldest].lastUse) {
+                oldest = i;
+            }
+        }
+        return cache[oldest];
+    }
+
+    static bool isEndOfTrajectory(std::vector<uint8_t> const & points, size_t index)
+    {
+        return points.at(index + TRAJ_LIB_POINT_SIZE - 1) != 0;
+    }
+
+    /* FNV-1a, 32 bits (0 est réservé à "pas de hash") */
+    static uint32_t computeHash(std::vector<uint8_t> const & data)
+    {
+        uint32_t hash = 2166136261UL;
+        for (size_t i = 0; i < data.size(); i++)
+        {
+            hash ^= data[i];
+            hash *= 16777619UL;
+        }
+        return hash != 0 ? hash : 1;
+    }
+
+    static void fileName(size_t id, char *name)
+    {
+        snprintf(name, 16, "TRAJ%02u.BIN", (unsigned)id);
+    }
+
+    MotionControlSystem & motionControlSystem;
+    bool mounted;
+    size_t nextHeader;                      // Prochain en-tête à lire pendant l'initialisation
+    bool sdAvailable;
+    uint32_t storedHash[TRAJ_LIB_MAX_ID];   // 0 : pas de trajectoire enregistrée
+    CacheEntry cache[TRAJ_LIB_CACHE_SIZE];
+    uint32_t useCounter;
+    uint8_t uploadId;                       // Trajectoire en cours de réception
+    std::vector<uint8_t> uploadBuffer;
+};
+
+
+#endif
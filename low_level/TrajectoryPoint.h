@@ -14,15 +14,17 @@ public:
 		endOfTrajectory = true;
 		curvature = 0;
 		algebricMaxSpeed = 0;
+		arrivalTime = 0;
 	}
 
-	TrajectoryPoint(const Position & aPos, float aCurvature, float aSpeed, bool isStopPoint, bool isEndOfTraj)
+	TrajectoryPoint(const Position & aPos, float aCurvature, float aSpeed, bool isStopPoint, bool isEndOfTraj, uint32_t anArrivalTime = 0)
 	{
 		position = aPos;
 		curvature = aCurvature;
 		algebricMaxSpeed = aSpeed;
 		stopPoint = isStopPoint;
 		endOfTrajectory = isEndOfTraj;
+		arrivalTime = anArrivalTime;
 	}
 
 	Position getPosition() const
@@ -50,6 +52,16 @@ public:
 		return algebricMaxSpeed;
 	}
 
+	bool isScheduled() const
+	{
+		return arrivalTime != 0;
+	}
+
+	uint32_t getArrivalTime() const
+	{
+		return arrivalTime;
+	}
+
 	size_t printTo(Print& p) const
 	{
 		size_t count = 0;
@@ -64,6 +76,7 @@ private:
 	bool endOfTrajectory;
 	float curvature; // m^-1
 	float algebricMaxSpeed; // mm/s
+	uint32_t arrivalTime; // ms, depuis le dbut du suivi de la trajectoire (0 : pas d'horaire)
 };
 
 
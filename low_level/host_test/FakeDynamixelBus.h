@@ -0,0 +1,226 @@
+#ifndef FAKE_DYNAMIXEL_BUS_h
+#define FAKE_DYNAMIXEL_BUS_h
+
+#include <Arduino.h>
+#include <deque>
+#include <vector>
+
+#define FAKE_DYN_NB_REGISTERS   50
+#define FAKE_DYN_BYTE_DURATION  10      // µs (1 Mbaud)
+
+
+/*
+    Host stand-in for a half-duplex AX12 bus (protocol 1.0) on a single-wire
+    UART. It models what matters to DynamixelTransport:
+    - a byte written while the UART is in read mode never reaches the bus,
+    - the UART receives the echo of every byte it sends,
+    - a servo answers READ and WRITE after its return delay, a status packet
+      sent while the UART is still in write mode is lost,
+    - SYNC_WRITE and broadcast packets are not answered.
+    Time only moves through host_clock_us (host_advance_clock() also fires the
+    transport's timer): available() delivers the bytes received up to now,
+    flush() waits for the end of the transmission.
+*/
+class FakeDynamixelBus : public Stream
+{
+public:
+    FakeDynamixelBus(volatile uint8_t *direction_register, uint8_t direction_mask) :
+        direction_register(direction_register), direction_mask(direction_mask)
+    {
+        lostBytes = 0;
+        lostAnswers = 0;
+        txEndTime = 0;
+    }
+
+    void addServo(uint8_t id, uint32_t returnDelay)
+    {
+        Servo s;
+        s.id = id;
+        s.returnDelay = returnDelay;
+        memset(s.registers, 0, sizeof(s.registers));
+        servos.push_back(s);
+    }
+
+    uint8_t *registers(uint8_t id)
+    {
+        Servo *s = findServo(id);
+        return s != nullptr ? s->registers : nullptr;
+    }
+
+    /* Bytes written while the UART was in read mode */
+    size_t lostBytes;
+    /* Status packets sent while the UART was still in write mode */
+    size_t lostAnswers;
+
+    size_t write(uint8_t b)
+    {
+        if (!writeMode()) {
+            lostBytes++;
+            return 1;
+        }
+        txEndTime = max(txEndTime, host_clock_us) + FAKE_DYN_BYTE_DURATION;
+        schedule(b, txEndTime);    // Echo
+        instruction.push_back(b);
+        parseInstruction();
+        return 1;
+    }
+
+    void flush()
+    {
+        if (txEndTime > host_clock_us) {
+            host_clock_us = txEndTime;
+        }
+    }
+
+    int available()
+    {
+        deliver();
+        return (int)received.size();
+    }
+
+    int read()
+    {
+        deliver();
+        if (received.empty()) {
+            return -1;
+        }
+        uint8_t b = received.front();
+        received.pop_front();
+        return b;
+    }
+
+    int peek()
+    {
+        deliver();
+        return received.empty() ? -1 : received.front();
+    }
+
+private:
+    struct Servo
+    {
+        uint8_t id;
+        uint32_t returnDelay;   // µs
+        uint8_t registers[FAKE_DYN_NB_REGISTERS];
+    };
+
+    struct Pending
+    {
+        uint8_t byte;
+        uint32_t time;          // µs, reception by the UART
+        bool answer;            // Sent by a servo (lost if the UART is in write mode)
+    };
+
+    bool writeMode() const
+    {
+        return (*direction_register & direction_mask) != 0;
+    }
+
+    Servo *findServo(uint8_t id)
+    {
+        for (size_t i = 0; i < servos.size(); i++) {
+            if (servos[i].id == id) {
+                return &servos[i];
+            }
+        }
+        return nullptr;
+    }
+
+    void schedule(uint8_t b, uint32_t time, bool answer = false)
+    {
+        Pending p = { b, time, answer };
+        pending.push_back(p);
+    }
+
+    void deliver()
+    {
+        while (!pending.empty() && (int32_t)(host_clock_us - pending.front().time) >= 0)
+        {
+            Pending p = pending.front();
+            pending.pop_front();
+            if (p.answer && writeMode()) {
+                lostAnswers++;
+            }
+            else {
+                received.push_back(p.byte);
+            }
+        }
+    }
+
+    void parseInstruction()
+    {
+        while (instruction.size() >= 2 && (instruction[0] != 0xFF || instruction[1] != 0xFF)) {
+            instruction.erase(instruction.begin());
+        }
+        if (instruction.size() < 4 || instruction.size() < (size_t)instruction[3] + 4) {
+            return;
+        }
+        std::vector<uint8_t> packet(instruction.begin(), instruction.begin() + instruction[3] + 4);
+        instruction.erase(instruction.begin(), instruction.begin() + packet.size());
+        execute(packet);
+    }
+
+    void execute(const std::vector<uint8_t> & packet)
+    {
+        uint8_t id = packet[2];
+        uint8_t instr = packet[4];
+        if (instr == 0x83) // SYNC_WRITE
+        {
+            uint8_t address = packet[5];
+            uint8_t length = packet[6];
+            for (size_t i = 7; i + length + 1 < packet.size(); i += length + 1)
+            {
+                Servo *s = findServo(packet[i]);
+                if (s != nullptr) {
+                    memcpy(s->registers + address, &packet[i + 1], length);
+                }
+            }
+            return;
+        }
+        Servo *s = findServo(id);
+        if (s == nullptr) {
+            return;
+        }
+        std::vector<uint8_t> params;
+        if (instr == 0x02) // READ
+        {
+            params.assign(s->registers + packet[5], s->registers + packet[5] + packet[6]);
+        }
+        else if (instr == 0x03) // WRITE
+        {
+            memcpy(s->registers + packet[5], &packet[6], packet[3] - 3);
+        }
+        answer(*s, params);
+    }
+
+    void answer(const Servo & s, const std::vector<uint8_t> & params)
+    {
+        std::vector<uint8_t> status;
+        status.push_back(0xFF);
+        status.push_back(0xFF);
+        status.push_back(s.id);
+        status.push_back(params.size() + 2);
+        status.push_back(0);
+        status.insert(status.end(), params.begin(), params.end());
+        uint8_t sum = 0;
+        for (size_t i = 2; i < status.size(); i++) {
+            sum += status[i];
+        }
+        status.push_back(~sum);
+        uint32_t t = txEndTime + s.returnDelay;
+        for (size_t i = 0; i < status.size(); i++) {
+            t += FAKE_DYN_BYTE_DURATION;
+            schedule(status[i], t, true);
+        }
+    }
+
+    volatile uint8_t *direction_register;
+    uint8_t direction_mask;
+    std::vector<Servo> servos;
+    std::vector<uint8_t> instruction;
+    std::deque<Pending> pending;
+    std::deque<uint8_t> received;
+    uint32_t txEndTime;         // µs, end of the transmission in progress
+};
+
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef HOST_TEST_h
+#define HOST_TEST_h
+
+#include <stdio.h>
+
+/* Minimal checks for the host tests: failures are counted and reported by main() */
+
+extern int host_test_failures;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            host_test_failures++; \
+        } \
+    } while (0)
+
+#define HOST_TEST_MAIN_END() \
+    do { \
+        if (host_test_failures == 0) { \
+            printf("%s: OK\n", __FILE__); \
+        } \
+        return host_test_failures == 0 ? 0 : 1; \
+    } while (0)
+
+#endif
@@ -0,0 +1,112 @@
+/*
+    DynamixelTransport against a stand-in AX12 bus: non blocking sending,
+    half-duplex direction switching, status packet parsing, echo skipping
+    and timeout.
+*/
+
+#include <Arduino.h>
+#include "HostTest.h"
+#include "FakeDynamixelBus.h"
+#include "../DynamixelTransport.h"
+
+uint32_t host_clock_us = 0;
+int host_test_failures = 0;
+
+static volatile uint8_t uart_c3 = 0;
+static const uint8_t TXDIR = 0x20;
+
+/* Runs the main loop until the transaction ends, 'period' µs per iteration */
+static DynamixelStatus complete(DynamixelTransport & transport, uint8_t *data, uint32_t period = 20)
+{
+    while (!transport.poll()) {
+        host_advance_clock(period);
+    }
+    return transport.takeResult(data);
+}
+
+static void testRead(DynamixelTransport & transport, FakeDynamixelBus & bus)
+{
+    uint8_t *regs = bus.registers(1);
+    regs[36] = 0x34;    // Present position
+    regs[37] = 0x02;
+    uint32_t start = host_clock_us;
+    CHECK(transport.submitRead(1, 36, 2));
+    CHECK(host_clock_us == start);      // Returns before the end of the transmission
+    CHECK((uart_c3 & TXDIR) != 0);
+    CHECK(!transport.poll());
+    host_advance_clock(8 * DYN_TRANSPORT_BYTE_DURATION);
+    CHECK((uart_c3 & TXDIR) == 0);      // Back in read mode as soon as the packet is out
+    CHECK(!transport.poll());           // Never waits for the status packet
+    uint8_t data[2] = { 0, 0 };
+    CHECK(complete(transport, data) == DYN_STATUS_OK);
+    CHECK(data[0] == 0x34 && data[1] == 0x02);
+    CHECK(transport.isIdle());
+}
+
+static void testWrite(DynamixelTransport & transport, FakeDynamixelBus & bus)
+{
+    uint8_t goal[2] = { 0xFF, 0x01 };
+    CHECK(transport.submitWrite(2, 30, 2, goal));
+    CHECK(complete(transport, nullptr) == DYN_STATUS_OK);
+    CHECK(bus.registers(2)[30] == 0xFF && bus.registers(2)[31] == 0x01);
+}
+
+static void testSyncWrite(DynamixelTransport & transport, FakeDynamixelBus & bus)
+{
+    uint8_t ids[2] = { 1, 2 };
+    uint8_t speeds[4] = { 0x10, 0x00, 0x20, 0x00 };
+    CHECK(transport.submitSyncWrite(2, ids, 32, 2, speeds));
+    CHECK(!transport.isIdle());         // Until the end of the transmission
+    CHECK(complete(transport, nullptr) == DYN_STATUS_OK);
+    CHECK(bus.registers(1)[32] == 0x10 && bus.registers(2)[32] == 0x20);
+}
+
+/* The direction does not depend on the main loop: a slow loop still gets the answer */
+static void testSlowLoop(DynamixelTransport & transport, FakeDynamixelBus & bus)
+{
+    size_t lostAnswers = bus.lostAnswers;
+    bus.registers(2)[36] = 0x12;
+    CHECK(transport.submitRead(2, 36, 2));
+    uint8_t data[2] = { 0, 0 };
+    CHECK(complete(transport, data, 2000) == DYN_STATUS_OK);
+    CHECK(data[0] == 0x12);
+    CHECK(bus.lostAnswers == lostAnswers);
+}
+
+static void testTimeout(DynamixelTransport & transport)
+{
+    uint32_t start = host_clock_us;
+    CHECK(transport.submitRead(7, 36, 2));
+    DynamixelStatus status = complete(transport, nullptr);
+    CHECK((status & DYN_STATUS_COM_ERROR) != 0);
+    CHECK(host_clock_us - start >= DYN_TRANSPORT_TIMEOUT);
+}
+
+int main()
+{
+    FakeDynamixelBus bus(&uart_c3, TXDIR);
+    bus.addServo(1, 100);
+    bus.addServo(2, 0);     // Answers right after the instruction packet
+    DynamixelTransport transport(bus, &uart_c3, TXDIR);
+
+    testRead(transport, bus);
+    testWrite(transport, bus);
+    testSyncWrite(transport, bus);
+    testSlowLoop(transport, bus);
+    testTimeout(transport);
+    testRead(transport, bus);   // The bus recovers after a timeout
+
+    CHECK(bus.lostBytes == 0);
+    CHECK(bus.lostAnswers == 0);
+
+    /* Without direction switching, nothing reaches the servos */
+    volatile uint8_t unused = 0;
+    FakeDynamixelBus silentBus(&uart_c3, TXDIR);
+    silentBus.addServo(1, 100);
+    DynamixelTransport fullDuplex(silentBus, &unused, TXDIR);
+    CHECK(fullDuplex.submitRead(1, 36, 2));
+    CHECK((complete(fullDuplex, nullptr) & DYN_STATUS_COM_ERROR) != 0);
+    CHECK(silentBus.lostBytes > 0);
+
+    HOST_TEST_MAIN_END();
+}
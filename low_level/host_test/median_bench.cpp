@@ -0,0 +1,128 @@
+/*
+    Sliding median and Hampel filter (sensor_test/Median.h): results checked
+    against a full sort of the window, then cost of add() compared with the
+    sort-based median for several window sizes.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include "HostTest.h"
+#include "Median.h"
+
+int host_test_failures = 0;
+
+#define BENCH_NB_VALUES 200000
+
+/* Reference: copy and sort the whole window at each new value */
+template<typename T, size_t const BUFFER_SIZE>
+class SortMedian
+{
+public:
+    SortMedian() : index(0), primed(false) {}
+
+    void add(T element)
+    {
+        if (!primed) {
+            std::fill(buffer, buffer + BUFFER_SIZE, element);
+            primed = true;
+        }
+        buffer[index] = element;
+        index = (index + 1) % BUFFER_SIZE;
+        T sorted[BUFFER_SIZE];
+        std::copy(buffer, buffer + BUFFER_SIZE, sorted);
+        std::sort(sorted, sorted + BUFFER_SIZE);
+        median = sorted[BUFFER_SIZE / 2];
+    }
+
+    T value() const { return median; }
+
+private:
+    T buffer[BUFFER_SIZE];
+    size_t index;
+    bool primed;
+    T median;
+};
+
+/* ToF-like signal: noisy distance with steps and isolated outliers */
+static int32_t sample(uint32_t & seed, size_t i)
+{
+    seed = seed * 1103515245 + 12345;
+    int32_t noise = (int32_t)((seed >> 16) % 7) - 3;
+    int32_t base = 200 + 150 * (int32_t)((i / 500) % 3);
+    if ((seed >> 8) % 97 == 0) {
+        return base + 400;
+    }
+    return base + noise;
+}
+
+template<size_t const N>
+static void checkAndBench()
+{
+    Median<int32_t, N> median;
+    SortMedian<int32_t, N> reference;
+    uint32_t seed = 1;
+    for (size_t i = 0; i < 20000; i++)
+    {
+        int32_t v = sample(seed, i);
+        median.add(v);
+        reference.add(v);
+        if (median.value() != reference.value())
+        {
+            CHECK(median.value() == reference.value());
+            break;
+        }
+    }
+
+    int32_t values[1024];
+    seed = 2;
+    for (size_t i = 0; i < 1024; i++) {
+        values[i] = sample(seed, i);
+    }
+    volatile int32_t sink = 0;
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < BENCH_NB_VALUES; i++) {
+        median.add(values[i % 1024]);
+        sink = sink + median.value();
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < BENCH_NB_VALUES; i++) {
+        reference.add(values[i % 1024]);
+        sink = sink + reference.value();
+    }
+    auto t2 = std::chrono::steady_clock::now();
+
+    double incremental = std::chrono::duration<double, std::nano>(t1 - t0).count() / BENCH_NB_VALUES;
+    double sorted = std::chrono::duration<double, std::nano>(t2 - t1).count() / BENCH_NB_VALUES;
+    printf("window %3u: incremental %6.1f ns/add, full sort %6.1f ns/add\n", (unsigned)N, incremental, sorted);
+}
+
+static void checkHampel()
+{
+    Hampel<int32_t, 3> hampel;
+    hampel.setThreshold(HAMPEL_DEFAULT_THRESHOLD, 15);
+    hampel.add(300);
+    hampel.add(302);
+    CHECK(hampel.value() == 302);   // Small variation on a stable window (MAD of zero) is kept
+    hampel.add(700);
+    CHECK(hampel.value() == 302);   // Isolated outlier replaced by the median
+    hampel.add(301);
+    CHECK(hampel.value() == 301);
+
+    hampel.reset();
+    hampel.add(500);
+    CHECK(hampel.value() == 500);   // After a reset, the first value goes through
+}
+
+int main()
+{
+    checkHampel();
+    checkAndBench<3>();
+    checkAndBench<5>();
+    checkAndBench<9>();
+    checkAndBench<15>();
+    checkAndBench<31>();
+    HOST_TEST_MAIN_END();
+}
@@ -0,0 +1,444 @@
+/*
+    Sequences of orders (OrderSequence.h) run against a stand-in OrderProvider:
+    - program validation (instruction lengths, opcodes, jump targets, orders
+      that cannot be called from a sequence),
+    - JUMP / JUMP_IF, with the mask and the offset applied to the output of
+      the last CALL,
+    - a long order that exceeds its timeout is cancelled and released,
+    - a long order without a free instance stops the sequence,
+    - cancelling the sequence cancels the long order it is running.
+*/
+
+#include <Arduino.h>
+#include <vector>
+#include "HostTest.h"
+#include "../Serializer.h"
+
+/* The orders and the server are replaced below by what RunSequence uses of them */
+#define _COMMUNICATIONSERVER_h
+#define _ORDERIMMEDIATE_h
+#define _ORDERLONG_h
+
+enum Channel
+{
+    SPY_ORDER
+};
+
+class HostServer
+{
+public:
+    void printf(Channel channel, const char *format, ...) {}
+    void printf_err(const char *format, ...) { errors++; }
+    uint32_t errors = 0;
+};
+HostServer Server;
+
+enum OrderResource
+{
+    ORDER_RESOURCE_NONE     = 0x00,
+    ORDER_RESOURCE_MOTION   = 0x01,
+    ORDER_RESOURCE_ACTUATOR = 0x02
+};
+
+class OrderImmediate
+{
+public:
+    virtual void execute(std::vector<uint8_t> &) = 0;
+};
+
+/* Life cycle of OrderLong.h (launch, cancel, instances), without the hardware */
+class OrderLong
+{
+public:
+    OrderLong() : finished(true), cancelled(false), inUse(false) {}
+
+    void launch(const std::vector<uint8_t> & arg)
+    {
+        finished = false;
+        cancelled = false;
+        _launch(arg);
+    }
+
+    virtual void _launch(const std::vector<uint8_t> &) = 0;
+    virtual void onExecute() = 0;
+    bool isFinished() { return finished; }
+    virtual void terminate(std::vector<uint8_t> &) = 0;
+    static void refuse(std::vector<uint8_t> &) {}
+
+    void cancel()
+    {
+        if (!finished)
+        {
+            cancelled = true;
+            finished = true;
+            onCancel();
+        }
+    }
+
+    virtual uint8_t getResources() const { return ORDER_RESOURCE_NONE; }
+    bool isSleeping() const { return false; }
+    bool isInUse() const { return inUse; }
+    void reserve() { inUse = true; }
+    void release() { inUse = false; }
+
+protected:
+    virtual void onCancel() {}
+    bool finished;
+    bool cancelled;
+
+private:
+    bool inUse;
+};
+
+#include "../OrderSequence.h"
+
+uint32_t host_clock_us = 0;
+int host_test_failures = 0;
+
+#define TEST_LOOP_PERIOD    1000    // µs, main loop period
+#define TEST_MAX_LOOPS      10000
+
+#define ID_WAIT             0x05    // Long order
+#define ID_SEQUENCE         0x09    // Long order, not sequenceable
+#define ID_ECHO             0x81    // Immediate order
+#define ID_CANCEL           0xA4    // Immediate order, not sequenceable
+
+/* Echo: the output is the input */
+class Echo : public OrderImmediate
+{
+public:
+    void execute(std::vector<uint8_t> &) {}
+};
+
+/* Wait: waits 'duration' ms (int16 argument), then answers its number of completions */
+class Wait : public OrderLong
+{
+public:
+    void _launch(const std::vector<uint8_t> & input)
+    {
+        duration = input.size() == 2 ? input[0] | (input[1] << 8) : 0;
+        startTime = millis();
+    }
+
+    void onExecute()
+    {
+        if (millis() - startTime >= duration)
+        {
+            completions++;
+            finished = true;
+        }
+    }
+
+    void terminate(std::vector<uint8_t> & output)
+    {
+        Serializer::writeInt(cancelled ? -1 : completions, output);
+    }
+
+    void onCancel() { cancellations++; }
+
+    uint32_t duration;      // ms
+    uint32_t startTime;     // ms
+    static int32_t completions;
+    static int32_t cancellations;
+};
+int32_t Wait::completions = 0;
+int32_t Wait::cancellations = 0;
+
+/* One instance of Wait, as the OrderLongPool of OrderMgr */
+class TestProvider : public OrderProvider
+{
+public:
+    bool isSequenceable(uint8_t id) { return id == ID_WAIT || id == ID_ECHO; }
+
+    OrderLong* acquireLongOrder(uint8_t id)
+    {
+        if (id != ID_WAIT || wait.isInUse()) {
+            return NULL;
+        }
+        wait.reserve();
+        return &wait;
+    }
+
+    OrderImmediate* getImmediateOrder(uint8_t id) { return id == ID_ECHO ? &echo : NULL; }
+
+    Wait wait;
+    Echo echo;
+};
+TestProvider provider;
+
+/* Instructions of a program */
+typedef std::vector<uint8_t> Program;
+
+static void call(Program & p, uint8_t id, uint16_t timeout, const std::vector<uint8_t> & args)
+{
+    p.push_back(0x01);
+    p.push_back(id);
+    p.push_back(timeout & 0xFF);
+    p.push_back(timeout >> 8);
+    p.push_back(args.size());
+    p.insert(p.end(), args.begin(), args.end());
+}
+
+static void wait(Program & p, uint16_t duration, uint16_t timeout)
+{
+    call(p, ID_WAIT, timeout, { (uint8_t)(duration & 0xFF), (uint8_t)(duration >> 8) });
+}
+
+static void jumpIf(Program & p, uint8_t condition, uint8_t offset, int32_t mask, int32_t value, uint8_t target)
+{
+    p.push_back(0x02);
+    p.push_back(condition);
+    p.push_back(offset);
+    Serializer::writeInt(mask, p);
+    Serializer::writeInt(value, p);
+    p.push_back(target);
+}
+
+static void jump(Program & p, uint8_t target)
+{
+    p.push_back(0x03);
+    p.push_back(target);
+}
+
+static void end(Program & p, uint8_t code)
+{
+    p.push_back(0x04);
+    p.push_back(code);
+}
+
+struct SequenceEnd
+{
+    uint8_t code;
+    int32_t nbCalls;
+    int32_t pc;
+    std::vector<uint8_t> result;
+};
+
+/* Runs the sequence from the main loop until it ends */
+static SequenceEnd run(RunSequence & sequence, const Program & program)
+{
+    sequence.launch(program);
+    for (size_t i = 0; i < TEST_MAX_LOOPS && !sequence.isFinished(); i++)
+    {
+        sequence.onExecute();
+        host_clock_us += TEST_LOOP_PERIOD;
+    }
+    CHECK(sequence.isFinished());
+    std::vector<uint8_t> output;
+    sequence.terminate(output);
+    SequenceEnd e;
+    size_t index = 1;
+    e.code = output.at(0);
+    e.nbCalls = Serializer::readInt(output, index);
+    e.pc = Serializer::readInt(output, index);
+    e.result.assign(output.begin() + index, output.end());
+    CHECK(!provider.wait.isInUse());
+    return e;
+}
+
+static SequenceEnd run(const Program & program)
+{
+    RunSequence sequence;
+    return run(sequence, program);
+}
+
+static bool invalid(const Program & program)
+{
+    return run(program).code == 0xFD;
+}
+
+static void testValidation()
+{
+    Program p;
+    CHECK(run(p).code == 0);            // Empty program: END 0
+    CHECK(run(p).nbCalls == 0);
+
+    p.clear();
+    end(p, 7);
+    CHECK(run(p).code == 7);
+
+    /* Instruction lengths */
+    p = { 0x01, ID_ECHO, 0, 0 };        // Truncated CALL header
+    CHECK(invalid(p));
+    p.clear();
+    call(p, ID_ECHO, 0, { 1, 2, 3 });
+    p.pop_back();                       // Arguments shorter than announced
+    CHECK(invalid(p));
+    p.clear();
+    jumpIf(p, 0, 0, 0, 0, 0);
+    p.pop_back();
+    CHECK(invalid(p));
+    p = { 0x03 };
+    CHECK(invalid(p));
+    p = { 0x04 };
+    CHECK(invalid(p));
+    p = { 0x05, 0x00 };                 // Unknown opcode
+    CHECK(invalid(p));
+
+    /* Orders that cannot be called */
+    p.clear();
+    call(p, ID_SEQUENCE, 0, {});
+    CHECK(invalid(p));
+    p.clear();
+    call(p, ID_CANCEL, 0, { 0x05, 0, 0, 0 });
+    CHECK(invalid(p));
+
+    /* Too many instructions */
+    p.clear();
+    for (size_t i = 0; i < SEQ_MAX_INSTRUCTIONS; i++) {
+        jump(p, i + 1);
+    }
+    CHECK(run(p).code == 0);
+    end(p, 1);
+    CHECK(invalid(p));
+
+    /* Jump targets: the end of the program at most */
+    p.clear();
+    jump(p, 2);
+    end(p, 1);
+    CHECK(run(p).code == 0);
+    CHECK(run(p).pc == 2);
+    p.clear();
+    jump(p, 3);
+    end(p, 1);
+    CHECK(invalid(p));
+    p.clear();
+    jumpIf(p, 2, 0, 0, 0, 3);
+    end(p, 1);
+    CHECK(invalid(p));
+}
+
+static void testJumps()
+{
+    /* 0: CALL echo | 1: JUMP_IF | 2: END 1 | 3: END 2 */
+    std::vector<uint8_t> args = { 0xAA, 0x34, 0x12, 0x00, 0x80 };  // int32 0x80001234 at offset 1
+    struct JumpCase
+    {
+        uint8_t condition;
+        uint8_t offset;
+        int32_t mask;
+        int32_t value;
+        uint8_t expectedCode;
+    };
+    const JumpCase cases[] = {
+        { 0, 1, (int32_t)0xFFFFFFFF, (int32_t)0x80001234, 2 },  // Whole field
+        { 0, 1, 0x0000FF00, 0x00001200, 2 },                    // Masked
+        { 0, 1, 0x0000FF00, 0x00001234, 1 },                    // Masked bits only
+        { 0, 0, (int32_t)0xFFFFFFFF, (int32_t)0x80001234, 1 },  // Wrong offset
+        { 1, 1, 0x0000FF00, 0x00001200, 1 },
+        { 1, 1, 0x0000FF00, 0x00003400, 2 },
+        { 0, 2, 0, 0, 1 },                                      // Field beyond the output: false
+        { 1, 2, 0, 0, 1 },
+        { 2, 1, 0, 0, 1 },                                      // No timeout
+    };
+    for (const JumpCase & c : cases)
+    {
+        Program p;
+        call(p, ID_ECHO, 0, args);
+        jumpIf(p, c.condition, c.offset, c.mask, c.value, 3);
+        end(p, 1);
+        end(p, 2);
+        SequenceEnd e = run(p);
+        CHECK(e.code == c.expectedCode);
+        CHECK(e.nbCalls == 1);
+        CHECK(e.result == args);
+    }
+
+    /* A loop: JUMP back, left by JUMP_IF once the long order has run 3 times */
+    Wait::completions = 0;
+    Program p;
+    wait(p, 10, 0);                                  // 0
+    jumpIf(p, 0, 0, (int32_t)0xFFFFFFFF, 3, 3);      // 1
+    jump(p, 0);                                      // 2
+    end(p, 5);                                       // 3
+    SequenceEnd e = run(p);
+    CHECK(e.code == 5);
+    CHECK(e.nbCalls == 3);
+    CHECK(e.pc == 3);
+}
+
+static void testTimeout()
+{
+    /* 0: CALL wait 500 ms, timeout 100 ms | 1: JUMP_IF timed out | 2: END 1 | 3: END 2 */
+    Wait::cancellations = 0;
+    Program p;
+    wait(p, 500, 100);
+    jumpIf(p, 2, 0, 0, 0, 3);
+    end(p, 1);
+    end(p, 2);
+    uint32_t start = millis();
+    SequenceEnd e = run(p);
+    uint32_t duration = millis() - start;
+    printf("timeout: cancelled after %u ms\n", (unsigned)duration);
+    CHECK(e.code == 2);
+    CHECK(Wait::cancellations == 1);
+    CHECK(duration >= 100 && duration < 150);
+    CHECK(e.result.size() == 4 && e.result[0] == 0xFF);     // Output of the cancelled order
+
+    /* Finished in time: no timeout */
+    p.clear();
+    wait(p, 50, 100);
+    jumpIf(p, 2, 0, 0, 0, 3);
+    end(p, 1);
+    end(p, 2);
+    CHECK(run(p).code == 1);
+    CHECK(Wait::cancellations == 1);
+}
+
+static void testPoolExhausted()
+{
+    /* The only instance of Wait is used by an order of the execution stack */
+    provider.wait.reserve();
+    Program p;
+    call(p, ID_ECHO, 0, {});
+    wait(p, 10, 0);
+    end(p, 1);
+    RunSequence sequence;
+    sequence.launch(p);
+    for (size_t i = 0; i < TEST_MAX_LOOPS && !sequence.isFinished(); i++) {
+        sequence.onExecute();
+    }
+    std::vector<uint8_t> output;
+    sequence.terminate(output);
+    size_t index = 1;
+    CHECK(output[0] == 0xFE);
+    CHECK(Serializer::readInt(output, index) == 2);
+    CHECK(Serializer::readInt(output, index) == 1);     // Stopped on the CALL
+    CHECK(provider.wait.isInUse());                     // Still owned by the stack
+    provider.wait.release();
+}
+
+static void testCancel()
+{
+    Wait::cancellations = 0;
+    Program p;
+    wait(p, 500, 0);
+    end(p, 1);
+    RunSequence sequence;
+    sequence.launch(p);
+    for (size_t i = 0; i < 10; i++)
+    {
+        sequence.onExecute();
+        host_clock_us += TEST_LOOP_PERIOD;
+    }
+    CHECK(!sequence.isFinished());
+    CHECK(provider.wait.isInUse());
+    sequence.cancel();
+    CHECK(sequence.isFinished());
+    CHECK(Wait::cancellations == 1);
+    CHECK(!provider.wait.isInUse());
+    std::vector<uint8_t> output;
+    sequence.terminate(output);
+    CHECK(output[0] == 0xFF);
+}
+
+int main()
+{
+    RunSequence::setOrderProvider(&provider);
+    testValidation();
+    testJumps();
+    testTimeout();
+    testPoolExhausted();
+    testCancel();
+    HOST_TEST_MAIN_END();
+}
@@ -0,0 +1,138 @@
+/*
+    Circle fit of the PuckTracker (PuckTracker.h) on points of the front edge
+    of a puck, as seen by a fork sensor sweeping across it:
+    - exact points give the center and a null residual,
+    - noisy points give the center within a few mm, never the symmetric
+      circle on the sensor side,
+    - degenerate inputs (a single point seen again and again, a point on the
+      estimated center) keep a finite estimate,
+    - outliers are rejected, and too many of them in a row reset the tracker.
+*/
+
+#include <Arduino.h>
+#include <random>
+#include "HostTest.h"
+#include "../PuckTracker.h"
+
+uint32_t host_clock_us = 0;
+int host_test_failures = 0;
+
+#define TEST_CENTER_X   350.0   // mm
+#define TEST_CENTER_Y   -120.0  // mm
+#define TEST_HALF_SWEEP 30.0    // mm, the sensor sweeps [y - 30 ; y + 30]
+#define TEST_NB_POINTS  40
+#define TEST_NOISE      2.0     // mm, standard deviation on each coordinate
+#define TEST_NB_SWEEPS  100
+
+/* Edge point seen by a sensor looking along +x at 'y' (|y - TEST_CENTER_Y| < PUCK_RADIUS) */
+static float edgeX(float y)
+{
+    float dy = y - TEST_CENTER_Y;
+    return TEST_CENTER_X - sqrtf(PUCK_RADIUS * PUCK_RADIUS - dy * dy);
+}
+
+static float sweepY(size_t i)
+{
+    return TEST_CENTER_Y - TEST_HALF_SWEEP + 2 * TEST_HALF_SWEEP * i / (TEST_NB_POINTS - 1);
+}
+
+static float centerError(const PuckTracker & tracker)
+{
+    return hypotf(tracker.getX() - TEST_CENTER_X, tracker.getY() - TEST_CENTER_Y);
+}
+
+static void testExactPoints()
+{
+    PuckTracker tracker;
+    for (size_t i = 0; i < TEST_NB_POINTS; i++)
+    {
+        float y = sweepY(i);
+        tracker.addPoint(edgeX(y), y, 1, 0);
+        CHECK(tracker.isValid() == (i + 1 >= PUCK_TRACKER_MIN_POINTS));
+    }
+    printf("exact points: error %.3f mm, rms %.3f mm\n", centerError(tracker), tracker.getRms());
+    CHECK(tracker.getNbPoints() == PUCK_TRACKER_HISTORY);
+    CHECK(centerError(tracker) < 0.1);
+    CHECK(tracker.getRms() < 0.1);
+}
+
+/* Over many sweeps: the fit must never settle on the symmetric circle, on the sensor side */
+static void testNoisyPoints()
+{
+    float maxError = 0, sumError = 0, sumRms = 0;
+    for (uint32_t seed = 0; seed < TEST_NB_SWEEPS; seed++)
+    {
+        std::mt19937 generator(seed);
+        std::normal_distribution<float> noise(0, TEST_NOISE);
+        PuckTracker tracker;
+        for (size_t i = 0; i < TEST_NB_POINTS; i++)
+        {
+            float y = sweepY(i);
+            float dx = noise(generator);
+            float dy = noise(generator);
+            tracker.addPoint(edgeX(y) + dx, y + dy, 1, 0);
+        }
+        CHECK(tracker.isValid());
+        maxError = max(maxError, centerError(tracker));
+        sumError += centerError(tracker);
+        sumRms += tracker.getRms();
+    }
+    printf("noisy points: error %.3f mm (max %.3f mm), rms %.3f mm\n",
+        sumError / TEST_NB_SWEEPS, maxError, sumRms / TEST_NB_SWEEPS);
+    CHECK(maxError < 2 * TEST_NOISE);
+    CHECK(sumError / TEST_NB_SWEEPS < TEST_NOISE);
+    CHECK(fabsf(sumRms / TEST_NB_SWEEPS - TEST_NOISE) < 0.5);
+}
+
+static void testDegenerate()
+{
+    /* The same point again and again: the center stays behind it, at PUCK_RADIUS */
+    PuckTracker tracker;
+    float x = edgeX(TEST_CENTER_Y);
+    for (size_t i = 0; i < TEST_NB_POINTS; i++) {
+        tracker.addPoint(x, TEST_CENTER_Y, 1, 0);
+    }
+    printf("single point: center (%.3f ; %.3f), rms %.3f mm\n", tracker.getX(), tracker.getY(), tracker.getRms());
+    CHECK(tracker.isValid());
+    CHECK(isfinite(tracker.getX()) && isfinite(tracker.getY()) && isfinite(tracker.getRms()));
+    CHECK(fabsf(hypotf(tracker.getX() - x, tracker.getY() - TEST_CENTER_Y) - PUCK_RADIUS) < 0.1);
+
+    /* A point on the current center is ignored by the fit instead of dividing by zero */
+    PuckTracker onCenter;
+    onCenter.addPoint(0, 0, 1, 0);
+    onCenter.addPoint(PUCK_RADIUS, 0, 1, 0);
+    CHECK(isfinite(onCenter.getX()) && isfinite(onCenter.getY()) && isfinite(onCenter.getRms()));
+}
+
+static void testOutliers()
+{
+    PuckTracker tracker;
+    for (size_t i = 0; i < TEST_NB_POINTS; i++)
+    {
+        float y = sweepY(i);
+        tracker.addPoint(edgeX(y), y, 1, 0);
+    }
+    float x = tracker.getX();
+    float y = tracker.getY();
+
+    /* Beyond PUCK_TRACKER_GATE: rejected, the estimate does not move */
+    for (size_t i = 0; i < PUCK_TRACKER_HISTORY; i++) {
+        tracker.addPoint(TEST_CENTER_X - PUCK_RADIUS - 2 * PUCK_TRACKER_GATE, TEST_CENTER_Y, 1, 0);
+    }
+    CHECK(tracker.getX() == x && tracker.getY() == y);
+    CHECK(tracker.getNbPoints() == PUCK_TRACKER_HISTORY);
+
+    /* One more: the puck is considered lost, the tracker starts again */
+    tracker.addPoint(TEST_CENTER_X - PUCK_RADIUS - 2 * PUCK_TRACKER_GATE, TEST_CENTER_Y, 1, 0);
+    CHECK(tracker.getNbPoints() == 0);
+    CHECK(!tracker.isValid());
+}
+
+int main()
+{
+    testExactPoints();
+    testNoisyPoints();
+    testDegenerate();
+    testOutliers();
+    HOST_TEST_MAIN_END();
+}
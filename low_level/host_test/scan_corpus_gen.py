@@ -0,0 +1,94 @@
+"""
+Generates the synthetic entries of scan_corpus.txt (see scan_corpus_test.cpp).
+The profiles model the fork sensors seeing pucks across the scan range:
+beam footprint, noise, spikes, empty bins of a fast scan, walls.
+Usage: python3 scan_corpus_gen.py > scan_corpus.txt
+Profiles recorded on the robot are appended by hand after the generated ones:
+keep them when regenerating the file.
+"""
+import math
+import random
+
+Y_MIN = -23.795 - 43.83  # mm, scan range of the PuckScanner
+Y_MAX = 23.795 + 43.83   # mm
+RESOLUTION = 101         # SCAN_RESOLUTION
+PUCK_RADIUS = 38.0       # mm
+GOLDENIUM_RADIUS = 50.0  # mm, seen as a wider puck
+SENSOR_MIN = 5           # mm, SCAN_SENSOR_MIN
+SENSOR_MAX = 200         # mm, SCAN_SENSOR_MAX
+EMPTY_BIN = 255          # SCAN_PROFILE_EMPTY_BIN
+
+BINS_Y = [Y_MIN + i * (Y_MAX - Y_MIN) / (RESOLUTION - 1) for i in range(RESOLUTION)]
+
+HEADER = """# Scan profiles replayed by scan_corpus_test.
+# Each entry is two lines:
+#   name goldenium(0/1) number_of_pucks expected_y_1 ... (mm)
+#   y_min y_max, then the 101 bins of the profile (mm, 255: empty bin),
+#   i.e. the payload of a SCAN_PROFILE frame (0x0D) as shown by the debug interface.
+# The first entries model the fork sensors (puck edge seen through the beam
+# footprint, noise, spikes, empty bins of a fast scan, walls, two pucks side
+# by side); profiles recorded on the robot can be appended, with the y measured
+# by hand."""
+
+
+def flat(distance):
+    return lambda y: distance
+
+
+def surface(y, pucks, background):
+    """ Distance seen at y: the nearest of the background and the puck edges """
+    d = background(y)
+    for (yc, xc, r) in pucks:
+        if abs(y - yc) < r:
+            d = min(d, xc - math.sqrt(r * r - (y - yc) ** 2))
+    return d
+
+
+def profile(pucks, background=flat(200), beam=4.0, noise=2.0, empty=0.0, spikes=0, seed=0):
+    """
+    pucks: (y, x, radius) in mm, x being the distance from the sensors to the puck center
+    beam: half width of the beam footprint (mm), the measure is averaged over it
+    empty: probability that a bin gets no measure
+    spikes: number of bins replaced by an extreme value
+    """
+    rnd = random.Random(seed)
+    out = []
+    for y in BINS_Y:
+        if rnd.random() < empty:
+            out.append(EMPTY_BIN)
+            continue
+        values = [surface(y + k * beam / 4, pucks, background) for k in range(-4, 5)]
+        v = sum(values) / len(values) + rnd.gauss(0, noise)
+        out.append(int(round(min(max(v, SENSOR_MIN), SENSOR_MAX))))
+    for _ in range(spikes):
+        i = rnd.randrange(RESOLUTION)
+        out[i] = rnd.choice([SENSOR_MIN, SENSOR_MAX])
+    return out
+
+
+R = PUCK_RADIUS
+CASES = [
+    ("centered", 0, [0.0], dict(pucks=[(0, 80, R)], seed=1)),
+    ("offset_left", 0, [-18.5], dict(pucks=[(-18.5, 95, R)], noise=3, seed=2)),
+    ("offset_right_sparse", 0, [22.0], dict(pucks=[(22, 70, R)], noise=3, empty=0.45, seed=3)),
+    ("close_noisy_spikes", 0, [6.0], dict(pucks=[(6, 40, R)], noise=4, spikes=3, seed=4)),
+    ("far_low_contrast", 0, [-8.0], dict(pucks=[(-8, 150, R)], noise=2, seed=5)),
+    ("wall_background", 0, [12.0], dict(pucks=[(12, 70, R)], background=flat(130), noise=2, seed=6)),
+    ("slanted_wall", 0, [-5.0], dict(pucks=[(-5, 60, R)], background=lambda y: 150 + 0.5 * y, noise=2, seed=7)),
+    ("two_pucks", 0, [-39.0, 39.0], dict(pucks=[(-39, 70, R), (39, 70, R)], noise=2, seed=8)),
+    ("two_pucks_staggered", 0, [-38.0, 40.0], dict(pucks=[(-38, 60, R), (40, 100, R)], noise=2, seed=9)),
+    ("goldenium", 1, [3.0], dict(pucks=[(3, 90, GOLDENIUM_RADIUS)], noise=2, seed=10)),
+    ("empty_table", 0, [], dict(pucks=[], noise=2, seed=11)),
+    ("flat_wall", 0, [], dict(pucks=[], background=flat(90), noise=3, seed=12)),
+]
+
+
+def main():
+    print(HEADER)
+    for name, goldenium, expected, params in CASES:
+        print("%s %d %d %s" % (name, goldenium, len(expected), " ".join("%.1f" % y for y in expected)))
+        print("%.3f %.3f %s" % (Y_MIN, Y_MAX, " ".join(map(str, profile(**params)))))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,151 @@
+/*
+    Puck detection (ScanProfile.h) replayed on the profiles of scan_corpus.txt
+    (synthetic entries made by scan_corpus_gen.py): every expected puck must be
+    found within SCAN_CORPUS_TOLERANCE, and no other candidate may be reported.
+    Usage: scan_corpus_test [corpus file]
+*/
+
+#include <Arduino.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "HostTest.h"
+#include "../ScanProfile.h"
+
+uint32_t host_clock_us = 0;
+int host_test_failures = 0;
+
+#define SCAN_CORPUS_TOLERANCE   1.5     // mm, about one bin of the profile
+#define SCAN_CORPUS_PUCK_RADIUS 38.0    // mm
+#define SCAN_CORPUS_GOLD_RADIUS 50.0    // mm, as in scan_corpus_gen.py
+
+/*
+    A puck whose outer edge lies beyond the end of the scan (two pucks side by
+    side) is only located by its inner edge and the end of the scan: the fitted
+    template is pulled towards the inside of the scan by up to two bins.
+*/
+#define SCAN_CORPUS_TRUNCATED_TOLERANCE 3.0     // mm
+
+struct CorpusEntry
+{
+    std::string name;
+    bool goldenium;
+    std::vector<float> expected;    // mm
+    float yMin;                     // mm
+    float yMax;                     // mm
+    std::vector<int> bins;          // mm, SCAN_PROFILE_EMPTY_BIN for an empty bin
+};
+
+/* Next non empty, non comment line */
+static bool nextLine(std::ifstream & file, std::string & line)
+{
+    while (std::getline(file, line))
+    {
+        if (!line.empty() && line[0] != '#') {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool readEntry(std::ifstream & file, CorpusEntry & entry)
+{
+    std::string line;
+    if (!nextLine(file, line)) {
+        return false;
+    }
+    std::istringstream header(line);
+    int goldenium;
+    size_t nbPucks;
+    header >> entry.name >> goldenium >> nbPucks;
+    entry.goldenium = goldenium != 0;
+    entry.expected.resize(nbPucks);
+    for (size_t i = 0; i < nbPucks; i++) {
+        header >> entry.expected[i];
+    }
+
+    if (!nextLine(file, line)) {
+        return false;
+    }
+    std::istringstream profile(line);
+    profile >> entry.yMin >> entry.yMax;
+    entry.bins.clear();
+    int value;
+    while (profile >> value) {
+        entry.bins.push_back(value);
+    }
+    return !header.fail() && entry.bins.size() == SCAN_RESOLUTION;
+}
+
+static float tolerance(const CorpusEntry & entry, float y)
+{
+    float radius = entry.goldenium ? SCAN_CORPUS_GOLD_RADIUS : SCAN_CORPUS_PUCK_RADIUS;
+    if (y - radius < entry.yMin || y + radius > entry.yMax) {
+        return SCAN_CORPUS_TRUNCATED_TOLERANCE;
+    }
+    return SCAN_CORPUS_TOLERANCE;
+}
+
+static void replay(const CorpusEntry & entry)
+{
+    ScanProfile profile(entry.yMin, entry.yMax);
+    for (size_t i = 0; i < SCAN_RESOLUTION; i++)
+    {
+        if (entry.bins[i] != SCAN_PROFILE_EMPTY_BIN) {
+            profile.addMeasure(entry.bins[i], profile.indexToMm(i));
+        }
+    }
+    float y = 0;
+    int32_t distance = 0;
+    bool found = profile.compute(entry.goldenium, y, distance) == EXIT_SUCCESS;
+
+    printf("%-24s %u candidate(s)", entry.name.c_str(), (unsigned)profile.getNbCandidates());
+    for (size_t i = 0; i < profile.getNbCandidates(); i++) {
+        printf("  y = %6.2f", profile.getCandidateY(i));
+    }
+    printf("  (confidence %.2f)\n", profile.getConfidence());
+
+    CHECK(found == !entry.expected.empty());
+    CHECK(profile.getNbCandidates() == entry.expected.size());
+    for (size_t k = 0; k < entry.expected.size(); k++)
+    {
+        bool matched = false;
+        for (size_t i = 0; i < profile.getNbCandidates(); i++) {
+            matched |= fabsf(profile.getCandidateY(i) - entry.expected[k]) <= tolerance(entry, entry.expected[k]);
+        }
+        if (!matched) {
+            printf("%s: no candidate at y = %g\n", entry.name.c_str(), entry.expected[k]);
+        }
+        CHECK(matched);
+    }
+
+    /* The profile sent to the high level is the replayed one */
+    std::vector<uint8_t> frame;
+    profile.appendProfileToVect(frame);
+    CHECK(frame.size() == 2 * sizeof(float) + SCAN_RESOLUTION);
+    for (size_t i = 0; i < SCAN_RESOLUTION; i++)
+    {
+        if (entry.bins[i] != SCAN_PROFILE_EMPTY_BIN) {
+            CHECK(frame[2 * sizeof(float) + i] == entry.bins[i]);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = argc > 1 ? argv[1] : "scan_corpus.txt";
+    std::ifstream file(path);
+    CHECK(file.is_open());
+
+    size_t nbEntries = 0;
+    CorpusEntry entry;
+    while (readEntry(file, entry))
+    {
+        replay(entry);
+        nbEntries++;
+    }
+    CHECK(file.eof());
+    CHECK(nbEntries > 0);
+    HOST_TEST_MAIN_END();
+}
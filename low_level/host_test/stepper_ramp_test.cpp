@@ -0,0 +1,87 @@
+/*
+    Speed profile of the Z stepper (StepperRamp.h), with the parameters of
+    ActuatorMgr: the step rate never exceeds the cruise rate, every step of
+    the move is made, and the move lasts as long as the ideal trapezoid.
+*/
+
+#include <Arduino.h>
+#include "HostTest.h"
+#include "../StepperRamp.h"
+
+uint32_t host_clock_us = 0;
+int host_test_failures = 0;
+
+#define TEST_ACCELERATION   (5000 * 16)     // microstep/s² (ACT_MGR_Z_ACCELERATION at 16 microsteps)
+#define TEST_SPEED          (16000)         // microstep/s (ACT_MGR_Z_MAX_STEP_RATE)
+
+struct RampRun
+{
+    uint32_t steps;         // Steps made (the first one is immediate)
+    uint64_t duration;      // µs, from the first to the last step
+    uint32_t minInterval;   // µs
+    uint32_t firstInterval; // µs
+    uint32_t lastInterval;  // µs
+};
+
+static RampRun run(uint32_t steps, float speed)
+{
+    StepperRamp ramp(TEST_ACCELERATION, TEST_ACCELERATION);
+    ramp.start(steps, speed);
+    RampRun r = { 0, 0, UINT32_MAX, 0, 0 };
+    if (ramp.getStepsRemaining() == 0) {
+        return r;
+    }
+    uint32_t interval;
+    do
+    {
+        r.steps++;
+        interval = ramp.nextStep();
+        if (interval > 0)
+        {
+            r.duration += interval;
+            r.minInterval = min(r.minInterval, interval);
+            if (r.firstInterval == 0) {
+                r.firstInterval = interval;
+            }
+            r.lastInterval = interval;
+        }
+    } while (interval > 0);
+    CHECK(ramp.getStepsCompleted() == steps);
+    return r;
+}
+
+/* Duration of the ideal profile from the first to the last step (µs) */
+static double idealDuration(uint32_t steps, double speed)
+{
+    double rampSteps = speed * speed / (2.0 * TEST_ACCELERATION);
+    if (2 * rampSteps > steps) {
+        return 2e6 * sqrt(steps / (double)TEST_ACCELERATION);
+    }
+    return 1e6 * (2 * speed / TEST_ACCELERATION + (steps - 2 * rampSteps) / speed);
+}
+
+static void testMove(uint32_t steps, float speed)
+{
+    RampRun r = run(steps, speed);
+    double ideal = idealDuration(steps, speed);
+    printf("%6u steps at %5.0f step/s: %7.1f ms (ideal %7.1f ms), intervals %u..%u us, ends %u/%u us\n",
+        (unsigned)steps, speed, r.duration / 1000.0, ideal / 1000.0,
+        (unsigned)r.minInterval, (unsigned)r.firstInterval, (unsigned)r.firstInterval, (unsigned)r.lastInterval);
+    CHECK(r.steps == steps);
+    CHECK(r.minInterval >= 1e6 / speed);
+    CHECK(fabs(r.duration - ideal) < 0.05 * ideal);
+    CHECK(fabs((double)r.firstInterval - r.lastInterval) < 0.1 * r.firstInterval);
+}
+
+int main()
+{
+    testMove(60000, TEST_SPEED);    // 150 mm, cruise reached
+    testMove(1600, TEST_SPEED);     // 4 mm, just below the cruise speed
+    testMove(200, TEST_SPEED);      // 0.5 mm, triangular profile
+    testMove(20000, 1000);          // Slow move, short ramps
+
+    CHECK(run(0, TEST_SPEED).steps == 0);
+    CHECK(run(100, 0).steps == 0);
+    CHECK(run(1, TEST_SPEED).steps == 1);
+    HOST_TEST_MAIN_END();
+}
@@ -0,0 +1,145 @@
+#ifndef HOST_ARDUINO_h
+#define HOST_ARDUINO_h
+
+/*
+    Minimal Arduino environment for the host tests: the clock is driven by
+    the test (host_clock_us), the serial ports are replaced by Stream
+    implementations of the test.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <algorithm>
+#include <vector>
+
+using std::min;
+using std::max;
+
+#define PI      3.1415926535897932384626433832795
+#define TWO_PI  6.283185307179586476925286766559
+
+extern uint32_t host_clock_us;
+
+inline uint32_t micros() { return host_clock_us; }
+inline uint32_t millis() { return host_clock_us / 1000; }
+
+/* Single threaded: nothing to mask */
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+/*
+    The timers fire from host_advance_clock(), at their exact deadline:
+    a test that uses them moves the clock with it rather than host_clock_us.
+*/
+class IntervalTimer
+{
+public:
+    IntervalTimer() : callback(nullptr), period(0), deadline(0)
+    {
+        timers().push_back(this);
+    }
+    ~IntervalTimer()
+    {
+        timers().erase(std::find(timers().begin(), timers().end(), this));
+    }
+    bool begin(void (*function)(), uint32_t microseconds)
+    {
+        callback = function;
+        period = microseconds;
+        deadline = host_clock_us + microseconds;
+        return true;
+    }
+    void end() { callback = nullptr; }
+    void priority(uint8_t) {}
+
+    static void advanceClock(uint32_t duration)
+    {
+        uint32_t target = host_clock_us + duration;
+        while (true)
+        {
+            IntervalTimer *next = nullptr;
+            for (IntervalTimer *t : timers()) {
+                if (t->callback != nullptr && (int32_t)(target - t->deadline) >= 0 &&
+                    (next == nullptr || (int32_t)(t->deadline - next->deadline) < 0)) {
+                    next = t;
+                }
+            }
+            if (next == nullptr) {
+                break;
+            }
+            host_clock_us = next->deadline;
+            next->deadline += next->period;     // Periodic unless restarted or stopped by the callback
+            next->callback();
+        }
+        host_clock_us = target;
+    }
+
+private:
+    static std::vector<IntervalTimer*> & timers()
+    {
+        static std::vector<IntervalTimer*> list;
+        return list;
+    }
+
+    void (*callback)();
+    uint32_t period;    // µs
+    uint32_t deadline;  // µs
+};
+
+inline void host_advance_clock(uint32_t duration)
+{
+    IntervalTimer::advanceClock(duration);
+}
+
+template<class T, class L, class H>
+auto constrain(T x, L low, H high) -> decltype(x + low + high)
+{
+    return x < low ? low : (x > high ? high : x);
+}
+
+class Printable;
+
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t b) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size)
+    {
+        for (size_t i = 0; i < size; i++) {
+            write(buffer[i]);
+        }
+        return size;
+    }
+    virtual void flush() {}
+
+    size_t printf(const char *format, ...)
+    {
+        char buffer[256];
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf(buffer, sizeof(buffer), format, args);
+        va_end(args);
+        if (length < 0) {
+            return 0;
+        }
+        return write((const uint8_t *)buffer, min((size_t)length, sizeof(buffer) - 1));
+    }
+
+    size_t print(const Printable & obj);    // Printable.h
+};
+
+class Stream : public Print
+{
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+};
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef HOST_DYNAMIXEL_h
+#define HOST_DYNAMIXEL_h
+
+/* Status codes of the Dynamixel library, as used by the firmware */
+
+#include <stdint.h>
+
+typedef uint8_t DynamixelStatus;
+
+#define DYN_STATUS_OK                   0
+#define DYN_STATUS_INPUT_VOLTAGE_ERROR  1
+#define DYN_STATUS_ANGLE_LIMIT_ERROR    2
+#define DYN_STATUS_OVERHEATING_ERROR    4
+#define DYN_STATUS_RANGE_ERROR          8
+#define DYN_STATUS_CHECKSUM_ERROR       16
+#define DYN_STATUS_OVERLOAD_ERROR       32
+#define DYN_STATUS_INSTRUCTION_ERROR    64
+#define DYN_STATUS_TIMEOUT              1
+#define DYN_STATUS_COM_ERROR            128
+
+#endif
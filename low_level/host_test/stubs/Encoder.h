@@ -0,0 +1,20 @@
+#ifndef HOST_ENCODER_h
+#define HOST_ENCODER_h
+
+/*
+    Both odometry wheels read the same count, driven by the test
+    (host_encoder_ticks): the simulated robot moves in a straight line.
+*/
+
+#include <Arduino.h>
+
+extern int32_t host_encoder_ticks;
+
+class Encoder
+{
+public:
+    Encoder(uint8_t pin1, uint8_t pin2) {}
+    int32_t read() { return host_encoder_ticks; }
+};
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef HOST_PRINTABLE_h
+#define HOST_PRINTABLE_h
+
+#include <Arduino.h>
+
+class Printable
+{
+public:
+    virtual ~Printable() {}
+    virtual size_t printTo(Print & p) const = 0;
+};
+
+inline size_t Print::print(const Printable & obj)
+{
+    return obj.printTo(*this);
+}
+
+#endif
@@ -0,0 +1,165 @@
+/*
+    Speed scale of the TrajectoryFollower (setSpeedScale), simulated at the
+    motion control frequency on a straight line with a perfect motor:
+    - a scale below minAimSpeed is followed, not raised to minAimSpeed;
+    - a scale of 0 stops the robot, and the move ends holding its point
+      (MOVE_ENDED, isHolding()) without a blocking error.
+*/
+
+#include <Arduino.h>
+#include <Printable.h>
+#include "HostTest.h"
+#include "../Utils.h"
+
+/* The hardware dependencies of TrajectoryFollower.h are replaced below */
+#define _MOTOR_h
+#define _DIRECTIONCONTROLLER_h
+#define _COMMUNICATIONSERVER_h
+
+class Motor
+{
+public:
+    void run(float speed) { aimSpeed = speed; }
+    static float aimSpeed;  // mm/s
+};
+
+class DirectionController
+{
+public:
+    static DirectionController & Instance()
+    {
+        static DirectionController instance;
+        return instance;
+    }
+    void setAimCurvature(float curvature) { aimCurvature = curvature; }
+    float getRealCurvature() const { return aimCurvature; }
+
+private:
+    float aimCurvature = 0;
+};
+
+enum Channel
+{
+    PID_SPEED,
+    PID_TRANS,
+    PID_TRAJECTORY,
+    STOPPING_MGR
+};
+
+class HostServer
+{
+public:
+    void printf(const char *format, ...) {}
+    void printf(Channel channel, const char *format, ...) {}
+    void printf_err(const char *format, ...) {}
+    void print(Channel channel, const Printable & obj) {}
+    void asynchronous_trace(uint32_t line) { traces++; }
+    uint32_t traces = 0;
+};
+HostServer Server;
+
+#include "../TrajectoryFollower.h"
+
+uint32_t host_clock_us = 0;
+int host_test_failures = 0;
+int32_t host_encoder_ticks = 0;
+float Motor::aimSpeed = 0;
+
+#define FREQ_ASSERV         1000    // Hz
+#define TEST_MAX_SPEED      1000    // mm/s
+#define TEST_DISTANCE       3000    // mm
+
+class Simulation
+{
+public:
+    Simulation() :
+        follower(FREQ_ASSERV, position, moveStatus)
+    {
+        moveStatus = MOVE_OK;
+        distance = 0;
+        follower.setMotionControlLevel(4);
+        followPosition();
+    }
+
+    /* Runs the motion control for 'duration' ms */
+    void run(uint32_t duration)
+    {
+        for (uint32_t i = 0; i < duration; i++)
+        {
+            host_clock_us += 1000000 / FREQ_ASSERV;
+            distance += Motor::aimSpeed / FREQ_ASSERV;
+            host_encoder_ticks = (int32_t)(distance / TICK_TO_MM);
+            followPosition();
+            follower.control();
+        }
+    }
+
+    /* Non stop point under the robot: the trajectory is always followed exactly */
+    void followPosition()
+    {
+        Position p(position.x, position.y, position.orientation);
+        follower.setTrajectoryPoint(TrajectoryPoint(p, 0, TEST_MAX_SPEED, false, false));
+    }
+
+    void startMove()
+    {
+        follower.setDistanceToDrive(TEST_DISTANCE);
+        follower.startMove();
+    }
+
+    volatile Position position;
+    volatile MoveStatus moveStatus;
+    float distance;     // mm
+    TrajectoryFollower follower;
+};
+
+/* A reduced speed below minAimSpeed is reached and kept */
+static void testReducedSpeed()
+{
+    Simulation sim;
+    float minAimSpeed = sim.follower.getTunings().minAimSpeed;
+    sim.follower.setSpeedScale(0.2);
+    sim.startMove();
+    sim.run(1000);
+
+    printf("scale 0.2: %g mm/s (minAimSpeed %g mm/s)\n", Motor::aimSpeed, minAimSpeed);
+    CHECK(sim.follower.getMovePhase() == MOVING);
+    CHECK(ABS(Motor::aimSpeed - 0.2 * TEST_MAX_SPEED) < 1);
+    CHECK(Motor::aimSpeed < minAimSpeed);
+    CHECK(sim.moveStatus == MOVE_OK);
+}
+
+/* A scale of 0 during the move ends it holding the current point */
+static void testPause()
+{
+    Simulation sim;
+    sim.follower.setSpeedScale(1);
+    sim.startMove();
+    sim.run(500);
+    CHECK(sim.follower.getMovePhase() == MOVING);
+    CHECK(Motor::aimSpeed > 500);
+
+    sim.follower.setSpeedScale(0);
+    sim.run(1000);
+    printf("scale 0: stopped after %g mm, phase %u\n", sim.distance, (unsigned)sim.follower.getMovePhase());
+    CHECK(sim.follower.getMovePhase() == MOVE_ENDED);
+    CHECK(sim.follower.isHolding());
+    CHECK(sim.moveStatus == MOVE_OK);
+    CHECK(Motor::aimSpeed == 0);
+    CHECK(sim.distance < TEST_DISTANCE);
+
+    /* The move can be resumed on the same point */
+    sim.follower.setSpeedScale(1);
+    sim.startMove();
+    sim.run(500);
+    CHECK(sim.follower.getMovePhase() == MOVING);
+    CHECK(!sim.follower.isHolding());
+    CHECK(Motor::aimSpeed > 500);
+}
+
+int main()
+{
+    testReducedSpeed();
+    testPause();
+    HOST_TEST_MAIN_END();
+}
@@ -6,6 +6,7 @@
 
 #include <Ethernet.h>
 #include <Wire.h>
+#include <SD.h>
 #include <Dynamixel.h>
 #include <DynamixelInterface.h>
 #include <DynamixelMotor.h>
@@ -24,6 +25,8 @@
 #include "Dashboard.h"
 #include "SerialAX12.h"
 #include "SmokeMgr.h"
+#include "BootMgr.h"
+#include "DynamixelBusMgr.h"
 
 #define ODOMETRY_REPORT_PERIOD  20  // ms
 
@@ -31,7 +34,7 @@
 void setup() {}
 void loop()
 {
-    OrderMgr orderManager;
+    OrderMgr &orderManager = OrderMgr::Instance();
     MotionControlSystem &motionControlSystem = MotionControlSystem::Instance();
     DirectionController &directionController = DirectionController::Instance();
     SensorsMgr &sensorMgr = SensorsMgr::Instance();
@@ -39,37 +42,22 @@ void loop()
     Dashboard &dashboard = Dashboard::Instance();
     ContextualLightning &contextualLightning = ContextualLightning::Instance();
     SmokeMgr &smokeMgr = SmokeMgr::Instance();
+    BootMgr &bootMgr = BootMgr::Instance();
+    DynamixelBusMgr &dynamixelBus = DynamixelBusMgr::Instance();
     IntervalTimer motionControlTimer;
-    IntervalTimer actuatorMgrTimer;
     uint32_t odometryReportTimer = 0;
     std::vector<uint8_t> odometryReport;
+    std::vector<uint8_t> sensorsReport;
+    std::vector<uint8_t> sensorsHealthReport;
+    std::vector<uint8_t> puckTrackingReport;
 
     Wire.begin();
-    dashboard.init();
-    if (Server.begin() != 0)
-    {
-        dashboard.setErrorLevel(Dashboard::WEAK_ERROR);
-    }
-    SerialAX12.begin(SERIAL_AX12_BAUDRATE, SERIAL_AX12_TIMEOUT);
-    if (directionController.init() != EXIT_SUCCESS)
-    {
-        dashboard.setErrorLevel(Dashboard::WEAK_ERROR);
-    }
-    if (actuatorMgr.init() != EXIT_SUCCESS)
-    {
-        dashboard.setErrorLevel(Dashboard::STRONG_WARNING);
-    } else {
-        actuatorMgr.goToHome();
-    }
-    if (sensorMgr.init() != EXIT_SUCCESS)
-    {
-        dashboard.setErrorLevel(Dashboard::STRONG_WARNING);
-    }
+    bootMgr.begin();    // Les capteurs ToF, la prise d'origine et la carte SD continuent depuis bootMgr.update()
 
     motionControlTimer.priority(253);
     motionControlTimer.begin(motionControlInterrupt, PERIOD_ASSERV);
-    actuatorMgrTimer.priority(252);
-    actuatorMgrTimer.begin(actuatorMgrInterrupt, ACT_MGR_INTERRUPT_PERIOD);
+    bootMgr.controlStarted();
+    Server.setEmergencyStopHandler(emergencyStop);
 
     contextualLightning.setNightLight(ContextualLightning::NIGHT_LIGHT_LOW);
 
@@ -82,13 +70,18 @@ void loop()
         directionController.control();
         //t3 = micros();
         actuatorMgr.mainLoopControl();
+        dynamixelBus.update();  // Requêtes AX12 de la direction puis des actionneurs
+        Server.receive();       // Les arrêts d'urgence sont traités dès leur réception
         //t4 = micros();
         dashboard.update();
         //t5 = micros();
         contextualLightning.update();
         smokeMgr.update();
+        Server.receive();
         //t6 = micros();
         sensorMgr.update(motionControlSystem.getMovingDirection());
+        bootMgr.update();
+        Server.receive();
         //t7 = micros();
 
         if (millis() - odometryReportTimer > ODOMETRY_REPORT_PERIOD)
@@ -106,8 +99,27 @@ void loop()
             Serializer::writeBool(motionControlSystem.isMovingForward(), odometryReport);
             sensorMgr.appendValuesToVect(odometryReport);
             actuatorMgr.appendSensorsValuesToVect(odometryReport);
+            Serializer::writeUInt(motionControlSystem.getPredictedArrivalTime(), odometryReport);
             Server.sendData(ODOMETRY_AND_SENSORS, odometryReport);
 
+            sensorsReport.clear();
+            uint32_t now = micros();
+            Serializer::writeUInt(millis(), sensorsReport);
+            sensorMgr.appendTimestampedValuesToVect(sensorsReport, motionControlSystem, now);
+            actuatorMgr.appendTimestampedSensorsValuesToVect(sensorsReport, motionControlSystem, now);
+            Server.sendData(SENSORS_TIMESTAMPED, sensorsReport);
+
+            sensorsHealthReport.clear();
+            sensorMgr.appendHealthToVect(sensorsHealthReport);
+            Server.sendData(SENSORS_HEALTH, sensorsHealthReport);
+
+            if (actuatorMgr.isTrackingPuck())
+            {
+                puckTrackingReport.clear();
+                actuatorMgr.appendPuckTrackingToVect(puckTrackingReport);
+                Server.sendData(PUCK_TRACKING, puckTrackingReport);
+            }
+
             motionControlSystem.sendLogs();
         }
 
@@ -156,10 +168,9 @@ void motionControlInterrupt()
 }
 
 
-void actuatorMgrInterrupt()
+void emergencyStop()
 {
-    static ActuatorMgr &actuatorMgr = ActuatorMgr::Instance();
-    actuatorMgr.interruptControl();
+    MotionControlSystem::Instance().stop_and_clear_trajectory();
 }
 
 
@@ -1,7 +1,16 @@
 #ifndef _MEDIAN_h
 #define _MEDIAN_h
 
+#define HAMPEL_DEFAULT_THRESHOLD    3.0     // Outlier if |x - median| > threshold * sigma
+#define HAMPEL_MAD_TO_SIGMA         1.4826  // Scale factor between MAD and standard deviation (gaussian noise)
 
+
+/*
+	Sliding median: the sorted copy of the window is maintained incrementally.
+	Each add() removes the oldest value from the sorted buffer and inserts the
+	new one in place (binary search + shift limited to the values lying between
+	the removed and the inserted one), instead of sorting the whole window.
+*/
 template<typename T, size_t const BUFFER_SIZE>
 class Median
 {
@@ -19,13 +28,26 @@ public:
 			sortedBuffer[i] = (T)0;
 		}
 		insertionIndex = 0;
+		primed = false;
 	}
-	
+
 	void add(T element)
 	{
+		if (!primed)
+		{
+			// The first value fills the whole window, so that the output is meaningful right away
+			for (size_t i = 0; i < BUFFER_SIZE; i++)
+			{
+				rawBuffer[i] = element;
+				sortedBuffer[i] = element;
+			}
+			primed = true;
+			return;
+		}
+		T removed = rawBuffer[insertionIndex];
 		rawBuffer[insertionIndex] = element;
 		insertionIndex = (insertionIndex + 1) % BUFFER_SIZE;
-		sortBuffer();
+		replaceSorted(removed, element);
 	}
 
 	T value() const
@@ -33,40 +55,140 @@ public:
 		return sortedBuffer[BUFFER_SIZE / 2];
 	}
 
+	/* Median absolute deviation of the window, computed by merging both sides of the sorted buffer */
+	T deviation() const
+	{
+		T median = value();
+		size_t left = BUFFER_SIZE / 2;
+		size_t right = BUFFER_SIZE / 2 + 1;
+		T dev = (T)0;
+		for (size_t k = 0; k < BUFFER_SIZE / 2; k++)
+		{
+			if (left > 0 && (right >= BUFFER_SIZE ||
+				median - sortedBuffer[left - 1] <= sortedBuffer[right] - median))
+			{
+				left--;
+				dev = median - sortedBuffer[left];
+			}
+			else
+			{
+				dev = sortedBuffer[right] - median;
+				right++;
+			}
+		}
+		return dev;
+	}
+
 private:
 	T rawBuffer[BUFFER_SIZE];
 	T sortedBuffer[BUFFER_SIZE];
 	size_t insertionIndex;
+	bool primed;
 
-	void sortBuffer()
+	void replaceSorted(T removed, T added)
 	{
-		for (size_t i = 0; i < BUFFER_SIZE; i++)
+		size_t i = lowerBound(removed);
+		if (added > removed)
 		{
-			sortedBuffer[i] = rawBuffer[i];
+			while (i + 1 < BUFFER_SIZE && sortedBuffer[i + 1] < added)
+			{
+				sortedBuffer[i] = sortedBuffer[i + 1];
+				i++;
+			}
+		}
+		else
+		{
+			while (i > 0 && sortedBuffer[i - 1] > added)
+			{
+				sortedBuffer[i] = sortedBuffer[i - 1];
+				i--;
+			}
 		}
+		sortedBuffer[i] = added;
+	}
 
-		for (size_t j = 0; j < BUFFER_SIZE - 1; j++)
+	/* Index of the first element of sortedBuffer which is not lower than v */
+	size_t lowerBound(T v) const
+	{
+		size_t low = 0;
+		size_t high = BUFFER_SIZE;
+		while (low < high)
 		{
-			T min = sortedBuffer[j];
-			size_t min_index = j;
-			for (size_t i = j + 1; i < BUFFER_SIZE; i++)
+			size_t mid = (low + high) / 2;
+			if (sortedBuffer[mid] < v)
 			{
-				if (sortedBuffer[i] < min)
-				{
-					min = sortedBuffer[i];
-					min_index = i;
-				}
+				low = mid + 1;
+			}
+			else
+			{
+				high = mid;
 			}
-			swap(min_index, j);
 		}
+		return low;
 	}
+};
+
 
-	void swap(size_t i, size_t j)
+/*
+	Hampel filter: the last value added is replaced by the median of the window
+	when it lies too far from it (threshold expressed in estimated standard
+	deviations, derived from the median absolute deviation).
+	minDeviation allows to keep the small variations when the window is
+	perfectly stable (MAD of zero).
+*/
+template<typename T, size_t const BUFFER_SIZE>
+class Hampel
+{
+public:
+	Hampel()
+	{
+		threshold = HAMPEL_DEFAULT_THRESHOLD;
+		minDeviation = (T)0;
+		reset();
+	}
+
+	void reset()
 	{
-		T mem = sortedBuffer[i];
-		sortedBuffer[i] = sortedBuffer[j];
-		sortedBuffer[j] = mem;
+		median.reset();
+		lastValue = (T)0;
 	}
+
+	void add(T element)
+	{
+		median.add(element);
+		T med = median.value();
+		float limit = threshold * HAMPEL_MAD_TO_SIGMA * (float)median.deviation();
+		if (limit < (float)minDeviation)
+		{
+			limit = (float)minDeviation;
+		}
+		T delta = element > med ? element - med : med - element;
+		if ((float)delta > limit)
+		{
+			lastValue = med;
+		}
+		else
+		{
+			lastValue = element;
+		}
+	}
+
+	T value() const
+	{
+		return lastValue;
+	}
+
+	void setThreshold(float aThreshold, T aMinDeviation)
+	{
+		threshold = aThreshold;
+		minDeviation = aMinDeviation;
+	}
+
+private:
+	Median<T, BUFFER_SIZE> median;
+	T lastValue;
+	float threshold;
+	T minDeviation;
 };
 
 
@@ -3,7 +3,14 @@
 #define TOF_SENSOR_I2C_TIMEOUT          50  // ms
 #define TOF_SENSOR_I2C_TIMEOUT_STARTUP  200 // ms
 #define TOF_SENSOR_INIT_DELAY           50  // ms
+#define TOF_SENSOR_RESET_DURATION       2   // ms
+#define TOF_SENSOR_BOOT_DELAY           5   // ms (tBOOT is 1.4ms max for both VL chips)
 #define TOF_SENSOR_SHORT_RANGE_UPDATE_PERIOD    20  // ms
+#define TOF_SENSOR_SHORT_RANGE_FAST_PERIOD      10  // ms (shortest period allowed by the VL6180X)
+#define TOF_SENSOR_SHORT_RANGE_CONVERGENCE      12  // ms
+#define TOF_SENSOR_SHORT_RANGE_FAST_CONVERGENCE 5   // ms (convergence + readout must fit in the fast period)
+
+ToF_sensor *ToF_sensor::defaultAddressOwner = nullptr;
 
 ToF_sensor::ToF_sensor()
 {
@@ -13,6 +20,8 @@ ToF_sensor::ToF_sensor()
     minRange = 0;
     maxRange = 0;
     isON = false;
+    bootState = TOF_OFF;
+    bootTimer = 0;
     debug_stream = nullptr;
     fully_defined = false;
 }
@@ -23,6 +32,8 @@ ToF_sensor::ToF_sensor(uint8_t address, uint8_t pinStandby, int32_t minRange,
         maxRange(maxRange), debug_stream(debug), name(name)
 {
     isON = false;
+    bootState = TOF_OFF;
+    bootTimer = 0;
     fully_defined = true;
     standby();
 }
@@ -38,7 +49,11 @@ SensorValue ToF_sensor::getMeasure()
     int32_t distance = 0;
     int ret = measureDistance(distance);
 
-    if (ret != EXIT_SUCCESS)
+    if (ret == TOF_MEASURE_NOT_READY)
+    {
+        sensorValue = (SensorValue)SENSOR_NOT_UPDATED;
+    }
+    else if (ret != EXIT_SUCCESS)
     {
         sensorValue = (SensorValue)SENSOR_DEAD;
         standby();
@@ -69,6 +84,11 @@ void ToF_sensor::standby()
         pinMode(pinStandby, OUTPUT);
         digitalWrite(pinStandby, LOW);
         isON = false;
+        bootState = TOF_OFF;
+        if (defaultAddressOwner == this)
+        {
+            defaultAddressOwner = nullptr;
+        }
     }
 }
 
@@ -78,26 +98,89 @@ int ToF_sensor::powerON()
     {
         return EXIT_FAILURE;
     }
-    setTimeout(TOF_SENSOR_I2C_TIMEOUT_STARTUP);
-    print("PowerOn ToF ");
-    print(name);
-    print("...");
-    pinMode(pinStandby, INPUT);
-    delay(TOF_SENSOR_INIT_DELAY);
+    startPowerON();
+    while (isBooting())
+    {
+        if (defaultAddressOwner != nullptr && defaultAddressOwner != this)
+        {
+            defaultAddressOwner->updatePowerON();
+        }
+        updatePowerON();
+    }
+    return isON ? EXIT_SUCCESS : EXIT_FAILURE;
+}
 
-    int ret = init();
-    if (ret == EXIT_SUCCESS)
+void ToF_sensor::startPowerON()
+{
+    if (!fully_defined)
     {
-        isON = true;
-        print("OK\n");
+        return;
     }
-    else
+    standby();
+    bootState = TOF_RESETTING;
+    bootTimer = millis();
+}
+
+void ToF_sensor::updatePowerON()
+{
+    switch (bootState)
     {
-        standby();
-        print("NOT OK\n");
+    case TOF_RESETTING:
+        if (millis() - bootTimer >= TOF_SENSOR_RESET_DURATION && defaultAddressOwner == nullptr)
+        {
+            defaultAddressOwner = this;
+            print("PowerOn ToF ");
+            print(name);
+            print("...");
+            pinMode(pinStandby, INPUT);
+            bootState = TOF_BOOTING;
+            bootTimer = millis();
+        }
+        break;
+    case TOF_BOOTING:
+        if (millis() - bootTimer >= TOF_SENSOR_BOOT_DELAY)
+        {
+            setTimeout(TOF_SENSOR_I2C_TIMEOUT_STARTUP);
+            int ret = init();
+            setTimeout(TOF_SENSOR_I2C_TIMEOUT);
+            if (ret == EXIT_SUCCESS)
+            {
+                // The sensor now answers on its own address
+                defaultAddressOwner = nullptr;
+                bootState = TOF_CONFIGURING;
+                bootTimer = millis();
+            }
+            else
+            {
+                failPowerON();
+            }
+        }
+        break;
+    case TOF_CONFIGURING:
+        if (millis() - bootTimer >= TOF_SENSOR_INIT_DELAY)
+        {
+            if (start() == EXIT_SUCCESS)
+            {
+                isON = true;
+                bootState = TOF_ON;
+                print("OK\n");
+            }
+            else
+            {
+                failPowerON();
+            }
+        }
+        break;
+    default:
+        break;
     }
-    setTimeout(TOF_SENSOR_I2C_TIMEOUT);
-    return ret;
+}
+
+void ToF_sensor::failPowerON()
+{
+    standby();
+    bootState = TOF_FAILED;
+    print("NOT OK\n");
 }
 
 int ToF_shortRange::init()
@@ -109,15 +192,56 @@ int ToF_shortRange::init()
     }
     vlSensor.configureDefault();
     vlSensor.setAddress(i2cAddress);
-    vlSensor.writeReg(VL6180X::SYSRANGE__MAX_CONVERGENCE_TIME, 12);
     vlSensor.stopContinuous();
-    delay(TOF_SENSOR_INIT_DELAY);
-    vlSensor.startRangeContinuous(TOF_SENSOR_SHORT_RANGE_UPDATE_PERIOD);
     return ret;
 }
 
+int ToF_shortRange::start()
+{
+    if (fastMode)
+    {
+        vlSensor.writeReg(VL6180X::SYSRANGE__MAX_CONVERGENCE_TIME, TOF_SENSOR_SHORT_RANGE_FAST_CONVERGENCE);
+        vlSensor.startRangeContinuous(TOF_SENSOR_SHORT_RANGE_FAST_PERIOD);
+    }
+    else
+    {
+        vlSensor.writeReg(VL6180X::SYSRANGE__MAX_CONVERGENCE_TIME, TOF_SENSOR_SHORT_RANGE_CONVERGENCE);
+        vlSensor.startRangeContinuous(TOF_SENSOR_SHORT_RANGE_UPDATE_PERIOD);
+    }
+    return vlSensor.last_status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+void ToF_shortRange::setFastMode(bool fast)
+{
+    if (fast == fastMode)
+    {
+        return;
+    }
+    fastMode = fast;
+    if (isON)
+    {
+        vlSensor.stopContinuous();
+        if (start() != EXIT_SUCCESS)
+        {
+            print("Sensor ");
+            print(name);
+            print(" failed to change its period\n");
+        }
+    }
+}
+
 int ToF_shortRange::measureDistance(int32_t &distance)
 {
+    // Non-blocking: the continuous mode raises the 'new sample ready' flag
+    uint8_t interruptStatus = vlSensor.readReg(VL6180X::RESULT__INTERRUPT_STATUS_GPIO);
+    if (vlSensor.last_status != 0)
+    {
+        return EXIT_FAILURE;
+    }
+    if ((interruptStatus & 0x04) == 0)
+    {
+        return TOF_MEASURE_NOT_READY;
+    }
     distance = vlSensor.readRangeContinuousMillimeters();
     if (vlSensor.timeoutOccurred() || vlSensor.last_status != 0)
     {
@@ -135,8 +259,6 @@ int ToF_longRange::init()
     {
         vlSensor.setAddress(i2cAddress);
         vlSensor.stopContinuous();
-        delay(TOF_SENSOR_INIT_DELAY);
-        vlSensor.startContinuous();
         return EXIT_SUCCESS;
     }
     else
@@ -145,6 +267,12 @@ int ToF_longRange::init()
     }
 }
 
+int ToF_longRange::start()
+{
+    vlSensor.startContinuous();
+    return vlSensor.last_status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 int ToF_longRange::measureDistance(int32_t &distance)
 {
     uint8_t foo;
@@ -15,6 +15,20 @@ enum SensorMetadata
     NO_OBSTACLE = 0x03
 };
 
+/* Return value of measureDistance() when no new measure is available yet */
+#define TOF_MEASURE_NOT_READY   2
+
+/* Power-on sequence state, advanced by updatePowerON() */
+enum SensorBootState
+{
+    TOF_OFF,            // Standby pin held low
+    TOF_RESETTING,      // Standby pin held low, waiting to release it (and for the default I2C address to be free)
+    TOF_BOOTING,        // Standby pin released, waiting for the sensor to boot
+    TOF_CONFIGURING,    // Sensor initialized, waiting before starting continuous ranging
+    TOF_ON,             // Ranging
+    TOF_FAILED          // Power-on failed, back in standby
+};
+
 class ToF_sensor
 {
 public:
@@ -25,12 +39,30 @@ public:
     /* Set I2C timeout (ms) */
     virtual void setTimeout(uint16_t timeout) = 0;
 
-    SensorValue getMeasure();
+    virtual SensorValue getMeasure();
     void standby();
+
+    /* Blocking power-on */
     int powerON();
 
+    /* Non-blocking power-on: start the sequence, then call updatePowerON() until isBooting() is false */
+    void startPowerON();
+    void updatePowerON();
+    bool isBooting() const
+    {
+        return bootState == TOF_RESETTING || bootState == TOF_BOOTING || bootState == TOF_CONFIGURING;
+    }
+    SensorBootState getBootState() const
+    {
+        return bootState;
+    }
+
 //protected:
+    /* Initialization on the default I2C address, ending with the address change */
     virtual int init() = 0;
+    /* Start continuous ranging */
+    virtual int start() = 0;
+    /* Returns TOF_MEASURE_NOT_READY if the sensor does not block until the next measure */
     virtual int measureDistance(int32_t &distance) = 0;
 
     size_t print(const char *str)
@@ -51,8 +83,15 @@ public:
     int32_t minRange;  // [mm] Toute valeur strictement infrieure est considre comme un obstacle trop proche
     int32_t maxRange;  // [mm] Toute valeur strictement suprieure est considre comme une absence d'obstacle
     bool isON;
+    SensorBootState bootState;
+    uint32_t bootTimer; // ms
     Stream *debug_stream;
 
+    /* Sensor being powered on, thus using the default I2C address (only one at a time) */
+    static ToF_sensor *defaultAddressOwner;
+
+    void failPowerON();
+
 public:
     const char* name;
 };
@@ -60,25 +99,39 @@ public:
 class ToF_shortRange : public ToF_sensor
 {
 public:
-    ToF_shortRange() {}
+    ToF_shortRange()
+    {
+        fastMode = false;
+    }
     ToF_shortRange(uint8_t address, uint8_t pinStandby, int32_t minRange = 15,
         int32_t maxRange = 200, const char* name = "", Stream *debug = nullptr) :
         ToF_sensor(address, pinStandby, minRange, maxRange, name, debug)
-    {}
+    {
+        fastMode = false;
+    }
 
     void setTimeout(uint16_t timeout)
     {
         vlSensor.setTimeout(timeout);
     }
 
+    /*
+        Fast mode: shortest continuous period, with a convergence time reduced
+        accordingly. Meant for short range targets with a strong return signal.
+    */
+    void setFastMode(bool fast);
+
 private:
     int init();
+    int start();
     int measureDistance(int32_t &distance);
 
     VL6180X vlSensor;
+    bool fastMode;
 };
 
-template<size_t NB_VALUES>
+/* Filter is either Median or Hampel (see Median.h) */
+template<size_t NB_VALUES, template<typename, size_t> class Filter = Median>
 class ToF_shortRange_med : public ToF_shortRange
 {
 public:
@@ -90,12 +143,33 @@ public:
 
     SensorValue getMeasure()
     {
-        m_median.add(ToF_shortRange::getMeasure());
-        return m_median.value();
+        SensorValue val = ToF_shortRange::getMeasure();
+        if (val == (SensorValue)SENSOR_DEAD)
+        {
+            m_filter.reset();
+            return val;
+        }
+        else if (val == (SensorValue)SENSOR_NOT_UPDATED)
+        {
+            return val;
+        }
+        else if (val == (SensorValue)NO_OBSTACLE || val == (SensorValue)OBSTACLE_TOO_CLOSE)
+        {
+            // Status codes are not distances: they bypass the filter, which restarts from the next distance
+            m_filter.reset();
+            return val;
+        }
+        m_filter.add(val);
+        return m_filter.value();
+    }
+
+    Filter<SensorValue, NB_VALUES> & filter()
+    {
+        return m_filter;
     }
 
 private:
-    Median<SensorValue, NB_VALUES> m_median;
+    Filter<SensorValue, NB_VALUES> m_filter;
 };
 
 class ToF_longRange : public ToF_sensor
@@ -114,12 +188,14 @@ public:
 
 //private:
     int init();
+    int start();
     int measureDistance(int32_t &distance);
 
     VL53L0X vlSensor;
 };
 
-template<size_t NB_VALUES>
+/* Filter is either Median or Hampel (see Median.h) */
+template<size_t NB_VALUES, template<typename, size_t> class Filter = Median>
 class ToF_longRange_med : public ToF_longRange
 {
 public:
@@ -131,12 +207,33 @@ public:
 
     SensorValue getMeasure()
     {
-        m_median.add(ToF_longRange::getMeasure());
-        return m_median.value();
+        SensorValue val = ToF_longRange::getMeasure();
+        if (val == (SensorValue)SENSOR_DEAD)
+        {
+            m_filter.reset();
+            return val;
+        }
+        else if (val == (SensorValue)SENSOR_NOT_UPDATED)
+        {
+            return val;
+        }
+        else if (val == (SensorValue)NO_OBSTACLE || val == (SensorValue)OBSTACLE_TOO_CLOSE)
+        {
+            // Status codes are not distances: they bypass the filter, which restarts from the next distance
+            m_filter.reset();
+            return val;
+        }
+        m_filter.add(val);
+        return m_filter.value();
+    }
+
+    Filter<SensorValue, NB_VALUES> & filter()
+    {
+        return m_filter;
     }
 
 private:
-    Median<SensorValue, NB_VALUES> m_median;
+    Filter<SensorValue, NB_VALUES> m_filter;
 };
 
 